@@ -0,0 +1,189 @@
+#include "bench.h"
+#include "vars.h"
+#include <errno.h>
+#include <ftw.h>
+#include <signal.h>
+#include <sys/utsname.h>
+#include <time.h>
+
+#define MAX_RESULTS 128
+
+typedef struct {
+    char name[64];
+    long ops;
+    int samples;
+    double min_ns;      // per operation, over the samples
+    double median_ns;
+    double max_ns;
+} BenchResult;
+
+static BenchResult results[MAX_RESULTS];
+static int result_count = 0;
+
+static const char *filter = NULL;
+static bool quick = false;
+static char tmpdir[64] = "";
+
+uint64_t bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+long bench_ops(long ops) {
+    if (!quick) return ops;
+    return ops >= 10 ? ops / 10 : 1;
+}
+
+bool bench_wanted(const char *prefix) {
+    if (filter == NULL) return true;
+    // "-f pipe" and "-f pipeline/spawn/8" both select the pipeline group
+    size_t len = strlen(prefix) < strlen(filter) ? strlen(prefix) : strlen(filter);
+    return strncmp(prefix, filter, len) == 0;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+void bench_run(const char *name, bench_fn fn, void *ctx, long ops, int samples) {
+    if (filter != NULL && strncmp(name, filter, strlen(filter)) != 0) return;
+    if (result_count == MAX_RESULTS) {
+        fprintf(stderr, "shell_bench: too many results, %s skipped\n", name);
+        return;
+    }
+
+    double per_op[samples];
+    for (int i = 0; i < samples; i++) {
+        per_op[i] = (double)fn(ctx, ops) / ops;
+    }
+    qsort(per_op, samples, sizeof(double), compare_doubles);
+
+    BenchResult *result = &results[result_count++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->ops = ops;
+    result->samples = samples;
+    result->min_ns = per_op[0];
+    result->median_ns = per_op[samples / 2];
+    result->max_ns = per_op[samples - 1];
+
+    fprintf(stderr, "%-32s %12.1f ns/op  (%ld ops x %d)\n", name, result->median_ns, ops, samples);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    remove(path);
+    return 0;
+}
+
+static void remove_tmpdir(void) {
+    if (tmpdir[0] != '\0') {
+        nftw(tmpdir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+}
+
+const char *bench_tmpdir(void) {
+    if (tmpdir[0] == '\0') {
+        snprintf(tmpdir, sizeof(tmpdir), "/tmp/shell_bench.XXXXXX");
+        if (mkdtemp(tmpdir) == NULL) {
+            perror("mkdtemp");
+            exit(1);
+        }
+        atexit(remove_tmpdir);
+    }
+    return tmpdir;
+}
+
+// Write every result as one JSON document
+static void write_json(FILE *out) {
+    struct utsname host;
+    uname(&host);
+    char timestamp[32];
+    time_t now = time(NULL);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"schema\": 1,\n");
+    fprintf(out, "  \"timestamp\": \"%s\",\n", timestamp);
+    fprintf(out, "  \"quick\": %s,\n", quick ? "true" : "false");
+    fprintf(out, "  \"host\": {\"sysname\": \"%s\", \"release\": \"%s\", \"machine\": \"%s\", \"cpus\": %ld},\n",
+            host.sysname, host.release, host.machine, sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(out, "  \"benchmarks\": [\n");
+    for (int i = 0; i < result_count; i++) {
+        const BenchResult *r = &results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"ops\": %ld, \"samples\": %d, "
+                     "\"ns_per_op\": {\"min\": %.1f, \"median\": %.1f, \"max\": %.1f}}%s\n",
+                r->name, r->ops, r->samples, r->min_ns, r->median_ns, r->max_ns,
+                i + 1 < result_count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: shell_bench [-q] [-f filter] [-o file]\n"
+                    "  -q         quick run with 10x fewer operations\n"
+                    "  -f filter  only run benchmarks whose name starts with filter\n"
+                    "  -o file    write the JSON results to file instead of stdout\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *output = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "qf:o:")) != -1) {
+        switch (opt) {
+            case 'q':
+                quick = true;
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+
+    // pipelines under test write to stdout: keep it for the results only
+    FILE *out = NULL;
+    if (output != NULL) {
+        out = fopen(output, "w");
+    } else {
+        int fd = dup(STDOUT_FILENO);
+        out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    }
+    if (out == NULL) {
+        perror(output != NULL ? output : "stdout");
+        return 1;
+    }
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+
+    // as in the shell: builtins writing into a closed pipe see EPIPE
+    signal(SIGPIPE, SIG_IGN);
+    vars_init();
+
+    if (bench_wanted("parse")) bench_parse();
+    if (bench_wanted("lookup")) bench_lookup();
+    if (bench_wanted("completion")) bench_completion();
+    if (bench_wanted("pipeline")) bench_pipeline();
+    if (bench_wanted("history")) bench_history();
+    if (bench_wanted("glob")) bench_glob();
+    if (bench_wanted("text")) bench_text();
+
+    write_json(out);
+    if (fclose(out) != 0) {
+        perror(output != NULL ? output : "stdout");
+        return 1;
+    }
+    return 0;
+}
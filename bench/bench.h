@@ -0,0 +1,36 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "common.h"
+#include <stdint.h>
+
+// A benchmark body: run ops operations and return how long they took in
+// nanoseconds, so setup that must not be measured can stay outside
+typedef uint64_t (*bench_fn)(void *ctx, long ops);
+
+// CLOCK_MONOTONIC in nanoseconds
+uint64_t bench_now(void);
+
+// Run fn for the given number of samples of ops operations each and
+// record the result under name. Skipped unless name starts with the -f filter.
+void bench_run(const char *name, bench_fn fn, void *ctx, long ops, int samples);
+
+// Scale an operation count down in quick mode (-q)
+long bench_ops(long ops);
+
+// Whether a group whose names start with prefix has anything selected by -f
+bool bench_wanted(const char *prefix);
+
+// A scratch directory under /tmp, removed with everything in it on exit
+const char *bench_tmpdir(void);
+
+// Benchmark groups, one per file
+void bench_parse(void);
+void bench_lookup(void);
+void bench_completion(void);
+void bench_pipeline(void);
+void bench_history(void);
+void bench_glob(void);
+void bench_text(void);
+
+#endif
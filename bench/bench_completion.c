@@ -0,0 +1,113 @@
+#include "bench.h"
+#include "vars.h"
+#include "catalog.h"
+#include "completion.h"
+#include <sys/stat.h>
+
+#define COMPLETION_EXECUTABLES 10000
+
+typedef struct {
+    const char *prefix;
+    const char *path;       // PATH to complete against
+    const char *alt_path;   // same directories spelled differently, to force a rescan
+} CompletionCase;
+
+// Complete one prefix the way readline does: generate until NULL
+static void complete(const char *prefix) {
+    char *match;
+    int state = 0;
+    while ((match = command_generator(prefix, state++)) != NULL) {
+        free(match);
+    }
+}
+
+static uint64_t run_complete(void *ctx, long ops) {
+    CompletionCase *c = ctx;
+    var_set("PATH", c->path, 0);
+    complete(c->prefix);    // make sure the catalog is warm
+
+    uint64_t start = bench_now();
+    for (long i = 0; i < ops; i++) {
+        complete(c->prefix);
+    }
+    return bench_now() - start;
+}
+
+// Complete a path argument: the directory listing comes from the cache
+static void complete_path(const char *text, rl_compentry_func_t *generator) {
+    char *match;
+    int state = 0;
+    while ((match = generator(text, state++)) != NULL) {
+        free(match);
+    }
+}
+
+static uint64_t run_files(void *ctx, long ops) {
+    CompletionCase *c = ctx;
+    complete_path(c->prefix, filename_generator);
+
+    uint64_t start = bench_now();
+    for (long i = 0; i < ops; i++) {
+        complete_path(c->prefix, filename_generator);
+    }
+    return bench_now() - start;
+}
+
+// every entry is a regular file: "cd" completion still looks at all of them
+static uint64_t run_directories(void *ctx, long ops) {
+    CompletionCase *c = ctx;
+    uint64_t start = bench_now();
+    for (long i = 0; i < ops; i++) {
+        complete_path(c->prefix, directory_generator);
+    }
+    return bench_now() - start;
+}
+
+// a changed PATH makes the catalog scan every directory again
+static uint64_t run_rescan(void *ctx, long ops) {
+    CompletionCase *c = ctx;
+    uint64_t start = bench_now();
+    for (long i = 0; i < ops; i++) {
+        var_set("PATH", i % 2 ? c->path : c->alt_path, 0);
+        complete(c->prefix);
+    }
+    return bench_now() - start;
+}
+
+void bench_completion(void) {
+    char dir[96];
+    snprintf(dir, sizeof(dir), "%s/completion", bench_tmpdir());
+    mkdir(dir, 0755);
+
+    // names like "cmd04217" spread evenly over 10k entries
+    for (int i = 0; i < COMPLETION_EXECUTABLES; i++) {
+        char file[128];
+        snprintf(file, sizeof(file), "%s/cmd%05d", dir, i);
+        int fd = open(file, O_WRONLY | O_CREAT, 0755);
+        if (fd >= 0) close(fd);
+    }
+
+    char alt_path[128];
+    snprintf(alt_path, sizeof(alt_path), "%s:", dir);
+    char *saved_path = strdup(var_get("PATH") != NULL ? var_get("PATH") : "");
+
+    CompletionCase narrow = {"cmd0421", dir, alt_path};    // 10 matches
+    CompletionCase wide = {"cmd", dir, alt_path};          // every entry
+    CompletionCase none = {"zzz", dir, alt_path};
+    bench_run("completion/prefix/10k", run_complete, &narrow, bench_ops(100000), 5);
+    bench_run("completion/all/10k", run_complete, &wide, bench_ops(100), 5);
+    bench_run("completion/nomatch/10k", run_complete, &none, bench_ops(100000), 5);
+    bench_run("completion/rescan/10k", run_rescan, &none, bench_ops(20), 5);
+
+    char narrow_file[128], wide_file[128];
+    snprintf(narrow_file, sizeof(narrow_file), "%s/cmd0421", dir);
+    snprintf(wide_file, sizeof(wide_file), "%s/", dir);
+    CompletionCase narrow_path = {narrow_file, NULL, NULL};
+    CompletionCase wide_path = {wide_file, NULL, NULL};
+    bench_run("completion/files/prefix/10k", run_files, &narrow_path, bench_ops(100000), 5);
+    bench_run("completion/files/all/10k", run_files, &wide_path, bench_ops(100), 5);
+    bench_run("completion/directories/all/10k", run_directories, &wide_path, bench_ops(100), 5);
+
+    var_set("PATH", saved_path, 0);
+    free(saved_path);
+}
@@ -0,0 +1,58 @@
+#include "bench.h"
+#include "arena.h"
+#include "wildcard.h"
+#include <sys/stat.h>
+
+#define GLOB_DIRS 100
+#define GLOB_FILES_PER_DIR 100
+
+typedef struct {
+    char pattern[160];
+    int expected;
+} GlobCase;
+
+static uint64_t run_glob(void *ctx, long ops) {
+    GlobCase *c = ctx;
+    Arena arena = {NULL};
+    char **matches;
+    uint64_t start = bench_now();
+    for (long i = 0; i < ops; i++) {
+        if (wildcard_expand(&arena, c->pattern, &matches) != c->expected) {
+            fprintf(stderr, "glob: %s: unexpected match count\n", c->pattern);
+            exit(1);
+        }
+        arena_reset(&arena);
+    }
+    uint64_t elapsed = bench_now() - start;
+    arena_free(&arena);
+    return elapsed;
+}
+
+void bench_glob(void) {
+    // logs/dNN/fileNNN.log and .txt, half of each directory matching
+    char root[96];
+    snprintf(root, sizeof(root), "%s/logs", bench_tmpdir());
+    mkdir(root, 0755);
+    for (int d = 0; d < GLOB_DIRS; d++) {
+        char path[160];
+        snprintf(path, sizeof(path), "%s/d%02d", root, d);
+        mkdir(path, 0755);
+        for (int f = 0; f < GLOB_FILES_PER_DIR; f++) {
+            snprintf(path, sizeof(path), "%s/d%02d/file%03d.%s", root, d, f, f % 2 ? "log" : "txt");
+            int fd = open(path, O_WRONLY | O_CREAT, 0644);
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    // listings come from the cache after the first sample
+    GlobCase one = {"", GLOB_FILES_PER_DIR / 2};
+    snprintf(one.pattern, sizeof(one.pattern), "%s/d42/*.log", root);
+    GlobCase all = {"", GLOB_DIRS * GLOB_FILES_PER_DIR / 2};
+    snprintf(all.pattern, sizeof(all.pattern), "%s/**/*.log", root);
+    GlobCase literal = {"", 1};
+    snprintf(literal.pattern, sizeof(literal.pattern), "%s/d42/file001.log", root);
+
+    bench_run("glob/star/100", run_glob, &one, bench_ops(10000), 5);
+    bench_run("glob/recursive/10k", run_glob, &all, bench_ops(100), 5);
+    bench_run("glob/literal", run_glob, &literal, bench_ops(100000), 5);
+}
@@ -0,0 +1,120 @@
+#include "bench.h"
+#include "vars.h"
+#include "history.h"
+#include "builtins.h"
+#include "outbuf.h"
+#include <readline/history.h>
+
+#define HISTORY_ENTRIES 1000000
+
+typedef struct {
+    char path[128];
+    long entries;
+    int null_fd;
+} HistoryCase;
+
+// Write a history file of count distinct lines
+static void write_history_file(const char *path, long count) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+    for (long i = 0; i < count; i++) {
+        fprintf(file, "git commit -m 'change number %ld' --author bench\n", i);
+    }
+    fclose(file);
+}
+
+// Load a HISTFILE into the in-memory list
+static uint64_t run_load(void *ctx, long ops) {
+    HistoryCase *c = ctx;
+    uint64_t elapsed = 0;
+    for (long i = 0; i < ops; i++) {
+        uint64_t start = bench_now();
+        history_read_file(c->path);
+        elapsed += bench_now() - start;
+        clear_history();
+    }
+    return elapsed;
+}
+
+// Record entries one by one, each appended to HISTFILE under its lock
+static uint64_t run_append(void *ctx, long ops) {
+    HistoryCase *c = ctx;
+    unlink(c->path);
+    var_set("HISTFILE", c->path, 0);
+    var_unset("HISTFILESIZE");
+    history_init();
+
+    char line[64];
+    uint64_t start = bench_now();
+    for (long i = 0; i < ops; i++) {
+        snprintf(line, sizeof(line), "make -j8 target%ld", i);
+        history_record(line);
+    }
+    uint64_t elapsed = bench_now() - start;
+
+    history_close();
+    clear_history();
+    return elapsed;
+}
+
+// List every entry with the history builtin, as "history | grep ..." does
+static uint64_t run_print(void *ctx, long ops) {
+    HistoryCase *c = ctx;
+    char *argv[] = {"history", NULL};
+    BuiltinIO io = {STDIN_FILENO, c->null_fd, STDERR_FILENO};
+    uint64_t start = bench_now();
+    for (long i = 0; i < ops; i++) {
+        handle_history(argv, &io);
+        outbuf_flush();
+    }
+    return bench_now() - start;
+}
+
+// Compact a HISTFILE of the full size down to half of it on exit
+static uint64_t run_compact(void *ctx, long ops) {
+    HistoryCase *c = ctx;
+    char limit[32];
+    snprintf(limit, sizeof(limit), "%ld", c->entries / 2);
+    uint64_t elapsed = 0;
+
+    for (long i = 0; i < ops; i++) {
+        write_history_file(c->path, c->entries);
+        var_set("HISTFILE", c->path, 0);
+        var_set("HISTFILESIZE", limit, 0);
+        history_init();
+
+        uint64_t start = bench_now();
+        history_close();
+        elapsed += bench_now() - start;
+        clear_history();
+    }
+    return elapsed;
+}
+
+void bench_history(void) {
+    HistoryCase c;
+    c.entries = bench_ops(HISTORY_ENTRIES);
+    snprintf(c.path, sizeof(c.path), "%s/histfile", bench_tmpdir());
+
+    // load and compact are timed per file, append per entry
+    char name[64];
+    write_history_file(c.path, c.entries);
+    snprintf(name, sizeof(name), "history/load/%ldk", c.entries / 1000);
+    bench_run(name, run_load, &c, 1, 3);
+    c.null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    history_read_file(c.path);
+    snprintf(name, sizeof(name), "history/print/%ldk", c.entries / 1000);
+    bench_run(name, run_print, &c, 1, 3);
+    clear_history();
+    close(c.null_fd);
+    snprintf(name, sizeof(name), "history/append/%ldk", c.entries / 1000);
+    bench_run(name, run_append, &c, c.entries, 3);
+    snprintf(name, sizeof(name), "history/compact/%ldk", c.entries / 1000);
+    bench_run(name, run_compact, &c, 1, 3);
+
+    var_unset("HISTFILE");
+    var_unset("HISTFILESIZE");
+}
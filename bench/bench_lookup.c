@@ -0,0 +1,86 @@
+#include "bench.h"
+#include "vars.h"
+#include "executor.h"
+#include "hash.h"
+#include "builtins.h"
+#include <sys/stat.h>
+
+#define LOOKUP_COMMAND "bench-target"
+
+static uint64_t run_path_walk(void *ctx, long ops) {
+    (void)ctx;
+    uint64_t start = bench_now();
+    for (long i = 0; i < ops; i++) {
+        free(find_command_in_path(LOOKUP_COMMAND));
+    }
+    return bench_now() - start;
+}
+
+static uint64_t run_hashed(void *ctx, long ops) {
+    (void)ctx;
+    uint64_t start = bench_now();
+    for (long i = 0; i < ops; i++) {
+        resolve_command(LOOKUP_COMMAND);
+    }
+    return bench_now() - start;
+}
+
+// every command name is checked against the builtins before PATH
+static uint64_t run_builtin(void *ctx, long ops) {
+    const char *const *names = ctx;
+    uint64_t start = bench_now();
+    for (long i = 0; i < ops; i++) {
+        find_builtin(names[i & 3]);
+    }
+    return bench_now() - start;
+}
+
+// Make a PATH of count directories with the command only in the last one,
+// so every lookup walks the whole list
+static char *make_path(int count) {
+    size_t size = count * 128;
+    char *path = malloc(size);
+    if (path == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    size_t used = 0;
+    char dir[96];
+    for (int i = 0; i < count; i++) {
+        snprintf(dir, sizeof(dir), "%s/path%d.%d", bench_tmpdir(), count, i);
+        mkdir(dir, 0755);
+        used += snprintf(path + used, size - used, "%s%s", i > 0 ? ":" : "", dir);
+    }
+
+    char target[128];
+    snprintf(target, sizeof(target), "%s/%s", dir, LOOKUP_COMMAND);
+    int fd = open(target, O_WRONLY | O_CREAT, 0755);
+    if (fd >= 0) close(fd);
+    return path;
+}
+
+void bench_lookup(void) {
+    char *saved_path = strdup(var_get("PATH") != NULL ? var_get("PATH") : "");
+    static const int sizes[] = {5, 50, 200};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        char *path = make_path(sizes[i]);
+        var_set("PATH", path, 0);
+        free(path);
+
+        char name[64];
+        snprintf(name, sizeof(name), "lookup/path/%d", sizes[i]);
+        bench_run(name, run_path_walk, NULL, bench_ops(200000 / sizes[i]), 5);
+        snprintf(name, sizeof(name), "lookup/hashed/%d", sizes[i]);
+        bench_run(name, run_hashed, NULL, bench_ops(1000000), 5);
+    }
+
+    var_set("PATH", saved_path, 0);
+    free(saved_path);
+    hash_clear();
+
+    // two builtins, two external commands that are not
+    static const char *const names[] = {"echo", "read", "git", "make"};
+    bench_run("lookup/builtin", run_builtin, (void *)names, bench_ops(10000000), 5);
+}
@@ -0,0 +1,82 @@
+#include "bench.h"
+#include "arena.h"
+#include "parser.h"
+#include "plancache.h"
+
+typedef struct {
+    const char *line;
+    Arena arena;
+} ParseCase;
+
+static uint64_t run_parse(void *ctx, long ops) {
+    ParseCase *c = ctx;
+    CommandList list;
+
+    uint64_t start = bench_now();
+    for (long i = 0; i < ops; i++) {
+        parse_command_line(&c->arena, c->line, &list);
+        arena_reset(&c->arena);
+    }
+    return bench_now() - start;
+}
+
+// The cached plan of a line run before: a hash and a compare, no parsing
+static uint64_t run_plan(void *ctx, long ops) {
+    ParseCase *c = ctx;
+    CommandList list;
+    if (plan_lookup(c->line) == NULL) {
+        parse_command_line(&c->arena, c->line, &list);
+        plan_store(c->line, &list);
+        arena_reset(&c->arena);
+    }
+
+    uint64_t start = bench_now();
+    for (long i = 0; i < ops; i++) {
+        plan_lookup(c->line);
+    }
+    return bench_now() - start;
+}
+
+// Build a line by repeating a fragment until it is about size bytes long
+static char *repeat_fragment(const char *fragment, size_t size) {
+    size_t len = strlen(fragment);
+    size_t copies = size / len + 1;
+    char *line = malloc(copies * len + 1);
+    if (line == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (size_t i = 0; i < copies; i++) {
+        memcpy(line + i * len, fragment, len);
+    }
+    line[copies * len] = '\0';
+    return line;
+}
+
+void bench_parse(void) {
+    char *long_line = repeat_fragment("grep -v pattern file.txt | sort -u > out.txt; ", 4096);
+    char *quoted_line = repeat_fragment("echo 'single quoted' \"double \\\"escaped\\\" \\$x\" back\\ slash\\ es; ", 4096);
+
+    struct {
+        const char *name;
+        const char *line;
+        long ops;
+    } cases[] = {
+        {"parse/short", "ls -la /tmp", 1000000},
+        {"parse/long", long_line, 20000},
+        {"parse/quoted", quoted_line, 20000},
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        ParseCase c = {cases[i].line, {NULL}};
+        bench_run(cases[i].name, run_parse, &c, bench_ops(cases[i].ops), 5);
+
+        char name[64];
+        snprintf(name, sizeof(name), "%s/planned", cases[i].name);
+        bench_run(name, run_plan, &c, bench_ops(cases[i].ops), 5);
+        arena_free(&c.arena);
+    }
+
+    free(long_line);
+    free(quoted_line);
+}
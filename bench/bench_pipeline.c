@@ -0,0 +1,73 @@
+#include "bench.h"
+#include "arena.h"
+#include "parser.h"
+#include "pipeline.h"
+
+typedef struct {
+    Arena arena;
+    CommandList list;
+} PipelineCase;
+
+static uint64_t run_pipeline_case(void *ctx, long ops) {
+    PipelineCase *c = ctx;
+    uint64_t start = bench_now();
+    for (long i = 0; i < ops; i++) {
+        execute_pipeline(&c->arena, &c->list.items[0].pipeline, NULL, false);
+    }
+    return bench_now() - start;
+}
+
+// "first | rest | rest ..." with the given number of stages
+static char *make_line(const char *first, const char *rest, int stages) {
+    size_t size = strlen(first) + stages * (strlen(rest) + 3) + 1;
+    char *line = malloc(size);
+    if (line == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    size_t used = snprintf(line, size, "%s", first);
+    for (int i = 1; i < stages; i++) {
+        used += snprintf(line + used, size - used, " | %s", rest);
+    }
+    return line;
+}
+
+static void bench_stages(const char *kind, const char *first, const char *rest, int stages, long ops) {
+    char name[64];
+    snprintf(name, sizeof(name), "pipeline/%s/%d", kind, stages);
+
+    PipelineCase c = {.arena = {NULL}, .list = {.items = NULL}};
+    char *line = make_line(first, rest, stages);
+    // parsed once: the arena only grows by what each run allocates
+    if (parse_command_line(&c.arena, line, &c.list) && c.list.count == 1) {
+        bench_run(name, run_pipeline_case, &c, ops, 5);
+    }
+    free(line);
+    arena_free(&c.arena);
+}
+
+// a builtin run by the shell itself with its output and errors redirected
+static void bench_redirect(long ops) {
+    char line[160];
+    snprintf(line, sizeof(line), "echo x > %s/redirect 2>&1", bench_tmpdir());
+
+    PipelineCase c = {.arena = {NULL}, .list = {.items = NULL}};
+    if (parse_command_line(&c.arena, line, &c.list) && c.list.count == 1) {
+        bench_run("pipeline/redirect/builtin", run_pipeline_case, &c, ops, 5);
+    }
+    arena_free(&c.arena);
+}
+
+void bench_pipeline(void) {
+    static const int stages[] = {2, 4, 8, 16, 32, 64};
+
+    for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); i++) {
+        long ops = bench_ops(stages[i] < 16 ? 200 : 40);
+        // every stage a process started with posix_spawn: a path, because
+        // plain "true" is a builtin and would run on a thread
+        bench_stages("spawn", "/bin/true", "/bin/true", stages[i], ops);
+        // every stage a builtin: threads and pipes, no process at all
+        bench_stages("builtin", "echo x", "cat", stages[i], ops);
+    }
+    bench_redirect(bench_ops(100000));
+}
@@ -0,0 +1,65 @@
+#include "bench.h"
+#include "textscan.h"
+#include "textutils.h"
+#include "outbuf.h"
+
+// size of the log the text builtins read
+#define TEXT_FILE_SIZE (32 * 1024 * 1024)
+
+typedef struct {
+    cmd_handler_t handler;
+    char **argv;
+    int null_fd;
+} TextCase;
+
+static uint64_t run_builtin(void *ctx, long ops) {
+    TextCase *c = ctx;
+    BuiltinIO io = {STDIN_FILENO, c->null_fd, STDERR_FILENO};
+    uint64_t start = bench_now();
+    for (long i = 0; i < ops; i++) {
+        c->handler(c->argv, &io);
+        outbuf_flush();
+    }
+    return bench_now() - start;
+}
+
+// A log of short lines, one in a thousand holding the searched word
+static void write_log(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+    long size = 0;
+    for (long i = 0; size < TEXT_FILE_SIZE; i++) {
+        size += fprintf(file, "2024-05-01T12:00:%02ld host app[%ld]: %s request served in %ld ms\n",
+                        i % 60, i % 997, i % 1000 == 0 ? "slow" : "fast", i % 113);
+    }
+    fclose(file);
+}
+
+void bench_text(void) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/text.log", bench_tmpdir());
+    write_log(path);
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+    char *wc_argv[] = {"wc", "-l", path, NULL};
+    char *grep_argv[] = {"grep", "-cF", "slow request", path, NULL};
+    TextCase wc_case = {handle_wc, wc_argv, null_fd};
+    TextCase grep_case = {handle_grep, grep_argv, null_fd};
+
+    // each kernel the CPU runs, on the same 32 MiB
+    static const char *const levels[] = {"scalar", "sse2", "avx2"};
+    const char *best = textscan_level();
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+        if (!textscan_select(levels[i])) continue;
+        char name[64];
+        snprintf(name, sizeof(name), "text/wc-l/%s", levels[i]);
+        bench_run(name, run_builtin, &wc_case, bench_ops(20), 5);
+        snprintf(name, sizeof(name), "text/grep-F/%s", levels[i]);
+        bench_run(name, run_builtin, &grep_case, bench_ops(20), 5);
+    }
+    textscan_select(best);
+    close(null_fd);
+}
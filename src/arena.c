@@ -0,0 +1,93 @@
+#include "arena.h"
+
+#define ARENA_CHUNK_SIZE 4096
+
+static ArenaChunk *new_chunk(size_t size) {
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + size);
+    if (chunk == NULL) return NULL;
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    // keep every allocation suitably aligned for any type
+    size_t align = _Alignof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+
+    ArenaChunk *chunk = arena->head;
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+        // grow geometrically so long lines settle into a single chunk
+        if (chunk != NULL && chunk_size < chunk->size * 2) {
+            chunk_size = chunk->size * 2;
+        }
+        chunk = new_chunk(chunk_size);
+        if (chunk == NULL) return NULL;
+        chunk->next = arena->head;
+        arena->head = chunk;
+    }
+
+    void *ptr = (char *)chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+char *arena_strndup(Arena *arena, const char *s, size_t len) {
+    char *copy = arena_alloc(arena, len + 1);
+    if (copy == NULL) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char *arena_strdup(Arena *arena, const char *s) {
+    return arena_strndup(arena, s, strlen(s));
+}
+
+ArenaMark arena_mark(Arena *arena) {
+    ArenaMark mark = {arena->head, arena->head != NULL ? arena->head->used : 0};
+    return mark;
+}
+
+void arena_rewind(Arena *arena, ArenaMark mark) {
+    while (arena->head != NULL && arena->head != mark.chunk) {
+        ArenaChunk *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+    if (arena->head != NULL) {
+        arena->head->used = mark.used;
+    }
+}
+
+void arena_reset(Arena *arena) {
+    ArenaChunk *chunk = arena->head;
+    if (chunk == NULL) return;
+
+    // a line that needed several chunks gets one chunk big enough for all of them
+    if (chunk->next != NULL) {
+        size_t total = 0;
+        while (chunk != NULL) {
+            ArenaChunk *next = chunk->next;
+            total += chunk->size;
+            free(chunk);
+            chunk = next;
+        }
+        arena->head = new_chunk(total);
+        return;
+    }
+
+    chunk->used = 0;
+}
+
+void arena_free(Arena *arena) {
+    ArenaChunk *chunk = arena->head;
+    while (chunk != NULL) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+}
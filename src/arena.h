@@ -0,0 +1,42 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "common.h"
+#include <stddef.h>
+
+// Bump allocator for memory that lives as long as one command line.
+// Everything allocated from an arena is released at once by arena_reset.
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+} ArenaChunk;
+
+typedef struct {
+    ArenaChunk *head;
+} Arena;
+
+void *arena_alloc(Arena *arena, size_t size);
+char *arena_strndup(Arena *arena, const char *s, size_t len);
+char *arena_strdup(Arena *arena, const char *s);
+
+// A point in an arena to rewind to
+typedef struct {
+    ArenaChunk *chunk;
+    size_t used;
+} ArenaMark;
+
+ArenaMark arena_mark(Arena *arena);
+
+// Release what was allocated since the mark was taken, so a loop can
+// allocate on every iteration without the arena growing
+void arena_rewind(Arena *arena, ArenaMark mark);
+
+// Release everything allocated so far, keeping the memory for reuse
+void arena_reset(Arena *arena);
+
+// Give all memory back to the system
+void arena_free(Arena *arena);
+
+#endif
@@ -1,105 +1,81 @@
 #include "builtins.h"
+#include "outbuf.h"
 #include "executor.h" // Needed for find_command_in_path used in 'type'
+#include "hash.h"
+#include "copy.h"
+#include "history.h"
+#include "jobs.h"
+#include "parser.h"
+#include "trace.h"
+#include "vars.h"
+#include "parallel.h"
+#include "plancache.h"
+#include "eval.h"
+#include "shell.h"
+#include "workdir.h"
+#include "loadable.h"
+#include "textutils.h"
+#include <errno.h>
+#include <sys/stat.h>
 #include <readline/readline.h>
 #include <readline/history.h> // Required for history functions
 
-typedef struct {
-    const char *name;
-    cmd_handler_t handler;
-} Builtin;
-
-char *get_current_working_directory() {
-    char *cwd = malloc(1024);
-    if (getcwd(cwd, 1024) != NULL) {
-        return cwd;
-    } else {
-        free(cwd);
-        return NULL;
-    }
-}
-
-void change_directory(const char *path) {
-    if (chdir(path) != 0) {
-        perror("cd");
+int handle_exit(char **argv, const BuiltinIO *io) {
+    // "exit <n>" exits with n, plain "exit" with the last command's status
+    (void)io;
+    int status = argv[1] != NULL ? atoi(argv[1]) : shell.last_status;
+    if (shell.subshell) {
+        // leave the parent's stdio streams alone
+        _exit(status & 0xff);
     }
-}
-
-void save_history_to_file(void) {
-    char *histfile = getenv("HISTFILE");
-    if (histfile != NULL) {
-        FILE *file = fopen(histfile, "w");
-        if (file != NULL) {
-            for (int i = 0; i < history_length; i++) {
-                HIST_ENTRY *entry = history_get(history_base + i);
-                if (entry && entry->line) {
-                    fprintf(file, "%s\n", entry->line);
-                }
-            }
-            fclose(file);
-        }
+    if (shell.interactive) {
+        history_close();
     }
+    exit(status & 0xff);
 }
 
-void handle_exit(char **argv) {
-    save_history_to_file();
-    exit(0);
-}
-
-void handle_echo(char **argv) {
+int handle_echo(char **argv, const BuiltinIO *io) {
     for (int i = 1; argv[i] != NULL; i++) {
-        printf("%s", argv[i]);
+        outbuf_printf(io->out, "%s", argv[i]);
         if (argv[i + 1] != NULL) {
-            printf(" ");
+            outbuf_printf(io->out, " ");
         }
     }
-    printf("\n");
+    outbuf_printf(io->out, "\n");
+    return 0;
 }
 
-void handle_history(char **argv) {
-    // static variable to track the index of the next command to be appended.
-    // initialized to 0, it persists across function calls.
+int handle_history(char **argv, const BuiltinIO *io) {
+    // static variable to track the number of the next command to be appended.
+    // history numbers stay valid when old entries are dropped by HISTSIZE.
     static int history_append_index = 0;
 
     // handle "history -r <path>"
     if (argv[1] != NULL && strcmp(argv[1], "-r") == 0) {
         if (argv[2] == NULL) {
-            printf("history: option requires an argument\n");
-            return;
+            outbuf_printf(io->out, "history: option requires an argument\n");
+            return 1;
         }
 
-        FILE *file = fopen(argv[2], "r");
-        if (file == NULL) {
-            printf("history: %s: cannot open history file\n", argv[2]);
-            return;
-        }
-
-        char line[1024]; // buffer for reading lines
-        // read the file line by line
-        while (fgets(line, sizeof(line), file)) {
-            // remove the trailing newline character
-            line[strcspn(line, "\n")] = 0;
-            
-            // if the line is not empty, add it to the in-memory history
-            if (strlen(line) > 0) {
-                add_history(line);
-            }
+        if (history_read_file(argv[2]) < 0) {
+            outbuf_printf(io->out, "history: %s: cannot open history file\n", argv[2]);
+            return 1;
         }
-        fclose(file);
-        return; // return immediately, do not print history
+        return 0; // return immediately, do not print history
     }
 
     // handle "history -w <path>" (write to file)
     if (argv[1] != NULL && strcmp(argv[1], "-w") == 0) {
         if (argv[2] == NULL) {
-            printf("history: option requires an argument\n");
-            return;
+            outbuf_printf(io->out, "history: option requires an argument\n");
+            return 1;
         }
 
         // Open with "w" mode to create file or truncate existing content
         FILE *file = fopen(argv[2], "w");
         if (file == NULL) {
-            printf("history: %s: cannot open history file\n", argv[2]);
-            return;
+            outbuf_printf(io->out, "history: %s: cannot open history file\n", argv[2]);
+            return 1;
         }
 
         // Iterate through all history entries in memory
@@ -112,36 +88,37 @@ void handle_history(char **argv) {
         }
         
         fclose(file);
-        return;
+        return 0;
     }
 
     // handle "history -a <path>" (Append new commands to file)
     if (argv[1] != NULL && strcmp(argv[1], "-a") == 0) {
         if (argv[2] == NULL) {
-            printf("history: option requires an argument\n");
-            return;
+            outbuf_printf(io->out, "history: option requires an argument\n");
+            return 1;
         }
 
         // open file in append mode
         FILE *file = fopen(argv[2], "a");
         if (file == NULL) {
-            printf("history: %s: cannot open history file\n", argv[2]);
-            return;
+            outbuf_printf(io->out, "history: %s: cannot open history file\n", argv[2]);
+            return 1;
         }
 
         // iterate from the last appended index up to the current history length
-        for (int i = history_append_index; i < history_length; i++) {
-            HIST_ENTRY *entry = history_get(history_base + i);
+        int first = history_append_index > history_base ? history_append_index : history_base;
+        for (int i = first; i < history_base + history_length; i++) {
+            HIST_ENTRY *entry = history_get(i);
             if (entry && entry->line) {
                 fprintf(file, "%s\n", entry->line);
             }
         }
 
         // update the tracking index so future calls only append new commands
-        history_append_index = history_length;
+        history_append_index = history_base + history_length;
 
         fclose(file);
-        return;
+        return 0;
     }
 
     // logic for printing history (with optional limit <n>)
@@ -166,89 +143,458 @@ void handle_history(char **argv) {
         HIST_ENTRY *entry = history_get(history_base + i);
         if (entry) {
             // print the entry number and the command line
-            printf("%5d  %s\n", history_base + i, entry->line);
+            outbuf_printf(io->out, "%5d  %s\n", history_base + i, entry->line);
         }
     }
+    return 0;
 }
 
-void handle_type(char **argv) {
+int handle_type(char **argv, const BuiltinIO *io) {
     if (argv[1] == NULL) {
-        printf("type: missing argument\n");
-        return;
+        outbuf_printf(io->out, "type: missing argument\n");
+        return 1;
     }
     
     char *token = argv[1];
-    if (is_builtin(token)) {
-        printf("%s is a shell builtin\n", token);
+    if (is_reserved_word(token)) {
+        outbuf_printf(io->out, "%s is a shell keyword\n", token);
+    } else if (is_builtin(token)) {
+        outbuf_printf(io->out, "%s is a shell builtin\n", token);
     } else {
+        // a remembered path saves walking PATH again
+        const char *hashed = hash_find(token);
+        if (hashed != NULL) {
+            outbuf_printf(io->out, "%s is %s\n", token, hashed);
+            return 0;
+        }
+
         char *fullpath = find_command_in_path(token);
         if (fullpath != NULL) {
-            printf("%s is %s\n", token, fullpath);
+            outbuf_printf(io->out, "%s is %s\n", token, fullpath);
             free(fullpath);
         } else {
-            printf("%s: not found\n", token);
+            outbuf_printf(io->out, "%s: not found\n", token);
+            return 1;
         }
     }
+    return 0;
 }
 
-void handle_pwd(char **argv) {
-    char *cwd = get_current_working_directory();
-    if (cwd != NULL) {
-        printf("%s\n", cwd);
-        free(cwd);
-    } else {
-        printf("pwd: error retrieving current directory\n");
+static void print_hash_entry(const char *name, const char *path, int hits, void *data) {
+    const BuiltinIO *io = data;
+    (void)name;
+    outbuf_printf(io->out, "%4d\t%s\n", hits, path);
+}
+
+int handle_hash(char **argv, const BuiltinIO *io) {
+    // "hash -r" forgets every remembered location
+    if (argv[1] != NULL && strcmp(argv[1], "-r") == 0) {
+        hash_clear();
+        return 0;
+    }
+
+    // "hash -p <path> <name>" remembers <path> as the location of <name>
+    if (argv[1] != NULL && strcmp(argv[1], "-p") == 0) {
+        if (argv[2] == NULL || argv[3] == NULL) {
+            outbuf_printf(io->out, "hash: -p: option requires an argument\n");
+            return 1;
+        }
+        hash_insert(argv[3], argv[2]);
+        return 0;
+    }
+
+    // "hash -d <name>" forgets the location of <name>
+    if (argv[1] != NULL && strcmp(argv[1], "-d") == 0) {
+        int status = 0;
+        for (int i = 2; argv[i] != NULL; i++) {
+            if (hash_find(argv[i]) == NULL) {
+                outbuf_printf(io->out, "hash: %s: not found\n", argv[i]);
+                status = 1;
+            } else {
+                hash_remove(argv[i]);
+            }
+        }
+        return status;
+    }
+
+    // "hash <name>..." looks the names up and remembers them
+    if (argv[1] != NULL) {
+        int status = 0;
+        for (int i = 1; argv[i] != NULL; i++) {
+            if (is_builtin(argv[i])) continue;
+            char *fullpath = find_command_in_path(argv[i]);
+            if (fullpath == NULL) {
+                outbuf_printf(io->out, "hash: %s: not found\n", argv[i]);
+                status = 1;
+                continue;
+            }
+            hash_insert(argv[i], fullpath);
+            free(fullpath);
+        }
+        return status;
+    }
+
+    if (hash_count() == 0) {
+        outbuf_printf(io->out, "hash: hash table empty\n");
+        return 0;
+    }
+
+    outbuf_printf(io->out, "hits\tcommand\n");
+    hash_foreach(print_hash_entry, (void *)io);
+    return 0;
+}
+
+int handle_pwd(char **argv, const BuiltinIO *io) {
+    // the directory as cd left it, or with "-P" as the kernel names it
+    bool physical = argv[1] != NULL && strcmp(argv[1], "-P") == 0;
+    const char *cwd = physical ? NULL : workdir_get();
+    char *resolved = cwd == NULL ? getcwd(NULL, 0) : NULL;
+    if (cwd == NULL && resolved == NULL) {
+        outbuf_printf(io->out, "pwd: error retrieving current directory\n");
+        return 1;
     }
+    outbuf_printf(io->out, "%s\n", cwd != NULL ? cwd : resolved);
+    free(resolved);
+    return 0;
 }
 
-void handle_cd(char **argv) {
-    char expanded_path[PATH_MAX];
-    char *dir = argv[1];
+// Find a relative directory name in CDPATH. Returns the path to use, in
+// buffer, or NULL to take dir as it is; "." and ".." names never search.
+static const char *search_cdpath(const char *dir, char *buffer, size_t size) {
+    const char *cdpath = var_get("CDPATH");
+    if (cdpath == NULL || dir[0] == '/' || strcmp(dir, ".") == 0 || strcmp(dir, "..") == 0 ||
+        strncmp(dir, "./", 2) == 0 || strncmp(dir, "../", 3) == 0) {
+        return NULL;
+    }
 
-    if (dir == NULL) {
-        printf("cd: missing argument\n");
-        return;
-    } else if (dir[0] == '~') {
-        char *home = getenv("HOME");
+    const char *entry = cdpath;
+    while (true) {
+        const char *end = strchrnul(entry, ':');
+        int len = (int)(end - entry);
+        // an empty entry is the current directory
+        if (len == 0) {
+            snprintf(buffer, size, "%s", dir);
+        } else {
+            snprintf(buffer, size, "%.*s%s%s", len, entry, entry[len - 1] == '/' ? "" : "/", dir);
+        }
+        struct stat st;
+        if (stat(buffer, &st) == 0 && S_ISDIR(st.st_mode)) {
+            return buffer;
+        }
+        if (*end == '\0') return NULL;
+        entry = end + 1;
+    }
+}
+
+int handle_cd(char **argv, const BuiltinIO *io) {
+    char expanded_path[PATH_MAX];
+    char cdpath_path[PATH_MAX];
+    bool physical = false;
+    int arg = 1;
+    for (; argv[arg] != NULL && (strcmp(argv[arg], "-P") == 0 || strcmp(argv[arg], "-L") == 0); arg++) {
+        physical = argv[arg][1] == 'P';
+    }
+    char *dir = argv[arg];
+    // the new directory is printed when it is not the one typed
+    bool announce = false;
+
+    if (dir == NULL || strcmp(dir, "~") == 0) {
+        dir = (char *)var_get("HOME");
+        if (dir == NULL) {
+            outbuf_printf(io->out, "cd: HOME not set\n");
+            return 1;
+        }
+    } else if (strcmp(dir, "-") == 0) {
+        dir = (char *)var_get("OLDPWD");
+        if (dir == NULL) {
+            outbuf_printf(io->out, "cd: OLDPWD not set\n");
+            return 1;
+        }
+        announce = true;
+    } else if (dir[0] == '~' && dir[1] == '/') {
+        const char *home = var_get("HOME");
         if (home != NULL) {
             snprintf(expanded_path, sizeof(expanded_path), "%s%s", home, dir + 1);
             dir = expanded_path;
         }
+    } else {
+        const char *found = search_cdpath(dir, cdpath_path, sizeof(cdpath_path));
+        if (found != NULL) {
+            // a match through "." is where the name already pointed
+            announce = strcmp(found, dir) != 0;
+            dir = (char *)found;
+        }
     }
 
-    if (access(dir, F_OK) != 0) {
-        printf("cd: %s: No such file or directory\n", dir);
-        return;
+    // chdir says what is wrong; no access checks up front
+    int error = workdir_change(dir, physical);
+    if (error != 0) {
+        outbuf_printf(io->out, "cd: %s: %s\n", argv[arg] != NULL ? argv[arg] : dir, strerror(error));
+        return 1;
     }
+    if (announce) {
+        outbuf_printf(io->out, "%s\n", workdir_get() != NULL ? workdir_get() : dir);
+    }
+    return 0;
+}
 
-    if (access(dir, X_OK) != 0) {
-        printf("cd: %s: Permission denied\n", dir);
-        return;
+int handle_cat(char **argv, const BuiltinIO *io) {
+    // options like -n are left to the real cat
+    for (int i = 1; argv[i] != NULL; i++) {
+        if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            return run_external_fallback(argv, io);
+        }
     }
 
-    change_directory(dir);
+    // closed with >&-: nothing could be written, as coreutils reports it
+    if (io->out < 0) {
+        outbuf_printf(io->err, "cat: standard output: %s\n", strerror(EBADF));
+        return 1;
+    }
+
+    struct stat out_st;
+    bool have_out_st = fstat(io->out, &out_st) == 0;
+    char *stdin_only[] = {"-", NULL};
+    char **files = argv[1] != NULL ? argv + 1 : stdin_only;
+    int status = 0;
+
+    for (int i = 0; files[i] != NULL; i++) {
+        const char *name = files[i];
+        bool from_stdin = strcmp(name, "-") == 0;
+        int fd = from_stdin ? io->in : open(name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            // a stdin closed with <&- has no errno of its own
+            if (from_stdin) errno = EBADF;
+            outbuf_printf(io->err, "cat: %s: %s\n", name, strerror(errno));
+            status = 1;
+            continue;
+        }
+
+        // copying a regular file onto itself would never finish
+        struct stat in_st;
+        if (have_out_st && fstat(fd, &in_st) == 0 && S_ISREG(in_st.st_mode) &&
+            in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+            outbuf_printf(io->err, "cat: %s: input file is output file\n", name);
+            status = 1;
+        } else {
+            // the copy bypasses the buffer: messages so far go first
+            outbuf_flush();
+            bool write_failed;
+            if (copy_fd(fd, io->out, &write_failed) != 0) {
+                if (write_failed) {
+                    // the reader went away, nothing more can be written
+                    if (errno != EPIPE) {
+                        outbuf_printf(io->err, "cat: write error: %s\n", strerror(errno));
+                    }
+                    if (!from_stdin) close(fd);
+                    return 1;
+                }
+                outbuf_printf(io->err, "cat: %s: %s\n", name, strerror(errno));
+                status = 1;
+            }
+        }
+
+        if (!from_stdin) {
+            close(fd);
+        }
+    }
+
+    return status;
 }
 
-const Builtin builtins[] = {
-    {"exit", handle_exit},
-    {"echo", handle_echo},
-    {"type", handle_type},
-    {"pwd", handle_pwd},
-    {"cd", handle_cd},
-    {"history", handle_history}
-};
+// true and ":" do nothing, successfully
+int handle_true(char **argv, const BuiltinIO *io) {
+    (void)argv;
+    (void)io;
+    return 0;
+}
+
+int handle_false(char **argv, const BuiltinIO *io) {
+    (void)argv;
+    (void)io;
+    return 1;
+}
 
-const int builtin_count = sizeof(builtins) / sizeof(builtins[0]);
+int handle_tee(char **argv, const BuiltinIO *io) {
+    int append = 0;
+    int first = 1;
 
-cmd_handler_t find_builtin_handler(const char *command) {
-    for (int i = 0; i < builtin_count; i++) {
-        if (strcmp(builtins[i].name, command) == 0) {
-            return builtins[i].handler;
+    for (; argv[first] != NULL && argv[first][0] == '-' && argv[first][1] != '\0'; first++) {
+        if (strcmp(argv[first], "-a") == 0 || strcmp(argv[first], "--append") == 0) {
+            append = 1;
+        } else if (strcmp(argv[first], "--") == 0) {
+            first++;
+            break;
+        } else {
+            // options like -i and -p are left to the real tee
+            return run_external_fallback(argv, io);
         }
     }
-    return NULL;
+
+    int file_count = 0;
+    while (argv[first + file_count] != NULL) {
+        file_count++;
+    }
+
+    // stdout first, then every file
+    int *fds = malloc((file_count + 1) * sizeof(int));
+    bool *failed = malloc((file_count + 1) * sizeof(bool));
+    if (fds == NULL || failed == NULL) {
+        free(fds);
+        free(failed);
+        outbuf_printf(io->err, "tee: %s\n", strerror(ENOMEM));
+        return 1;
+    }
+
+    int status = 0;
+    int count = 0;
+    // a closed stdout fails like one that cannot be written; the files still get the input
+    if (io->out < 0) {
+        outbuf_printf(io->err, "tee: 'standard output': %s\n", strerror(EBADF));
+        status = 1;
+    }
+    fds[count++] = io->out;
+    for (int i = 0; i < file_count; i++) {
+        const char *name = argv[first + i];
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+        int fd = open(name, flags, 0666);
+        if (fd < 0) {
+            outbuf_printf(io->err, "tee: %s: %s\n", name, strerror(errno));
+            status = 1;
+            continue;
+        }
+        fds[count++] = fd;
+    }
+
+    outbuf_flush();
+    if (tee_fd(io->in, fds, count, failed) != 0 && !failed[0]) {
+        bool any_failed = false;
+        for (int i = 0; i < count; i++) {
+            any_failed = any_failed || failed[i];
+        }
+        if (!any_failed) {
+            outbuf_printf(io->err, "tee: read error: %s\n", strerror(errno));
+        }
+        status = 1;
+    }
+
+    for (int i = 1; i < count; i++) {
+        if (failed[i]) {
+            outbuf_printf(io->err, "tee: write error\n");
+            status = 1;
+        }
+        close(fds[i]);
+    }
+
+    free(fds);
+    free(failed);
+    return status;
+}
+
+// the shell's own builtins, always in the registry
+static Builtin shell_builtins[] = {
+    {.name = "exit", .handler = handle_exit, .flags = BUILTIN_SUBSHELL},
+    {.name = "echo", .handler = handle_echo, .flags = 0},
+    {.name = "type", .handler = handle_type, .flags = BUILTIN_SUBSHELL},
+    {.name = "pwd", .handler = handle_pwd, .flags = 0},
+    {.name = "cd", .handler = handle_cd, .flags = BUILTIN_SUBSHELL},
+    {.name = "history", .handler = handle_history, .flags = 0},
+    {.name = "hash", .handler = handle_hash, .flags = BUILTIN_SUBSHELL},
+    {.name = "cat", .handler = handle_cat, .flags = 0},
+    {.name = "tee", .handler = handle_tee, .flags = 0},
+    {.name = "jobs", .handler = handle_jobs, .flags = BUILTIN_SUBSHELL},
+    {.name = "fg", .handler = handle_fg, .flags = BUILTIN_SUBSHELL},
+    {.name = "bg", .handler = handle_bg, .flags = BUILTIN_SUBSHELL},
+    {.name = "wait", .handler = handle_wait, .flags = BUILTIN_SUBSHELL},
+    {.name = "shellstats", .handler = handle_shellstats, .flags = 0},
+    {.name = "export", .handler = handle_export, .flags = BUILTIN_SUBSHELL},
+    {.name = "unset", .handler = handle_unset, .flags = BUILTIN_SUBSHELL},
+    {.name = "parallel", .handler = handle_parallel, .flags = 0},
+    {.name = "plancache", .handler = handle_plancache, .flags = BUILTIN_SUBSHELL},
+    {.name = "true", .handler = handle_true, .flags = 0},
+    {.name = "false", .handler = handle_false, .flags = 0},
+    {.name = ":", .handler = handle_true, .flags = 0},
+    {.name = "break", .handler = handle_break, .flags = BUILTIN_SUBSHELL},
+    {.name = "continue", .handler = handle_continue, .flags = BUILTIN_SUBSHELL},
+    {.name = "read", .handler = handle_read, .flags = BUILTIN_SUBSHELL},
+    {.name = "enable", .handler = handle_enable, .flags = BUILTIN_SUBSHELL},
+    {.name = "wc", .handler = handle_wc, .flags = 0},
+    {.name = "head", .handler = handle_head, .flags = 0},
+    {.name = "tail", .handler = handle_tail, .flags = 0},
+    {.name = "grep", .handler = handle_grep, .flags = 0}
+};
+
+#define BUILTIN_BUCKETS 64
+
+// every builtin by name: the shell's own and those loaded with "enable -f"
+static Builtin *registry[BUILTIN_BUCKETS];
+static bool registry_ready = false;
+static unsigned long registry_generation = 1;
+
+static void registry_init(void) {
+    registry_ready = true;
+    for (size_t i = 0; i < sizeof(shell_builtins) / sizeof(shell_builtins[0]); i++) {
+        Builtin *builtin = &shell_builtins[i];
+        unsigned int bucket = hash_string(builtin->name) % BUILTIN_BUCKETS;
+        builtin->next = registry[bucket];
+        registry[bucket] = builtin;
+    }
+}
+
+static Builtin **find_link(const char *name) {
+    if (!registry_ready) registry_init();
+    Builtin **link = &registry[hash_string(name) % BUILTIN_BUCKETS];
+    while (*link != NULL && strcmp((*link)->name, name) != 0) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+const Builtin *find_builtin(const char *command) {
+    return *find_link(command);
+}
+
+cmd_handler_t find_builtin_handler(const char *command) {
+    const Builtin *builtin = find_builtin(command);
+    return builtin != NULL ? builtin->handler : NULL;
 }
 
 bool is_builtin(const char *command) {
     return find_builtin_handler(command) != NULL;
-}
\ No newline at end of file
+}
+
+bool builtin_add(Builtin *builtin, Builtin **replaced) {
+    Builtin **link = find_link(builtin->name);
+    *replaced = *link;
+    if (*link != NULL) {
+        if ((*link)->library == NULL) return false;
+        builtin->next = (*link)->next;
+    } else {
+        builtin->next = NULL;
+    }
+    *link = builtin;
+    registry_generation++;
+    return true;
+}
+
+Builtin *builtin_remove(const char *name) {
+    Builtin **link = find_link(name);
+    Builtin *builtin = *link;
+    if (builtin == NULL || builtin->library == NULL) return NULL;
+    *link = builtin->next;
+    registry_generation++;
+    return builtin;
+}
+
+void builtin_foreach(builtin_visit_t visit, void *data) {
+    if (!registry_ready) registry_init();
+    for (int i = 0; i < BUILTIN_BUCKETS; i++) {
+        for (const Builtin *builtin = registry[i]; builtin != NULL; builtin = builtin->next) {
+            visit(builtin, data);
+        }
+    }
+}
+
+unsigned long builtin_generation(void) {
+    return registry_generation;
+}
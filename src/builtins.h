@@ -3,16 +3,51 @@
 
 #include "common.h"
 
-void handle_exit(char **argv);
-void handle_echo(char **argv);
-void handle_type(char **argv);
-void handle_pwd(char **argv);
-void handle_cd(char **argv);
-void handle_history(char **argv);
+// the builtin changes or reads the shell's own tables (jobs, hashed paths,
+// variables, the directory), so inside a pipeline it runs in a forked
+// child: on a helper thread it would race the shell thread using them
+#define BUILTIN_SUBSHELL SHELL_BUILTIN_SUBSHELL
 
-void save_history_to_file(void);
+typedef struct Builtin {
+    const char *name;
+    cmd_handler_t handler;
+    int flags;
+    void *library;          // dlopen handle of a loaded builtin, NULL for the shell's own
+    struct Builtin *next;   // registry chain
+} Builtin;
 
+typedef void (*builtin_visit_t)(const Builtin *builtin, void *data);
+
+int handle_exit(char **argv, const BuiltinIO *io);
+int handle_echo(char **argv, const BuiltinIO *io);
+int handle_type(char **argv, const BuiltinIO *io);
+int handle_pwd(char **argv, const BuiltinIO *io);
+int handle_cd(char **argv, const BuiltinIO *io);
+int handle_history(char **argv, const BuiltinIO *io);
+int handle_hash(char **argv, const BuiltinIO *io);
+int handle_cat(char **argv, const BuiltinIO *io);
+int handle_tee(char **argv, const BuiltinIO *io);
+int handle_true(char **argv, const BuiltinIO *io);
+int handle_false(char **argv, const BuiltinIO *io);
+
+// Builtins are found through a hash table shared by dispatch, "type" and
+// completion, so loaded ones are everywhere the shell's own are
+const Builtin *find_builtin(const char *command);
 cmd_handler_t find_builtin_handler(const char *command);
 bool is_builtin(const char *command);
 
+// Put a loaded builtin in the registry; the registry keeps the pointer. A
+// loaded builtin of the same name is replaced and stored in replaced for
+// the caller to free. Fails, leaving replaced at the shell's own builtin,
+// when the name is one of those.
+bool builtin_add(Builtin *builtin, Builtin **replaced);
+
+// Take a loaded builtin out of the registry and return it, or NULL
+Builtin *builtin_remove(const char *name);
+
+void builtin_foreach(builtin_visit_t visit, void *data);
+
+// Changes whenever a builtin is added or removed
+unsigned long builtin_generation(void);
+
 #endif
\ No newline at end of file
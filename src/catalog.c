@@ -0,0 +1,236 @@
+#include "catalog.h"
+#include "builtins.h"
+#include "vars.h"
+#include <dirent.h>
+#include <sys/stat.h>
+
+// executables found in one PATH directory, as of its last modification time
+typedef struct {
+    char *path;
+    struct timespec mtime;
+    bool scanned;
+    char **names;
+    int count;
+} CatalogDir;
+
+static CatalogDir *dirs = NULL;
+static int dir_count = 0;
+static char *catalog_path_env = NULL;
+
+// sorted union of all directory names and builtins
+static const char **names = NULL;
+static int name_count = 0;
+static bool names_valid = false;
+
+// builtin_generation() the names were merged at: loading a builtin
+// changes the catalog as much as a new file in PATH does
+static unsigned long names_builtin_generation = 0;
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static void free_dir_names(CatalogDir *dir) {
+    for (int i = 0; i < dir->count; i++) {
+        free(dir->names[i]);
+    }
+    free(dir->names);
+    dir->names = NULL;
+    dir->count = 0;
+}
+
+static void free_dirs(void) {
+    for (int i = 0; i < dir_count; i++) {
+        free_dir_names(&dirs[i]);
+        free(dirs[i].path);
+    }
+    free(dirs);
+    dirs = NULL;
+    dir_count = 0;
+}
+
+// rebuild the directory list when PATH itself changed
+static void sync_path_dirs(void) {
+    const char *path_env = var_get("PATH");
+    if (path_env == NULL) path_env = "";
+
+    if (catalog_path_env != NULL && strcmp(catalog_path_env, path_env) == 0) {
+        return;
+    }
+
+    free_dirs();
+    free(catalog_path_env);
+    catalog_path_env = strdup(path_env);
+    names_valid = false;
+
+    char *path_copy = strdup(path_env);
+    if (path_copy == NULL) return;
+
+    int count = 1;
+    for (const char *p = path_copy; *p; p++) {
+        if (*p == PATH_SEPARATOR[0]) count++;
+    }
+
+    dirs = calloc(count, sizeof(CatalogDir));
+    if (dirs != NULL) {
+        char *saveptr = NULL;
+        char *dir = strtok_r(path_copy, PATH_SEPARATOR, &saveptr);
+        while (dir != NULL && dir_count < count) {
+            // a directory listed twice only needs to be scanned once
+            bool duplicate = false;
+            for (int i = 0; i < dir_count; i++) {
+                if (strcmp(dirs[i].path, dir) == 0) {
+                    duplicate = true;
+                    break;
+                }
+            }
+            if (!duplicate) {
+                dirs[dir_count++].path = strdup(dir);
+            }
+            dir = strtok_r(NULL, PATH_SEPARATOR, &saveptr);
+        }
+    }
+    free(path_copy);
+}
+
+// read the executables of one directory
+static void scan_dir(CatalogDir *dir) {
+    free_dir_names(dir);
+
+    DIR *handle = opendir(dir->path);
+    if (handle == NULL) return;
+
+    int capacity = 0;
+    int dfd = dirfd(handle);
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != NULL) {
+        // skip hidden files and directories
+        if (entry->d_name[0] == '.') continue;
+        if (entry->d_type == DT_DIR) continue;
+
+        struct stat st;
+        if (fstatat(dfd, entry->d_name, &st, 0) != 0) continue;
+        if (S_ISDIR(st.st_mode) || (st.st_mode & S_IXUSR) == 0) continue;
+
+        if (dir->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char **grown = realloc(dir->names, capacity * sizeof(char *));
+            if (grown == NULL) break;
+            dir->names = grown;
+        }
+        dir->names[dir->count++] = strdup(entry->d_name);
+    }
+    closedir(handle);
+}
+
+// merge every directory and the builtins into one sorted, unique array
+typedef struct {
+    const char **names;
+    int count;
+} NameList;
+
+static void count_builtin(const Builtin *builtin, void *data) {
+    (void)builtin;
+    ((NameList *)data)->count++;
+}
+
+static void add_builtin(const Builtin *builtin, void *data) {
+    NameList *list = data;
+    list->names[list->count++] = builtin->name;
+}
+
+static void rebuild_names(void) {
+    NameList list = {NULL, 0};
+    builtin_foreach(count_builtin, &list);
+    int total = list.count;
+    for (int i = 0; i < dir_count; i++) {
+        total += dirs[i].count;
+    }
+
+    const char **merged = malloc((total > 0 ? total : 1) * sizeof(char *));
+    if (merged == NULL) return;
+
+    list = (NameList){merged, 0};
+    builtin_foreach(add_builtin, &list);
+    int count = list.count;
+    for (int i = 0; i < dir_count; i++) {
+        for (int j = 0; j < dirs[i].count; j++) {
+            merged[count++] = dirs[i].names[j];
+        }
+    }
+
+    qsort(merged, count, sizeof(char *), compare_names);
+
+    int unique = 0;
+    for (int i = 0; i < count; i++) {
+        if (unique == 0 || strcmp(merged[unique - 1], merged[i]) != 0) {
+            merged[unique++] = merged[i];
+        }
+    }
+
+    free(names);
+    names = merged;
+    name_count = unique;
+    names_valid = true;
+    names_builtin_generation = builtin_generation();
+}
+
+void catalog_refresh(void) {
+    sync_path_dirs();
+
+    for (int i = 0; i < dir_count; i++) {
+        CatalogDir *dir = &dirs[i];
+        struct stat st;
+
+        if (stat(dir->path, &st) != 0) {
+            // directory vanished: forget what it held
+            if (dir->scanned) {
+                free_dir_names(dir);
+                dir->scanned = false;
+                names_valid = false;
+            }
+            continue;
+        }
+
+        if (dir->scanned &&
+            st.st_mtim.tv_sec == dir->mtime.tv_sec &&
+            st.st_mtim.tv_nsec == dir->mtime.tv_nsec) {
+            continue;
+        }
+
+        scan_dir(dir);
+        dir->mtime = st.st_mtim;
+        dir->scanned = true;
+        names_valid = false;
+    }
+
+    if (!names_valid || names_builtin_generation != builtin_generation()) {
+        rebuild_names();
+    }
+}
+
+const char *const *catalog_prefix(const char *prefix, int *count) {
+    size_t len = strlen(prefix);
+    *count = 0;
+    if (names == NULL) return NULL;
+
+    // binary search for the first name not sorting before prefix
+    int lo = 0;
+    int hi = name_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(names[mid], prefix) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    int end = lo;
+    while (end < name_count && strncmp(names[end], prefix, len) == 0) {
+        end++;
+    }
+
+    *count = end - lo;
+    return names + lo;
+}
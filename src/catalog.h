@@ -0,0 +1,16 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "common.h"
+
+// Bring the catalog of command names (builtins + executables in PATH) up to
+// date. Only PATH directories whose mtime changed since the last call are
+// rescanned, so calling this on every completion request is cheap.
+void catalog_refresh(void);
+
+// Find the sorted, duplicate-free run of names starting with prefix.
+// Returns the first matching name and stores the run length in count.
+// The names stay valid until the next catalog_refresh.
+const char *const *catalog_prefix(const char *prefix, int *count);
+
+#endif
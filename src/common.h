@@ -11,28 +11,65 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 
+#include "shell_builtin.h"
+
 #ifdef _WIN32
     #define PATH_SEPARATOR ";"
 #else
     #define PATH_SEPARATOR ":"
 #endif
 
-#define MAX_INPUT 1024
-#define MAX_ARGS 64
+// Descrittori su cui un comando builtin legge e scrive: gli stessi che
+// vedono i builtin caricati con "enable -f"
+typedef shell_builtin_io BuiltinIO;
 
 // Tipo per i puntatori a funzione dei comandi builtin
-typedef void (*cmd_handler_t)(char **);
+typedef shell_builtin_fn cmd_handler_t;
+
+// Hash FNV-1a di una stringa, per le tabelle hash della shell
+static inline unsigned int hash_string(const char *s) {
+    unsigned int h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+typedef enum {
+    REDIRECT_OUTPUT,        // > e >>
+    REDIRECT_INPUT,         // <
+    REDIRECT_HEREDOC,       // << e <<-: filename contiene il testo
+    REDIRECT_HERESTRING,    // <<<: filename contiene la parola
+    REDIRECT_DUP,           // N>&M e N<&M
+    REDIRECT_CLOSE          // N>&- e N<&-
+} RedirectKind;
 
 typedef struct {
-    char *filename;
+    char *filename;   // NULL per REDIRECT_DUP e REDIRECT_CLOSE
     int fd_type;  // 1 per stdout (>), 2 per stderr (2>), ecc.
     int append;   // 1 per append (>>), 0 per truncate (>)
+    int source_fd;    // REDIRECT_DUP: descrittore copiato su fd_type
+    RedirectKind kind;
 } Redirection;
 
 typedef struct {
-    char *args[MAX_ARGS];
+    char **args;    // NULL-terminated, allocated from the command line's arena
     int count;
-    Redirection output_redirect;
+    Redirection *redirects;     // applied in the order they were written
+    int redirect_count;
+    char **assigns;     // "NAME=value" words written before the command name
+    int assign_count;
+    bool expand;        // some word holds expansions still to be done
+    struct Compound *compound;  // if, while, until, for or case; NULL for a simple command
+    struct PathCache *path_cache;   // where a cached plan keeps args[0]'s program, or NULL
 } Args;
 
+// The program a cached plan's command ran last time. It is filled in the
+// first time the command runs and shared by the copies expansion makes.
+typedef struct PathCache {
+    struct HashEntry *entry;    // NULL until then, or when it must be looked up each run
+    unsigned long generation;   // hash_generation() when entry was found
+} PathCache;
+
 #endif
\ No newline at end of file
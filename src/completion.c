@@ -1,219 +1,389 @@
 #include "completion.h"
-#include "builtins.h"
-#include <readline/readline.h>
-#include <dirent.h>
+#include "catalog.h"
+#include "dircache.h"
 #include <sys/stat.h>
+#include <time.h>
+#include <readline/readline.h>
+#include <readline/tilde.h>
 
-// structure to track completion state
-typedef struct {
-    int phase;              // 0 = builtins, 1 = executables
-    int builtin_index;      // current builtin index
-    char **path_dirs;       // array of PATH directories
-    int path_dir_count;     // number of PATH directories
-    int current_dir_index;  // current directory being scanned
-    DIR *current_dir;       // current directory handle
-    int text_len;           // length of text to match
-    char **seen_executables; // list of executables already returned (to avoid duplicates)
-    int seen_count;         // number of seen executables
-} completion_state_t;
-
-// free completion state resources
-static void free_completion_state(completion_state_t *state) {
-    if (state->path_dirs != NULL) {
-        for (int i = 0; i < state->path_dir_count; i++) {
-            free(state->path_dirs[i]);
-        }
-        free(state->path_dirs);
-        state->path_dirs = NULL;
+// how long one Tab press may spend reading directories and checking
+// entries; past it completion offers what it found so far
+#define COMPLETION_BUDGET_MS 100
+
+// characters in a file name that must be escaped to stay one word
+#define QUOTE_CHARACTERS " \t\n\\\"'`$<>;|&()*?[]#"
+
+typedef enum {
+    COMPLETE_NOTHING,
+    COMPLETE_COMMANDS,      // builtins and programs in PATH
+    COMPLETE_FILES,         // anything in the directory
+    COMPLETE_DIRECTORIES,
+    COMPLETE_PROGRAMS       // directories and executable files, for "./x"
+} CompletionKind;
+
+// What the arguments of a builtin complete to. A builtin listed with an
+// option completes its kind only right after that option; a builtin not
+// listed at all completes files, like any other command.
+static const struct {
+    const char *name;
+    const char *option;
+    CompletionKind kind;
+} builtin_arguments[] = {
+    {"cd", NULL, COMPLETE_DIRECTORIES},
+    {"history", "-r", COMPLETE_FILES},
+    {"history", "-w", COMPLETE_FILES},
+    {"history", NULL, COMPLETE_NOTHING},
+    {"type", NULL, COMPLETE_COMMANDS},
+    {"hash", NULL, COMPLETE_COMMANDS},
+    {"pwd", NULL, COMPLETE_NOTHING},
+    {"exit", NULL, COMPLETE_NOTHING},
+    {"jobs", NULL, COMPLETE_NOTHING},
+    {"fg", NULL, COMPLETE_NOTHING},
+    {"bg", NULL, COMPLETE_NOTHING},
+    {"wait", NULL, COMPLETE_NOTHING},
+    {"export", NULL, COMPLETE_NOTHING},
+    {"unset", NULL, COMPLETE_NOTHING},
+    {"break", NULL, COMPLETE_NOTHING},
+    {"continue", NULL, COMPLETE_NOTHING},
+    {"shellstats", NULL, COMPLETE_NOTHING},
+    {"plancache", NULL, COMPLETE_NOTHING},
+    {"enable", "-f", COMPLETE_FILES},
+    {"enable", NULL, COMPLETE_NOTHING}
+};
+
+// words after which the next word is a command again
+static const char *const command_keywords[] = {
+    "if", "then", "elif", "else", "while", "until", "do", "!", "time"
+};
+
+static struct timespec deadline;
+
+static void start_budget(void) {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += COMPLETION_BUDGET_MS * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+}
+
+static bool budget_spent(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline.tv_sec ||
+           (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec);
+}
+
+// generator function for command completion (builtins + executables)
+char *command_generator(const char *text, int state) {
+    static const char *const *matches = NULL;
+    static int match_count = 0;
+    static int match_index = 0;
+
+    // look the prefix up in the catalog on first call
+    if (!state) {
+        catalog_refresh();
+        matches = catalog_prefix(text, &match_count);
+        match_index = 0;
     }
-    if (state->current_dir != NULL) {
-        closedir(state->current_dir);
-        state->current_dir = NULL;
+
+    if (match_index < match_count) {
+        return strdup(matches[match_index++]);
     }
-    if (state->seen_executables != NULL) {
-        for (int i = 0; i < state->seen_count; i++) {
-            free(state->seen_executables[i]);
-        }
-        free(state->seen_executables);
-        state->seen_executables = NULL;
+
+    return NULL;
+}
+
+// path matches of the current Tab press, handed to readline one by one
+static char **found = NULL;
+static int found_count = 0;
+static int found_capacity = 0;
+static int found_index = 0;
+
+static void add_found(const char *dir_part, size_t dir_len, const char *name) {
+    if (found_count == found_capacity) {
+        int capacity = found_capacity ? found_capacity * 2 : 64;
+        char **grown = realloc(found, capacity * sizeof(char *));
+        if (grown == NULL) return;
+        found = grown;
+        found_capacity = capacity;
     }
+    size_t name_len = strlen(name);
+    char *match = malloc(dir_len + name_len + 1);
+    if (match == NULL) return;
+    memcpy(match, dir_part, dir_len);
+    memcpy(match + dir_len, name, name_len + 1);
+    found[found_count++] = match;
 }
 
-// check if executable name was already seen
-static bool is_seen(completion_state_t *state, const char *name) {
-    for (int i = 0; i < state->seen_count; i++) {
-        if (strcmp(state->seen_executables[i], name) == 0) {
-            return true;
+// Whether an entry of a listing is what kind asks for. d_type answers
+// most of them; the rest need a stat, skipped once the budget is spent
+// so a slow filesystem offers the entry rather than stalling.
+static bool entry_wanted(const char *dir, const DirEntry *entry, CompletionKind kind) {
+    if (kind == COMPLETE_FILES) return true;
+
+    bool is_dir = entry->type == DT_DIR;
+    bool known = entry->type != DT_UNKNOWN && entry->type != DT_LNK;
+    if (known && (is_dir || kind == COMPLETE_DIRECTORIES)) return is_dir;
+    if (budget_spent()) return true;
+
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", dir, entry->name) >= (int)sizeof(path)) return false;
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    if (S_ISDIR(st.st_mode)) return true;
+    return kind == COMPLETE_PROGRAMS && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+// Collect the entries of the directory named in text whose names start
+// with the rest of text. The listing comes from the directory cache, read
+// under the Tab press's time budget.
+static void collect_paths(const char *text, CompletionKind kind) {
+    const char *slash = strrchr(text, '/');
+    const char *prefix = slash != NULL ? slash + 1 : text;
+    size_t dir_len = slash != NULL ? (size_t)(slash - text) + 1 : 0;
+    size_t prefix_len = strlen(prefix);
+
+    // the directory as typed, without its last slash unless it is "/"
+    char *typed = strndup(text, dir_len > 1 ? dir_len - 1 : dir_len);
+    if (typed == NULL) return;
+    char *dir = dir_len == 0 ? strdup(".") : typed[0] == '~' ? tilde_expand(typed) : strdup(typed);
+    free(typed);
+    if (dir == NULL) return;
+
+    const DirListing *listing = dircache_get_until(dir, &deadline);
+    if (listing != NULL) {
+        // the listing is sorted: the matches are one run from the first
+        // name not below the prefix
+        int low = 0, high = listing->count;
+        while (low < high) {
+            int mid = low + (high - low) / 2;
+            if (strcmp(listing->entries[mid].name, prefix) < 0) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        for (int i = low; i < listing->count; i++) {
+            const DirEntry *entry = &listing->entries[i];
+            if (strncmp(entry->name, prefix, prefix_len) != 0) break;
+            // a run of many thousands is cut off, checked now and then
+            if ((i - low) % 1024 == 1023 && budget_spent()) break;
+            // hidden entries only when asked for by name
+            if (entry->name[0] == '.' && prefix[0] != '.') continue;
+            if (entry_wanted(dir, entry, kind)) {
+                add_found(text, dir_len, entry->name);
+            }
         }
+        dircache_release(listing);
     }
-    return false;
+    free(dir);
 }
 
-// add executable to seen list
-static void add_seen(completion_state_t *state, const char *name) {
-    state->seen_executables = realloc(state->seen_executables, 
-                                      (state->seen_count + 1) * sizeof(char *));
-    if (state->seen_executables != NULL) {
-        state->seen_executables[state->seen_count] = strdup(name);
-        state->seen_count++;
+static char *path_generator(const char *text, int state, CompletionKind kind) {
+    if (!state) {
+        // whatever an abandoned run left over
+        for (int i = found_index; i < found_count; i++) free(found[i]);
+        found_count = 0;
+        found_index = 0;
+        start_budget();
+        collect_paths(text, kind);
+    }
+
+    if (found_index < found_count) {
+        return found[found_index++];
     }
+    return NULL;
 }
 
-// check if file is executable
-static bool is_executable(const char *path) {
-    struct stat st;
-    if (stat(path, &st) == 0) {
-        return (st.st_mode & S_IXUSR) != 0;
+char *filename_generator(const char *text, int state) {
+    return path_generator(text, state, COMPLETE_FILES);
+}
+
+char *directory_generator(const char *text, int state) {
+    return path_generator(text, state, COMPLETE_DIRECTORIES);
+}
+
+static char *program_generator(const char *text, int state) {
+    return path_generator(text, state, COMPLETE_PROGRAMS);
+}
+
+// The words of the simple command being typed, up to the word under the
+// cursor. Quotes and backslashes keep separators inside a word; an
+// operator starts a new command.
+typedef struct {
+    int words;              // complete words before the cursor's word
+    char command[64];
+    char previous[64];
+} CommandContext;
+
+static void copy_word(char *dest, size_t size, const char *word, size_t len) {
+    if (len >= size) len = size - 1;
+    memcpy(dest, word, len);
+    dest[len] = '\0';
+}
+
+static bool is_command_keyword(const char *word) {
+    for (size_t i = 0; i < sizeof(command_keywords) / sizeof(command_keywords[0]); i++) {
+        if (strcmp(word, command_keywords[i]) == 0) return true;
     }
     return false;
 }
 
-// generator function for command completion (builtins + executables)
-char *command_generator(const char *text, int state) {
-    static completion_state_t comp_state = {0};
-    
-    // initialize on first call
-    if (!state) {
-        // free any previously allocated resources
-        free_completion_state(&comp_state);
-        
-        comp_state.phase = 0;
-        comp_state.builtin_index = 0;
-        comp_state.path_dirs = NULL;
-        comp_state.path_dir_count = 0;
-        comp_state.current_dir_index = 0;
-        comp_state.current_dir = NULL;
-        comp_state.text_len = strlen(text);
-        comp_state.seen_executables = NULL;
-        comp_state.seen_count = 0;
-        
-        // parse PATH environment variable
-        char *path_env = getenv("PATH");
-        if (path_env != NULL) {
-            char path_copy[2048];
-            strncpy(path_copy, path_env, sizeof(path_copy) - 1);
-            path_copy[sizeof(path_copy) - 1] = '\0';
-            
-            // count directories
-            int count = 0;
-            char *temp = path_copy;
-            while (*temp) {
-                if (*temp == ':') count++;
-                temp++;
-            }
-            count++; // last directory
-            
-            comp_state.path_dirs = malloc(count * sizeof(char *));
-            if (comp_state.path_dirs != NULL) {
-                char *dir = strtok(path_copy, PATH_SEPARATOR);
-                while (dir != NULL && comp_state.path_dir_count < count) {
-                    comp_state.path_dirs[comp_state.path_dir_count] = strdup(dir);
-                    comp_state.path_dir_count++;
-                    dir = strtok(NULL, PATH_SEPARATOR);
+static void command_context(const char *line, int end, CommandContext *context) {
+    context->words = 0;
+    context->command[0] = '\0';
+    context->previous[0] = '\0';
+
+    char quote = '\0';
+    int word_start = -1;
+    for (int i = 0; i <= end; i++) {
+        char c = i < end ? line[i] : ' ';
+        if (quote != '\0') {
+            if (c == quote) quote = '\0';
+            continue;
+        }
+        if (c == '\\' && i + 1 < end) {
+            if (word_start < 0) word_start = i;
+            i++;
+            continue;
+        }
+        if (c == '\'' || c == '"') {
+            quote = c;
+            if (word_start < 0) word_start = i;
+            continue;
+        }
+        bool separator = c == ' ' || c == '\t' || c == '\n';
+        bool operator = strchr("|;&()", c) != NULL;
+        if ((separator || operator) && word_start >= 0) {
+            const char *word = line + word_start;
+            size_t len = i - word_start;
+            copy_word(context->previous, sizeof(context->previous), word, len);
+            if (context->words == 0 && is_command_keyword(context->previous)) {
+                // "if", "do" and the like: the command is the next word
+            } else {
+                if (context->words == 0) {
+                    copy_word(context->command, sizeof(context->command), word, len);
                 }
+                context->words++;
             }
+            word_start = -1;
+        }
+        if (operator) {
+            context->words = 0;
+            context->command[0] = '\0';
+            context->previous[0] = '\0';
+        } else if (!separator && word_start < 0) {
+            word_start = i;
         }
     }
-    
-    // phase 0: return builtin matches
-    if (comp_state.phase == 0) {
-        static const char *builtins[] = {"echo", "exit"};
-        static const int builtin_count = 2;
-        
-        while (comp_state.builtin_index < builtin_count) {
-            const char *name = builtins[comp_state.builtin_index++];
-            if (strncmp(name, text, comp_state.text_len) == 0) {
-                return strdup(name);
-            }
+}
+
+static CompletionKind argument_kind(const CommandContext *context) {
+    for (size_t i = 0; i < sizeof(builtin_arguments) / sizeof(builtin_arguments[0]); i++) {
+        if (strcmp(builtin_arguments[i].name, context->command) != 0) continue;
+        if (builtin_arguments[i].option == NULL ||
+            strcmp(builtin_arguments[i].option, context->previous) == 0) {
+            return builtin_arguments[i].kind;
         }
-        
-        // switch to executables phase
-        comp_state.phase = 1;
     }
-    
-    // phase 1: return executable matches from PATH
-    if (comp_state.phase == 1) {
-        while (comp_state.current_dir_index < comp_state.path_dir_count) {
-            // open directory if not already open
-            if (comp_state.current_dir == NULL) {
-                const char *dir_path = comp_state.path_dirs[comp_state.current_dir_index];
-                
-                // check if directory exists and is accessible
-                if (access(dir_path, R_OK | X_OK) == 0) {
-                    comp_state.current_dir = opendir(dir_path);
-                }
-                
-                // if directory doesn't exist or can't be opened, skip it
-                if (comp_state.current_dir == NULL) {
-                    comp_state.current_dir_index++;
-                    continue;
-                }
-            }
-            
-            // read directory entries
-            struct dirent *entry = readdir(comp_state.current_dir);
-            if (entry == NULL) {
-                // end of directory, move to next
-                closedir(comp_state.current_dir);
-                comp_state.current_dir = NULL;
-                comp_state.current_dir_index++;
-                continue;
-            }
-            
-            // skip hidden files and directories
-            if (entry->d_name[0] == '.') {
-                continue;
-            }
-            
-            // check if name matches text prefix
-            if (strncmp(entry->d_name, text, comp_state.text_len) == 0) {
-                // check if already seen (to avoid duplicates across PATH directories)
-                if (is_seen(&comp_state, entry->d_name)) {
-                    continue;
-                }
-                
-                // build full path and check if executable
-                char fullpath[512];
-                snprintf(fullpath, sizeof(fullpath), "%s/%s", 
-                        comp_state.path_dirs[comp_state.current_dir_index], 
-                        entry->d_name);
-                
-                if (is_executable(fullpath)) {
-                    add_seen(&comp_state, entry->d_name);
-                    return strdup(entry->d_name);
-                }
-            }
+    return COMPLETE_FILES;
+}
+
+// Escape a completed file name with backslashes so it stays one word.
+// Inside quotes the user opened it goes as it is; readline closes them.
+static char *quote_filename(char *text, int match_type, char *quote_pointer) {
+    (void)match_type;
+    if (quote_pointer != NULL && *quote_pointer != '\0') {
+        return strdup(text);
+    }
+    char *quoted = malloc(strlen(text) * 2 + 1);
+    if (quoted == NULL) return NULL;
+    char *out = quoted;
+    for (const char *p = text; *p != '\0'; p++) {
+        if (strchr(QUOTE_CHARACTERS, *p) != NULL) {
+            *out++ = '\\';
         }
-        
-        // cleanup when done
-        free_completion_state(&comp_state);
-        return NULL;
+        *out++ = *p;
     }
-    
-    return NULL;
+    *out = '\0';
+    return quoted;
+}
+
+// The word as the generators see it: backslashes outside quotes removed
+static char *dequote_filename(const char *text, int quote_char) {
+    char *plain = malloc(strlen(text) + 1);
+    if (plain == NULL) return NULL;
+    char *out = plain;
+    for (const char *p = text; *p != '\0'; p++) {
+        if (*p == '\\' && quote_char == 0 && p[1] != '\0') p++;
+        *out++ = *p;
+    }
+    *out = '\0';
+    return plain;
 }
 
 // completion generator function
 char **command_completion(const char *text, int start, int end) {
-    char **matches = NULL;
-    
     // suppress unused parameter warning
     (void)end;
-    
-    // disable default filename completion
+
+    // the generators below cover files too: no readline defaults
     rl_attempted_completion_over = 1;
-    
-    // only complete the first word (command name)
-    if (start == 0) {
-        matches = rl_completion_matches(text, command_generator);
+
+    CommandContext context;
+    command_context(rl_line_buffer, start, &context);
+
+    CompletionKind kind;
+    if (context.words == 0) {
+        // a command name, unless it is spelled as a path
+        kind = strchr(text, '/') != NULL || text[0] == '~' ? COMPLETE_PROGRAMS : COMPLETE_COMMANDS;
+    } else {
+        kind = argument_kind(&context);
+    }
+
+    rl_compentry_func_t *generator = NULL;
+    switch (kind) {
+    case COMPLETE_COMMANDS:
+        generator = command_generator;
+        break;
+    case COMPLETE_FILES:
+        generator = filename_generator;
+        break;
+    case COMPLETE_DIRECTORIES:
+        generator = directory_generator;
+        break;
+    case COMPLETE_PROGRAMS:
+        generator = program_generator;
+        break;
+    case COMPLETE_NOTHING:
+        return NULL;
     }
-    
+    if (kind == COMPLETE_COMMANDS) {
+        return rl_completion_matches(text, generator);
+    }
+
+    // readline hands over the word as typed: match on what it stands for,
+    // and have the matches quoted back on the way in
+    rl_filename_completion_desired = 1;
+    char *plain = rl_completion_found_quote ? dequote_filename(text, rl_completion_quote_character) : NULL;
+    char **matches = rl_completion_matches(plain != NULL ? plain : text, generator);
+    free(plain);
     return matches;
 }
 
+// a word break character escaped with a backslash does not break the word
+static int char_is_quoted(char *text, int index) {
+    return index > 0 && text[index - 1] == '\\' && !char_is_quoted(text, index - 1);
+}
+
 // set up tab completion
 void setup_completion(void) {
     rl_attempted_completion_function = command_completion;
     // append space after completion
     rl_completion_append_character = ' ';
-}
\ No newline at end of file
+    // words end where the lexer's would
+    rl_completer_word_break_characters = " \t\n\"'<>;|&()";
+    rl_completer_quote_characters = "'\"";
+    rl_filename_quote_characters = QUOTE_CHARACTERS;
+    rl_filename_quoting_function = quote_filename;
+    rl_char_is_quoted_p = char_is_quoted;
+}
@@ -4,7 +4,19 @@
 #include "common.h"
 #include <readline/readline.h>
 
+// readline generator over the command catalog: the first call (state 0)
+// looks the prefix up, each call returns the next match or NULL
+char *command_generator(const char *text, int state);
+
+// readline generators over the directory named in text ("." if none):
+// entries starting with the rest of text, or only the directories among
+// them. Listings come from the directory cache, and the first call stops
+// reading and checking entries after a fixed time budget, so a huge or
+// slow directory gives partial matches instead of blocking the prompt.
+char *filename_generator(const char *text, int state);
+char *directory_generator(const char *text, int state);
+
 char **command_completion(const char *text, int start, int end);
 void setup_completion(void);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,197 @@
+#include "copy.h"
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+// amount moved per kernel call and size of the fallback buffer
+#define COPY_CHUNK (1024 * 1024)
+#define COPY_BUFFER_SIZE (128 * 1024)
+
+typedef enum {
+    METHOD_SPLICE,
+    METHOD_COPY_FILE_RANGE,
+    METHOD_SENDFILE,
+    METHOD_READ_WRITE
+} CopyMethod;
+
+static bool is_pipe(const struct stat *st) {
+    return S_ISFIFO(st->st_mode);
+}
+
+static CopyMethod choose_method(int in_fd, int out_fd) {
+    struct stat in_st;
+    struct stat out_st;
+    if (fstat(in_fd, &in_st) != 0 || fstat(out_fd, &out_st) != 0) {
+        return METHOD_READ_WRITE;
+    }
+
+    // none of the zero-copy calls can append
+    int out_flags = fcntl(out_fd, F_GETFL);
+    bool appending = out_flags >= 0 && (out_flags & O_APPEND);
+
+    if ((is_pipe(&in_st) || is_pipe(&out_st)) && !appending) {
+        return METHOD_SPLICE;
+    }
+    if (S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode) && !appending) {
+        return METHOD_COPY_FILE_RANGE;
+    }
+    if (S_ISREG(in_st.st_mode)) {
+        return METHOD_SENDFILE;
+    }
+    return METHOD_READ_WRITE;
+}
+
+// write all of buf, retrying short writes
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int copy_read_write(int in_fd, int out_fd, bool *write_failed) {
+    char *buf = malloc(COPY_BUFFER_SIZE);
+    if (buf == NULL) return -1;
+
+    int result = 0;
+    while (1) {
+        ssize_t n = read(in_fd, buf, COPY_BUFFER_SIZE);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            result = -1;
+            break;
+        }
+        if (write_all(out_fd, buf, n) != 0) {
+            *write_failed = true;
+            result = -1;
+            break;
+        }
+    }
+
+    int saved_errno = errno;
+    free(buf);
+    errno = saved_errno;
+    return result;
+}
+
+int copy_fd(int in_fd, int out_fd, bool *write_failed) {
+    *write_failed = false;
+    if (in_fd < 0 || out_fd < 0) {
+        // a side closed with <&- or >&-
+        *write_failed = out_fd < 0;
+        errno = EBADF;
+        return -1;
+    }
+    CopyMethod method = choose_method(in_fd, out_fd);
+
+    // nothing is moved until the first successful call, so a method the
+    // kernel refuses for these descriptors can still fall back cleanly
+    bool moved = false;
+    while (method != METHOD_READ_WRITE) {
+        ssize_t n;
+        if (method == METHOD_SPLICE) {
+            n = splice(in_fd, NULL, out_fd, NULL, COPY_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+        } else if (method == METHOD_COPY_FILE_RANGE) {
+            n = copy_file_range(in_fd, NULL, out_fd, NULL, COPY_CHUNK, 0);
+        } else {
+            n = sendfile(out_fd, in_fd, NULL, COPY_CHUNK);
+        }
+
+        if (n == 0) return 0;
+        if (n > 0) {
+            moved = true;
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EPIPE) {
+            *write_failed = true;
+            return -1;
+        }
+        if (!moved && (errno == EINVAL || errno == EXDEV || errno == ENOSYS ||
+                       errno == EOPNOTSUPP || errno == EBADF)) {
+            break;
+        }
+        return -1;
+    }
+
+    return copy_read_write(in_fd, out_fd, write_failed);
+}
+
+// pipe-to-pipe copy into one extra file: tee(2) duplicates the data into
+// the output pipe, then splice consumes the same bytes into the file
+static int tee_splice(int in_fd, int pipe_out, int file_out, bool *failed) {
+    while (1) {
+        ssize_t n = tee(in_fd, pipe_out, COPY_CHUNK, 0);
+        if (n == 0) return 0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EPIPE) failed[0] = true;
+            return -1;
+        }
+        while (n > 0) {
+            ssize_t m = splice(in_fd, NULL, file_out, NULL, n, SPLICE_F_MOVE);
+            if (m < 0) {
+                if (errno == EINTR) continue;
+                failed[1] = true;
+                return -1;
+            }
+            n -= m;
+        }
+    }
+}
+
+static bool can_tee_splice(int in_fd, const int *out_fds, int count) {
+    if (count != 2) return false;
+
+    struct stat in_st;
+    struct stat pipe_st;
+    struct stat file_st;
+    if (fstat(in_fd, &in_st) != 0 || fstat(out_fds[0], &pipe_st) != 0 ||
+        fstat(out_fds[1], &file_st) != 0) {
+        return false;
+    }
+    int file_flags = fcntl(out_fds[1], F_GETFL);
+    return is_pipe(&in_st) && is_pipe(&pipe_st) && S_ISREG(file_st.st_mode) &&
+           file_flags >= 0 && !(file_flags & O_APPEND);
+}
+
+int tee_fd(int in_fd, const int *out_fds, int count, bool *failed) {
+    for (int i = 0; i < count; i++) {
+        failed[i] = false;
+    }
+
+    if (can_tee_splice(in_fd, out_fds, count)) {
+        return tee_splice(in_fd, out_fds[0], out_fds[1], failed);
+    }
+
+    char *buf = malloc(COPY_BUFFER_SIZE);
+    if (buf == NULL) return -1;
+
+    int result = 0;
+    while (1) {
+        ssize_t n = read(in_fd, buf, COPY_BUFFER_SIZE);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            result = -1;
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            if (!failed[i] && write_all(out_fds[i], buf, n) != 0) {
+                failed[i] = true;
+            }
+        }
+    }
+
+    int saved_errno = errno;
+    free(buf);
+    errno = saved_errno;
+    return result;
+}
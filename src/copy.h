@@ -0,0 +1,18 @@
+#ifndef COPY_H
+#define COPY_H
+
+#include "common.h"
+
+// Move everything readable from in_fd to out_fd inside the kernel when the
+// descriptor types allow it: splice when either side is a pipe,
+// copy_file_range between regular files and sendfile from a regular file.
+// Falls back to a large read/write loop. Returns 0, or -1 with errno set
+// (write errors set *write_failed so callers can tell the sides apart).
+int copy_fd(int in_fd, int out_fd, bool *write_failed);
+
+// Copy in_fd to every descriptor in out_fds, like tee(1). A pipe-to-pipe
+// copy with one file uses tee(2) and splice so no data is copied through
+// user space. Outputs that fail are reported through failed[] and dropped.
+int tee_fd(int in_fd, const int *out_fds, int count, bool *failed);
+
+#endif
@@ -0,0 +1,245 @@
+#include "dircache.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define DIRCACHE_BUCKETS 1024
+
+// past this many directories the cache starts over, so a walk over a huge
+// tree cannot keep all of it in memory
+#define DIRCACHE_MAX_DIRS 16384
+
+// buffer handed to getdents64, several hundred entries per call
+#define GETDENTS_BUFFER_SIZE (64 * 1024)
+
+// the record getdents64 fills in, which glibc does not always declare
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+typedef struct CachedDir {
+    DirListing listing;     // first, so a listing pointer is its CachedDir
+    dev_t dev;              // directories are keyed by identity, not by path,
+    ino_t ino;              // so relative names stay right after a cd
+    struct timespec mtime;
+    char *names;            // every entry name, NUL-separated
+    int refs;               // listings handed out and not yet released
+    bool dropped;           // no longer in the table, freed at the last release
+    struct CachedDir *next;
+} CachedDir;
+
+static CachedDir *buckets[DIRCACHE_BUCKETS];
+static int cached_count = 0;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void free_dir(CachedDir *dir) {
+    free(dir->listing.entries);
+    free(dir->names);
+    free(dir);
+}
+
+// take a directory out of the table; caller holds cache_lock
+static void drop_dir(CachedDir *dir) {
+    dir->dropped = true;
+    cached_count--;
+    if (dir->refs == 0) {
+        free_dir(dir);
+    }
+}
+
+static void drop_all(void) {
+    for (int i = 0; i < DIRCACHE_BUCKETS; i++) {
+        CachedDir *dir = buckets[i];
+        buckets[i] = NULL;
+        while (dir != NULL) {
+            CachedDir *next = dir->next;
+            drop_dir(dir);
+            dir = next;
+        }
+    }
+}
+
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const DirEntry *)a)->name, ((const DirEntry *)b)->name);
+}
+
+static bool past(const struct timespec *deadline) {
+    if (deadline == NULL) return false;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline->tv_sec ||
+           (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+// Read a directory with getdents64 into a new CachedDir, stopping early
+// between batches once the deadline passed
+static CachedDir *read_dir(const char *path, const struct timespec *deadline) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    CachedDir *dir = calloc(1, sizeof(CachedDir));
+    char *buffer = malloc(GETDENTS_BUFFER_SIZE);
+    size_t names_len = 0, names_capacity = 0;
+    // entries hold offsets into names until it stops moving
+    size_t *offsets = NULL;
+    unsigned char *types = NULL;
+    int count = 0, capacity = 0;
+    bool ok = dir != NULL && buffer != NULL;
+
+    while (ok) {
+        if (past(deadline)) {
+            dir->listing.partial = true;
+            break;
+        }
+        long n = syscall(SYS_getdents64, fd, buffer, GETDENTS_BUFFER_SIZE);
+        if (n <= 0) {
+            ok = n == 0;
+            break;
+        }
+        for (long pos = 0; pos < n && ok; ) {
+            struct linux_dirent64 *entry = (struct linux_dirent64 *)(buffer + pos);
+            pos += entry->d_reclen;
+
+            const char *name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+            size_t len = strlen(name) + 1;
+            if (names_len + len > names_capacity) {
+                names_capacity = names_capacity ? names_capacity * 2 : 4096;
+                while (names_len + len > names_capacity) names_capacity *= 2;
+                char *grown = realloc(dir->names, names_capacity);
+                if (grown == NULL) {
+                    ok = false;
+                    break;
+                }
+                dir->names = grown;
+            }
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                size_t *grown_offsets = realloc(offsets, capacity * sizeof(size_t));
+                unsigned char *grown_types = grown_offsets != NULL ? realloc(types, capacity) : NULL;
+                if (grown_offsets != NULL) offsets = grown_offsets;
+                if (grown_types == NULL) {
+                    ok = false;
+                    break;
+                }
+                types = grown_types;
+            }
+            memcpy(dir->names + names_len, name, len);
+            offsets[count] = names_len;
+            types[count] = entry->d_type;
+            names_len += len;
+            count++;
+        }
+    }
+    close(fd);
+    free(buffer);
+
+    if (ok) {
+        dir->listing.entries = malloc((count > 0 ? count : 1) * sizeof(DirEntry));
+        ok = dir->listing.entries != NULL;
+    }
+    if (ok) {
+        for (int i = 0; i < count; i++) {
+            dir->listing.entries[i].name = dir->names + offsets[i];
+            dir->listing.entries[i].type = types[i];
+        }
+        dir->listing.count = count;
+        qsort(dir->listing.entries, count, sizeof(DirEntry), compare_entries);
+    }
+    free(offsets);
+    free(types);
+
+    if (!ok) {
+        if (dir != NULL) free_dir(dir);
+        return NULL;
+    }
+    return dir;
+}
+
+const DirListing *dircache_get_until(const char *path, const struct timespec *deadline) {
+    // stat first: a change made while the directory is read then shows up
+    // as a newer mtime next time, never as a stale listing kept for good
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) return NULL;
+
+    unsigned int bucket = (unsigned int)(st.st_ino ^ st.st_dev) % DIRCACHE_BUCKETS;
+    pthread_mutex_lock(&cache_lock);
+    for (CachedDir *dir = buckets[bucket]; dir != NULL; dir = dir->next) {
+        if (dir->ino == st.st_ino && dir->dev == st.st_dev &&
+            dir->mtime.tv_sec == st.st_mtim.tv_sec && dir->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            dir->refs++;
+            pthread_mutex_unlock(&cache_lock);
+            return &dir->listing;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    // read without the lock, so other threads keep walking meanwhile
+    CachedDir *fresh = read_dir(path, deadline);
+    if (fresh == NULL) return NULL;
+    fresh->dev = st.st_dev;
+    fresh->ino = st.st_ino;
+    fresh->mtime = st.st_mtim;
+    fresh->refs = 1;
+    if (fresh->listing.partial) {
+        // handed out but never shared, freed at its release
+        fresh->dropped = true;
+        return &fresh->listing;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    // replace an out of date copy, or one another thread just read
+    for (CachedDir **link = &buckets[bucket]; *link != NULL; link = &(*link)->next) {
+        CachedDir *dir = *link;
+        if (dir->ino == st.st_ino && dir->dev == st.st_dev) {
+            *link = dir->next;
+            drop_dir(dir);
+            break;
+        }
+    }
+    if (cached_count >= DIRCACHE_MAX_DIRS) {
+        drop_all();
+    }
+    fresh->next = buckets[bucket];
+    buckets[bucket] = fresh;
+    cached_count++;
+    pthread_mutex_unlock(&cache_lock);
+    return &fresh->listing;
+}
+
+const DirListing *dircache_get(const char *path) {
+    return dircache_get_until(path, NULL);
+}
+
+void dircache_release(const DirListing *listing) {
+    if (listing == NULL) return;
+
+    CachedDir *dir = (CachedDir *)listing;
+    pthread_mutex_lock(&cache_lock);
+    dir->refs--;
+    if (dir->refs == 0 && dir->dropped) {
+        free_dir(dir);
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+int dircache_find(const DirListing *listing, const char *name) {
+    int low = 0, high = listing->count - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        int cmp = strcmp(listing->entries[mid].name, name);
+        if (cmp == 0) return mid;
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,36 @@
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#include "common.h"
+#include <dirent.h>
+#include <time.h>
+
+typedef struct {
+    const char *name;
+    unsigned char type;     // d_type: DT_DIR, DT_REG ..., DT_UNKNOWN if the filesystem does not say
+} DirEntry;
+
+// The entries of one directory as of its modification time, sorted by
+// name, without "." and "..". A listing never changes once made.
+typedef struct {
+    DirEntry *entries;
+    int count;
+    bool partial;           // the read stopped at its deadline, entries are missing
+} DirListing;
+
+// Get the listing of dir. The cached copy is used while the directory's
+// mtime is unchanged, otherwise it is read again with getdents64. Returns
+// NULL if dir cannot be read. Safe to call from any thread; every listing
+// returned must be given back with dircache_release.
+const DirListing *dircache_get(const char *dir);
+void dircache_release(const DirListing *listing);
+
+// dircache_get that stops reading at a CLOCK_MONOTONIC deadline. A read cut
+// short gives a partial listing of what was read by then; it is never
+// cached, so a later call with more time sees the whole directory.
+const DirListing *dircache_get_until(const char *dir, const struct timespec *deadline);
+
+// Index of name in a listing, or -1
+int dircache_find(const DirListing *listing, const char *name);
+
+#endif
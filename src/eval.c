@@ -0,0 +1,266 @@
+#include "eval.h"
+#include "outbuf.h"
+#include "pipeline.h"
+#include "shell.h"
+#include "jobs.h"
+#include "vars.h"
+#include "expand.h"
+#include <fnmatch.h>
+#include <signal.h>
+
+// loops running in this process, and the levels a break or continue still
+// has to leave
+static int loop_depth = 0;
+static int pending_breaks = 0;
+static int pending_continues = 0;
+
+// break, continue or Ctrl+C is on its way out of the running lists
+static bool unwinding(void) {
+    return pending_breaks > 0 || pending_continues > 0 || shell_interrupted;
+}
+
+// the source text of items first..last, for job listings
+static const char *item_text(Arena *arena, const CommandList *list, int first, int last) {
+    size_t start = list->items[first].pipeline.start;
+    size_t end = list->items[last].pipeline.end;
+    return arena_strndup(arena, list->source + start, end - start);
+}
+
+// Run the and-or chain of items first..last in the foreground
+static int run_chain(Arena *arena, const CommandList *list, int first, int last) {
+    int status = shell.last_status;
+    bool run = true;
+
+    for (int i = first; i <= last && !unwinding(); i++) {
+        const ListItem *item = &list->items[i];
+
+        // a skipped item passes the previous status on to the next connector
+        if (run) {
+            // the text is only shown if the pipeline gets stopped
+            const char *text = job_control_enabled() ? item_text(arena, list, i, i) : NULL;
+            status = execute_pipeline(arena, &item->pipeline, text, false);
+            shell.last_status = status;
+            // a command killed by Ctrl+C stops the loop it ran in too
+            if (status == 128 + SIGINT && shell.interactive) {
+                shell_interrupted = 1;
+            }
+        }
+
+        switch (item->connector) {
+            case CONNECT_AND:
+                run = status == 0;
+                break;
+            case CONNECT_OR:
+                run = status != 0;
+                break;
+            case CONNECT_SEQ:
+                run = true;
+                break;
+        }
+    }
+
+    return status;
+}
+
+// Start the chain first..last as a background job. A lone pipeline is
+// started directly; a chain of && and || needs a subshell to decide.
+static void run_background(Arena *arena, const CommandList *list, int first, int last) {
+    const char *text = item_text(arena, list, first, last);
+
+    if (first == last) {
+        execute_pipeline(arena, &list->items[first].pipeline, text, true);
+        return;
+    }
+
+    pid_t pgid = job_new_pgid();
+    // see start_forked_builtin
+    outbuf_flush();
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return;
+    }
+
+    if (pid == 0) {
+        shell.subshell = true;
+        if (pgid >= 0) {
+            setpgid(0, 0);
+        }
+        shell_reset_signals();
+        signal(SIGPIPE, SIG_IGN);
+        jobs_subshell();
+
+        int status = run_chain(arena, list, first, last);
+        // _exit: see start_forked_builtin
+        fflush(stdout);
+        _exit(status);
+    }
+
+    if (pgid >= 0) {
+        setpgid(pid, pid);
+        pgid = pid;
+    }
+    job_add_background(pgid, &pid, 1, text);
+}
+
+int execute_list(Arena *arena, const CommandList *list) {
+    int status = shell.last_status;
+
+    for (int first = 0; first < list->count && !unwinding(); ) {
+        // an and-or chain ends at the first ; & or newline
+        int last = first;
+        while (last < list->count - 1 && list->items[last].connector != CONNECT_SEQ) {
+            last++;
+        }
+
+        if (list->items[last].background) {
+            run_background(arena, list, first, last);
+            status = 0;
+            shell.last_status = status;
+        } else {
+            status = run_chain(arena, list, first, last);
+        }
+        first = last + 1;
+    }
+
+    return status;
+}
+
+// Whether a loop ends after its body ran: a break, Ctrl+C, or a continue
+// meant for a loop further out
+static bool loop_ends(void) {
+    if (shell_interrupted) return true;
+    if (pending_breaks > 0) {
+        pending_breaks--;
+        return true;
+    }
+    if (pending_continues > 0) {
+        pending_continues--;
+        return pending_continues > 0;
+    }
+    return false;
+}
+
+static int run_if(Arena *arena, const Compound *compound) {
+    int pairs = (compound->part_count - (compound->has_else ? 1 : 0)) / 2;
+    for (int i = 0; i < pairs; i++) {
+        int condition = execute_list(arena, &compound->parts[2 * i]);
+        if (unwinding()) return condition;
+        if (condition == 0) {
+            return execute_list(arena, &compound->parts[2 * i + 1]);
+        }
+    }
+    if (compound->has_else) {
+        return execute_list(arena, &compound->parts[compound->part_count - 1]);
+    }
+    return 0;
+}
+
+// while and until. Each iteration's allocations are rewound, so a loop
+// that runs for days does not grow the arena.
+static int run_while(Arena *arena, const Compound *compound) {
+    bool until = compound->kind == COMPOUND_UNTIL;
+    int status = 0;
+    ArenaMark mark = arena_mark(arena);
+
+    loop_depth++;
+    while (1) {
+        arena_rewind(arena, mark);
+        int condition = execute_list(arena, &compound->parts[0]);
+        if (unwinding()) {
+            if (loop_ends()) break;
+            continue;
+        }
+        if ((condition == 0) == until) break;
+
+        status = execute_list(arena, &compound->parts[1]);
+        if (unwinding() && loop_ends()) break;
+    }
+    loop_depth--;
+    return status;
+}
+
+static int run_for(Arena *arena, const Compound *compound) {
+    // the words are expanded once, before the first iteration
+    Args words = {0};
+    words.args = compound->words;
+    words.count = compound->word_count;
+    words.expand = true;
+    const Args *expanded = compound->word_count > 0 ? expand_commands(arena, &words, 1) : &words;
+    if (expanded == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    int status = 0;
+    ArenaMark mark = arena_mark(arena);
+    loop_depth++;
+    for (int i = 0; i < expanded->count; i++) {
+        arena_rewind(arena, mark);
+        var_set(compound->name, expanded->args[i], 0);
+        status = execute_list(arena, &compound->parts[0]);
+        if (unwinding() && loop_ends()) break;
+    }
+    loop_depth--;
+    return status;
+}
+
+static int run_case(Arena *arena, const Compound *compound) {
+    const char *subject = expand_word(arena, compound->subject);
+    if (subject == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    for (int i = 0; i < compound->item_count; i++) {
+        const CaseItem *item = &compound->items[i];
+        for (char **word = item->patterns; *word != NULL; word++) {
+            const char *pattern = expand_pattern(arena, *word);
+            if (pattern == NULL || fnmatch(pattern, subject, 0) != 0) continue;
+            return item->body.count > 0 ? execute_list(arena, &item->body) : 0;
+        }
+    }
+    return 0;
+}
+
+int execute_compound(Arena *arena, const Compound *compound) {
+    switch (compound->kind) {
+        case COMPOUND_IF:
+            return run_if(arena, compound);
+        case COMPOUND_WHILE:
+        case COMPOUND_UNTIL:
+            return run_while(arena, compound);
+        case COMPOUND_FOR:
+            return run_for(arena, compound);
+        case COMPOUND_CASE:
+            return run_case(arena, compound);
+    }
+    return 0;
+}
+
+// break [n] and continue [n]: leave n enclosing loops, or all there are
+static int loop_control(char **argv, const BuiltinIO *io, int *pending) {
+    long levels = 1;
+    if (argv[1] != NULL) {
+        char *end;
+        levels = strtol(argv[1], &end, 10);
+        if (argv[1][0] == '\0' || *end != '\0' || levels < 1) {
+            outbuf_printf(io->err, "%s: %s: loop count out of range\n", argv[0], argv[1]);
+            return 1;
+        }
+    }
+    if (loop_depth == 0) {
+        outbuf_printf(io->err, "%s: only meaningful in a `for', `while', or `until' loop\n", argv[0]);
+        return 0;
+    }
+    *pending = levels < loop_depth ? (int)levels : loop_depth;
+    return 0;
+}
+
+int handle_break(char **argv, const BuiltinIO *io) {
+    return loop_control(argv, io, &pending_breaks);
+}
+
+int handle_continue(char **argv, const BuiltinIO *io) {
+    return loop_control(argv, io, &pending_continues);
+}
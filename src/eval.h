@@ -0,0 +1,19 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "common.h"
+#include "arena.h"
+#include "parser.h"
+
+// Run every item of a parsed command line, honouring ;, && and ||.
+// Returns the exit status of the last pipeline that ran.
+int execute_list(Arena *arena, const CommandList *list);
+
+// Run an if, while, until, for or case command in this process. Its
+// redirections have already been applied by the caller.
+int execute_compound(Arena *arena, const Compound *compound);
+
+int handle_break(char **argv, const BuiltinIO *io);
+int handle_continue(char **argv, const BuiltinIO *io);
+
+#endif
@@ -1,104 +1,89 @@
 #include "executor.h"
+#include "outbuf.h"
+#include "builtins.h"
+#include "spawn.h"
+#include "shell.h"
+#include "trace.h"
+#include "vars.h"
+#include "redirect.h"
+#include <errno.h>
 
-int apply_redirection(const Redirection *redirect) {
-    if (redirect->filename == NULL || redirect->fd_type == 0) {
-        return -1;
+int execute_with_redirection(cmd_handler_t handler, char **args, const Redirection *redirects, int count) {
+    // the builtin is handed the redirected descriptors: the shell's own
+    // are never touched, so there is nothing to save and restore
+    RedirectPlan plan;
+    if (!redirect_plan(&plan, redirects, count, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO)) {
+        return 1;
     }
-    
-    int original_fd = dup(redirect->fd_type);
-    
-    int flags = O_WRONLY | O_CREAT;
-    if (redirect->append) {
-        flags |= O_APPEND;
-    } else {
-        flags |= O_TRUNC;
-    }
-    
-    int output_fd = open(redirect->filename, flags, 0644);
-    if (output_fd < 0) {
-        perror("open");
-        return original_fd;
-    }
-    
-    dup2(output_fd, redirect->fd_type);
-    close(output_fd);
-    
-    return original_fd;
-}
 
-void restore_fd(int original_fd, int fd_type) {
-    if (original_fd >= 0) {
-        dup2(original_fd, fd_type);
-        close(original_fd);
-    }
-}
+    BuiltinIO io = {plan.fds[STDIN_FILENO], plan.fds[STDOUT_FILENO], plan.fds[STDERR_FILENO]};
+    TRACE_BEGIN(start);
+    int status = handler(args, &io);
+    outbuf_flush();
+    TRACE_END(TRACE_BUILTIN, start);
 
-void execute_with_redirection(cmd_handler_t handler, char **args, const Redirection *redirect) {
-    int original_fd = -1;
-    
-    if (redirect->filename != NULL) {
-        original_fd = apply_redirection(redirect);
-    }
-    
-    handler(args);
-    
-    if (original_fd >= 0) {
-        restore_fd(original_fd, redirect->fd_type);
-    }
+    redirect_plan_close(&plan);
+    return status;
 }
 
 char *find_command_in_path(const char *command) {
-    char *path_env = getenv("PATH");
+    const char *path_env = var_get("PATH");
     if (path_env == NULL) return NULL;
 
-    char path_copy[2048];
-    strncpy(path_copy, path_env, sizeof(path_copy) - 1);
-    path_copy[sizeof(path_copy) - 1] = '\0';
-
-    char *dir = strtok(path_copy, PATH_SEPARATOR);
+    // walk PATH in place: no copy, so its length is not limited
+    size_t command_len = strlen(command);
+    const char *dir = path_env;
+    while (1) {
+        const char *end = strchr(dir, PATH_SEPARATOR[0]);
+        size_t dir_len = end != NULL ? (size_t)(end - dir) : strlen(dir);
 
-    while (dir != NULL) {
-        char fullpath[512];
-        snprintf(fullpath, sizeof(fullpath), "%s/%s", dir, command);
+        char fullpath[PATH_MAX];
+        if (dir_len > 0 && dir_len + 1 + command_len < sizeof(fullpath)) {
+            memcpy(fullpath, dir, dir_len);
+            fullpath[dir_len] = '/';
+            memcpy(fullpath + dir_len + 1, command, command_len + 1);
 
-        if (access(fullpath, X_OK) == 0) {
-            char *result = malloc(strlen(fullpath) + 1);
-            strcpy(result, fullpath);
-            return result;
+            if (access(fullpath, X_OK) == 0) {
+                return strdup(fullpath);
+            }
         }
 
-        dir = strtok(NULL, PATH_SEPARATOR);
+        if (end == NULL) break;
+        dir = end + 1;
     }
 
     return NULL;
 }
 
-void handle_external_command(char **argv, const Redirection *redirect) {
-    if (argv[0] == NULL) return;
-    
+int execute_builtin(const Args *command) {
+    if (command->count == 0) return 0;
+
+    cmd_handler_t handler = find_builtin_handler(command->args[0]);
+    if (handler == NULL) {
+        fprintf(stderr, "%s: not a shell builtin\n", command->args[0]);
+        return 1;
+    }
+    return execute_with_redirection(handler, command->args, command->redirects, command->redirect_count);
+}
+
+int run_external_fallback(char **argv, const BuiltinIO *io) {
+    // walk PATH directly: this may run on a pipeline's helper thread
     char *fullpath = find_command_in_path(argv[0]);
-    
-    if (fullpath != NULL) {
-        pid_t pid = fork();
-        
-        if (pid == -1) {
-            perror("fork");
-        } else if (pid == 0) {
-            // child process
-            if (redirect->filename != NULL) {
-                apply_redirection(redirect);
-            }
-            
-            execvp(fullpath, argv);
-            perror(argv[0]);
-            exit(1);
-        } else {
-            // parent process
-            waitpid(pid, NULL, 0);
-        }
-        
-        free(fullpath);
-    } else {
-        printf("%s: command not found\n", argv[0]);
+    if (fullpath == NULL) {
+        outbuf_printf(io->err, "%s: command not found\n", argv[0]);
+        return 127;
     }
-}
\ No newline at end of file
+
+    SpawnIO spawn_io = {io->in, io->out, io->err, NULL, 0, -1, NULL};
+    pid_t pid = spawn_command(fullpath, argv, &spawn_io);
+    free(fullpath);
+    if (pid < 0) {
+        return errno == ENOENT ? 127 : 126;
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) return 1;
+    }
+    return exit_status_from_wait(status);
+}
@@ -4,9 +4,14 @@
 #include "common.h"
 
 char *find_command_in_path(const char *command);
-void execute_with_redirection(cmd_handler_t handler, char **args, const Redirection *redirect);
-void handle_external_command(char **args, const Redirection *redirect);
-int apply_redirection(const Redirection *redirect);
-void restore_fd(int original_fd, int fd_type);
+int execute_with_redirection(cmd_handler_t handler, char **args, const Redirection *redirects, int count);
+
+// Run the external program a builtin stands in for, with the builtin's
+// descriptors. Builtins use it for options they do not implement.
+int run_external_fallback(char **argv, const BuiltinIO *io);
+
+// Run a single parsed builtin command in the shell and return its status.
+// External commands always go through a pipeline, even a lone one.
+int execute_builtin(const Args *command);
 
 #endif
\ No newline at end of file
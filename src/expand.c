@@ -0,0 +1,265 @@
+#include "expand.h"
+#include "lexer.h"
+#include "vars.h"
+#include "shell.h"
+#include "wildcard.h"
+
+#define DEFAULT_IFS " \t\n"
+
+// Fields being built from the words of one command, all in the arena
+typedef struct {
+    Arena *arena;
+    char *text;         // the field being built
+    size_t length;
+    size_t capacity;
+    bool started;       // the field exists, even if it is still empty
+    char **fields;      // finished fields, NULL-terminated
+    int count;
+    int field_capacity;
+    const char *ifs;    // NULL when not splitting
+    bool glob;          // fields are pathname patterns, with literal *, ? and [ escaped
+    bool glob_active;   // the field has an unquoted *, ? or [
+    bool glob_escaped;  // the field has backslashes added to escape it
+} Expander;
+
+static bool append_char(Expander *ex, char c) {
+    // keep room for the terminator
+    if (ex->length + 1 >= ex->capacity) {
+        size_t capacity = ex->capacity ? ex->capacity * 2 : 32;
+        char *text = arena_alloc(ex->arena, capacity);
+        if (text == NULL) return false;
+        memcpy(text, ex->text, ex->length);
+        ex->text = text;
+        ex->capacity = capacity;
+    }
+    ex->text[ex->length++] = c;
+    ex->started = true;
+    return true;
+}
+
+// Add a character to a field that may be a pattern. Only an active *, ?
+// or [ (unquoted in the input or in an unquoted expansion) is special;
+// any other pattern character, and every backslash, is escaped.
+static bool append_glob_char(Expander *ex, char c, bool active) {
+    if (ex->glob) {
+        if (active && (c == '*' || c == '?' || c == '[')) {
+            ex->glob_active = true;
+        } else if (c == '\\' || (!active && (c == '*' || c == '?' || c == '[' || c == ']'))) {
+            if (!append_char(ex, '\\')) return false;
+            ex->glob_escaped = true;
+        }
+    }
+    return append_char(ex, c);
+}
+
+static bool push_field(Expander *ex, char *field) {
+    if (ex->count + 1 >= ex->field_capacity) {
+        int capacity = ex->field_capacity ? ex->field_capacity * 2 : 8;
+        char **fields = arena_alloc(ex->arena, capacity * sizeof(char *));
+        if (fields == NULL) return false;
+        if (ex->count > 0) {
+            memcpy(fields, ex->fields, ex->count * sizeof(char *));
+        }
+        ex->fields = fields;
+        ex->field_capacity = capacity;
+    }
+    ex->fields[ex->count++] = field;
+    ex->fields[ex->count] = NULL;
+    return true;
+}
+
+static bool end_field(Expander *ex) {
+    if (ex->text == NULL) {
+        // an empty field that never needed a buffer
+        ex->text = arena_alloc(ex->arena, 1);
+        if (ex->text == NULL) return false;
+    }
+    ex->text[ex->length] = '\0';
+
+    bool pushed = false;
+    if (ex->glob_active) {
+        char **matches;
+        int count = wildcard_expand(ex->arena, ex->text, &matches);
+        if (count < 0) return false;
+        for (int i = 0; i < count; i++) {
+            if (!push_field(ex, matches[i])) return false;
+        }
+        pushed = count > 0;
+    }
+    if (!pushed) {
+        // a pattern matching nothing is passed on as written
+        if (ex->glob_escaped) {
+            size_t length = 0;
+            for (size_t i = 0; i < ex->length; i++) {
+                if (ex->text[i] == '\\') i++;
+                ex->text[length++] = ex->text[i];
+            }
+            ex->text[length] = '\0';
+        }
+        if (!push_field(ex, ex->text)) return false;
+    }
+
+    // the next field gets a buffer of its own
+    ex->text = NULL;
+    ex->length = 0;
+    ex->capacity = 0;
+    ex->started = false;
+    ex->glob_active = false;
+    ex->glob_escaped = false;
+    return true;
+}
+
+// Value of the parameter named by the len characters at name. The special
+// parameters are formatted into buf.
+static const char *lookup(Arena *arena, const char *name, size_t len, char *buf, size_t size) {
+    if (len == 1 && name[0] == '?') {
+        snprintf(buf, size, "%d", shell.last_status);
+        return buf;
+    }
+    if (len == 1 && name[0] == '$') {
+        // the shell's own pid, also in a subshell
+        snprintf(buf, size, "%d", (int)(shell.pid > 0 ? shell.pid : getpid()));
+        return buf;
+    }
+    if (len == 1 && name[0] == '!') {
+        if (shell.last_background <= 0) return "";
+        snprintf(buf, size, "%d", (int)shell.last_background);
+        return buf;
+    }
+
+    char *copy = arena_strndup(arena, name, len);
+    if (copy == NULL) return "";
+    const char *value = var_get(copy);
+    return value != NULL ? value : "";
+}
+
+static bool expand_into(Expander *ex, const char *word) {
+    for (const char *p = word; *p != '\0'; p++) {
+        if (*p == WORD_ESCAPE) {
+            p++;
+            if (!append_glob_char(ex, *p, false)) return false;
+            continue;
+        }
+        if (*p != WORD_EXPAND && *p != WORD_EXPAND_QUOTED) {
+            if (!append_glob_char(ex, *p, true)) return false;
+            continue;
+        }
+
+        bool quoted = *p == WORD_EXPAND_QUOTED;
+        bool split = !quoted && ex->ifs != NULL;
+        const char *name = p + 1;
+        const char *end = strchr(name, WORD_EXPAND_END);
+        char buf[32];
+        const char *value = lookup(ex->arena, name, end - name, buf, sizeof(buf));
+        p = end;
+
+        // a quoted expansion makes a field even when it is empty
+        if (!split) {
+            ex->started = true;
+        }
+        for (const char *v = value; *v != '\0'; v++) {
+            if (split && strchr(ex->ifs, *v) != NULL) {
+                if (ex->started && !end_field(ex)) return false;
+            } else if (!append_glob_char(ex, *v, !quoted)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// whether word text still holds expansion marks or escapes
+static bool has_expansions(const char *word) {
+    return strpbrk(word, (const char[]){WORD_EXPAND, WORD_EXPAND_QUOTED, WORD_ESCAPE, '\0'}) != NULL;
+}
+
+char *expand_word(Arena *arena, const char *word) {
+    if (!has_expansions(word)) return (char *)word;
+
+    Expander ex = {0};
+    ex.arena = arena;
+    if (!expand_into(&ex, word) || !end_field(&ex)) return NULL;
+    return ex.fields[0];
+}
+
+char *expand_pattern(Arena *arena, const char *word) {
+    Expander ex = {0};
+    ex.arena = arena;
+    ex.glob = true;
+    if (!expand_into(&ex, word)) return NULL;
+    if (ex.text == NULL) return arena_strdup(arena, "");
+    ex.text[ex.length] = '\0';
+    return ex.text;
+}
+
+static bool expand_command(Arena *arena, const Args *command, Args *out) {
+    *out = *command;
+    out->expand = false;
+
+    const char *ifs = var_get("IFS");
+    Expander ex = {0};
+    ex.arena = arena;
+    ex.ifs = ifs != NULL ? ifs : DEFAULT_IFS;
+    ex.glob = true;
+
+    for (int i = 0; i < command->count; i++) {
+        const char *word = command->args[i];
+        if (!has_expansions(word) && strpbrk(word, "*?[") == NULL) {
+            // an unexpanded word is kept as it is, even when empty
+            if (!push_field(&ex, command->args[i])) return false;
+            continue;
+        }
+        if (!expand_into(&ex, word)) return false;
+        if (ex.started && !end_field(&ex)) return false;
+    }
+    if (ex.fields == NULL) {
+        // every word expanded to nothing
+        ex.fields = arena_alloc(arena, sizeof(char *));
+        if (ex.fields == NULL) return false;
+        ex.fields[0] = NULL;
+    }
+    out->args = ex.fields;
+    out->count = ex.count;
+
+    if (command->assign_count > 0) {
+        out->assigns = arena_alloc(arena, (command->assign_count + 1) * sizeof(char *));
+        if (out->assigns == NULL) return false;
+        for (int i = 0; i < command->assign_count; i++) {
+            out->assigns[i] = expand_word(arena, command->assigns[i]);
+            if (out->assigns[i] == NULL) return false;
+        }
+        out->assigns[command->assign_count] = NULL;
+    }
+
+    if (command->redirect_count > 0) {
+        out->redirects = arena_alloc(arena, command->redirect_count * sizeof(Redirection));
+        if (out->redirects == NULL) return false;
+        for (int i = 0; i < command->redirect_count; i++) {
+            out->redirects[i] = command->redirects[i];
+            // a file name, a here-string or a here-document's body
+            if (command->redirects[i].filename == NULL) continue;
+            out->redirects[i].filename = expand_word(arena, command->redirects[i].filename);
+            if (out->redirects[i].filename == NULL) return false;
+        }
+    }
+    return true;
+}
+
+Args *expand_commands(Arena *arena, Args *commands, int count) {
+    bool needed = false;
+    for (int i = 0; i < count && !needed; i++) {
+        needed = commands[i].expand;
+    }
+    if (!needed) return commands;
+
+    Args *expanded = arena_alloc(arena, count * sizeof(Args));
+    if (expanded == NULL) return NULL;
+    for (int i = 0; i < count; i++) {
+        if (!commands[i].expand) {
+            expanded[i] = commands[i];
+        } else if (!expand_command(arena, &commands[i], &expanded[i])) {
+            return NULL;
+        }
+    }
+    return expanded;
+}
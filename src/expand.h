@@ -0,0 +1,23 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include "common.h"
+#include "arena.h"
+
+// Do the expansions left in the words of count commands. Unquoted
+// expansions are split into fields on IFS, and a word that expands to no
+// fields at all is dropped. Arguments with an unquoted *, ? or [ are then
+// replaced by the pathnames they match, or kept as written if none do.
+// Assignments, redirection targets and here-document bodies are expanded
+// without splitting. Returns commands itself when nothing needs
+// expanding, otherwise a copy from the arena, or NULL if memory ran out.
+Args *expand_commands(Arena *arena, Args *commands, int count);
+
+// Expand one word into a single string without field splitting
+char *expand_word(Arena *arena, const char *word);
+
+// Expand a word into an fnmatch pattern: its unquoted *, ? and [ stay
+// special, quoted ones are escaped with a backslash
+char *expand_pattern(Arena *arena, const char *word);
+
+#endif
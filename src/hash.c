@@ -0,0 +1,186 @@
+#include "hash.h"
+#include "executor.h"
+#include "trace.h"
+#include "vars.h"
+
+#define HASH_BUCKETS 128
+
+struct HashEntry {
+    char *name;
+    char *path;
+    int hits;
+    struct HashEntry *next;
+};
+
+static HashEntry *buckets[HASH_BUCKETS];
+static int entry_count = 0;
+
+// value of PATH the table was filled against; a different PATH empties it
+static char *hashed_path_env = NULL;
+
+// bumped whenever a remembered location is dropped or replaced, so paths
+// copied out of the table can tell they may be stale
+static unsigned long generation = 1;
+
+// drop every entry if PATH changed since the table was filled
+static void check_path_changed(void) {
+    const char *path_env = var_get("PATH");
+
+    if (hashed_path_env != NULL && path_env != NULL && strcmp(hashed_path_env, path_env) == 0) {
+        return;
+    }
+    if (hashed_path_env == NULL && path_env == NULL) {
+        return;
+    }
+
+    hash_clear();
+    free(hashed_path_env);
+    hashed_path_env = path_env != NULL ? strdup(path_env) : NULL;
+}
+
+static HashEntry *find_entry(const char *command) {
+    HashEntry *entry = buckets[hash_string(command) % HASH_BUCKETS];
+    while (entry != NULL) {
+        if (strcmp(entry->name, command) == 0) {
+            return entry;
+        }
+        entry = entry->next;
+    }
+    return NULL;
+}
+
+static HashEntry *insert_entry(const char *command, const char *path) {
+    HashEntry *entry = find_entry(command);
+    if (entry != NULL) {
+        char *new_path = strdup(path);
+        if (new_path == NULL) return NULL;
+        free(entry->path);
+        entry->path = new_path;
+        entry->hits = 0;
+        generation++;
+        return entry;
+    }
+
+    entry = malloc(sizeof(HashEntry));
+    if (entry == NULL) return NULL;
+    entry->name = strdup(command);
+    entry->path = strdup(path);
+    if (entry->name == NULL || entry->path == NULL) {
+        free(entry->name);
+        free(entry->path);
+        free(entry);
+        return NULL;
+    }
+    entry->hits = 0;
+
+    unsigned int bucket = hash_string(command) % HASH_BUCKETS;
+    entry->next = buckets[bucket];
+    buckets[bucket] = entry;
+    entry_count++;
+    return entry;
+}
+
+static const char *lookup_command(const char *command, HashEntry **found) {
+    *found = NULL;
+    if (command == NULL || command[0] == '\0') return NULL;
+
+    // explicit paths bypass PATH search entirely
+    if (strchr(command, '/') != NULL) {
+        return access(command, X_OK) == 0 ? command : NULL;
+    }
+
+    check_path_changed();
+
+    HashEntry *entry = find_entry(command);
+    if (entry == NULL) {
+        char *fullpath = find_command_in_path(command);
+        if (fullpath == NULL) return NULL;
+        entry = insert_entry(command, fullpath);
+        free(fullpath);
+        if (entry == NULL) return NULL;
+    }
+
+    *found = entry;
+    entry->hits++;
+    return entry->path;
+}
+
+const char *resolve_command(const char *command) {
+    HashEntry *entry;
+    return resolve_command_entry(command, &entry);
+}
+
+const char *resolve_command_entry(const char *command, HashEntry **entry) {
+    TRACE_BEGIN(start);
+    const char *path = lookup_command(command, entry);
+    TRACE_END(TRACE_LOOKUP, start);
+    return path;
+}
+
+const char *hash_hit(HashEntry *entry) {
+    entry->hits++;
+    return entry->path;
+}
+
+const char *hash_find(const char *command) {
+    check_path_changed();
+    HashEntry *entry = find_entry(command);
+    return entry != NULL ? entry->path : NULL;
+}
+
+void hash_insert(const char *command, const char *path) {
+    check_path_changed();
+    insert_entry(command, path);
+}
+
+void hash_remove(const char *command) {
+    HashEntry **link = &buckets[hash_string(command) % HASH_BUCKETS];
+    while (*link != NULL) {
+        HashEntry *entry = *link;
+        if (strcmp(entry->name, command) == 0) {
+            *link = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            entry_count--;
+            generation++;
+            return;
+        }
+        link = &entry->next;
+    }
+}
+
+void hash_clear(void) {
+    for (int i = 0; i < HASH_BUCKETS; i++) {
+        HashEntry *entry = buckets[i];
+        while (entry != NULL) {
+            HashEntry *next = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            entry = next;
+        }
+        buckets[i] = NULL;
+    }
+    entry_count = 0;
+    generation++;
+}
+
+unsigned long hash_generation(void) {
+    check_path_changed();
+    return generation;
+}
+
+int hash_count(void) {
+    check_path_changed();
+    return entry_count;
+}
+
+void hash_foreach(hash_visit_t visit, void *data) {
+    check_path_changed();
+    for (int i = 0; i < HASH_BUCKETS; i++) {
+        for (HashEntry *entry = buckets[i]; entry != NULL; entry = entry->next) {
+            visit(entry->name, entry->path, entry->hits, data);
+        }
+    }
+}
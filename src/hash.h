@@ -0,0 +1,39 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "common.h"
+
+// A remembered command. It stays valid until hash_generation() changes.
+typedef struct HashEntry HashEntry;
+
+// callback used by hash_foreach to walk the remembered commands
+typedef void (*hash_visit_t)(const char *name, const char *path, int hits, void *data);
+
+// Resolve a command name to the path to execute, using the hash table.
+// Names containing '/' are returned as-is when executable and never hashed.
+// Every successful call counts as a hit. Returns NULL if not found.
+const char *resolve_command(const char *command);
+
+// resolve_command that also hands back the entry the path came from, or
+// NULL when the name was not hashed, so later runs can count with hash_hit
+const char *resolve_command_entry(const char *command, HashEntry **entry);
+
+// Count another run of a command found earlier and return its path. The
+// entry must be from the current hash_generation().
+const char *hash_hit(HashEntry *entry);
+
+// Return the remembered path for a command without searching PATH
+const char *hash_find(const char *command);
+
+void hash_insert(const char *command, const char *path);
+void hash_remove(const char *command);
+void hash_clear(void);
+int hash_count(void);
+
+// Changes whenever a location that was handed out may no longer be right:
+// PATH changed, or an entry was removed or replaced. New entries alone
+// leave it as it is.
+unsigned long hash_generation(void);
+void hash_foreach(hash_visit_t visit, void *data);
+
+#endif
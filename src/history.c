@@ -0,0 +1,177 @@
+#include "history.h"
+#include "trace.h"
+#include "vars.h"
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <readline/history.h>
+
+// lines HISTFILE may grow past HISTFILESIZE before it is compacted, so the
+// rewrite happens now and then instead of after every command
+#define HISTORY_COMPACT_SLACK_MIN 64
+
+static int history_fd = -1;        // HISTFILE, opened for appending
+static long histfile_size = -1;    // HISTFILESIZE, -1 for no limit
+static long histfile_lines = 0;    // lines in HISTFILE as far as we know
+
+// parse a size variable; unset, empty or negative means no limit
+static long size_from_env(const char *name, long fallback) {
+    const char *value = var_get(name);
+    if (value == NULL || *value == '\0') return fallback;
+
+    char *end;
+    long size = strtol(value, &end, 10);
+    if (*end != '\0' || size < 0) return -1;
+    return size;
+}
+
+long history_read_file(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return -1;
+
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    long count = 0;
+
+    // getline handles lines of any length
+    while ((length = getline(&line, &capacity, file)) != -1) {
+        count++;
+        if (length > 0 && line[length - 1] == '\n') {
+            line[--length] = '\0';
+        }
+        if (length > 0) {
+            add_history(line);
+        }
+    }
+
+    free(line);
+    fclose(file);
+    return count;
+}
+
+void history_init(void) {
+    long histsize = size_from_env("HISTSIZE", -1);
+    histfile_size = size_from_env("HISTFILESIZE", histsize);
+
+    // keep only the newest HISTSIZE entries in memory
+    if (histsize >= 0) {
+        stifle_history(histsize > INT_MAX ? INT_MAX : (int)histsize);
+    }
+
+    const char *histfile = var_get("HISTFILE");
+    if (histfile == NULL) return;
+
+    long lines = history_read_file(histfile);
+    histfile_lines = lines > 0 ? lines : 0;
+
+    history_fd = open(histfile, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+}
+
+// Rewrite HISTFILE in place keeping only its newest HISTFILESIZE lines.
+// Runs under the same exclusive lock appends take, so no concurrent
+// session can lose a line while the file is being shortened.
+static void compact_history_file(void) {
+    if (history_fd < 0 || histfile_size < 0) return;
+
+    const char *histfile = var_get("HISTFILE");
+    if (histfile == NULL) return;
+
+    int fd = open(histfile, O_RDWR | O_CLOEXEC);
+    if (fd < 0) return;
+
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return;
+    }
+
+    struct stat st;
+    char *data = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = malloc(st.st_size);
+    }
+
+    size_t size = 0;
+    if (data != NULL) {
+        while (size < (size_t)st.st_size) {
+            ssize_t n = pread(fd, data + size, st.st_size - size, size);
+            if (n <= 0) break;
+            size += n;
+        }
+
+        // walk back from the end to find where the newest lines start
+        long lines = 0;
+        size_t keep_from = 0;
+        size_t end = size;
+        if (end > 0 && data[end - 1] == '\n') end--;
+        for (size_t i = end; i > 0; i--) {
+            if (data[i - 1] == '\n') {
+                lines++;
+                if (lines == histfile_size) {
+                    keep_from = i;
+                    break;
+                }
+            }
+        }
+        if (histfile_size == 0) keep_from = size;
+
+        if (keep_from > 0) {
+            size_t keep = size - keep_from;
+            if (pwrite(fd, data + keep_from, keep, 0) == (ssize_t)keep) {
+                ftruncate(fd, keep);
+            }
+            histfile_lines = histfile_size;
+        } else {
+            // another session already compacted it
+            histfile_lines = lines + (end > 0 ? 1 : 0);
+        }
+        free(data);
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+void history_record(const char *line) {
+    TRACE_BEGIN(start);
+    add_history(line);
+
+    if (history_fd < 0) {
+        TRACE_END(TRACE_HISTORY, start);
+        return;
+    }
+
+    // one write per entry under the lock, so lines from concurrent shells
+    // never interleave and never land in the middle of a compaction
+    size_t length = strlen(line);
+    char *entry = malloc(length + 1);
+    if (entry == NULL) return;
+    memcpy(entry, line, length);
+    entry[length] = '\n';
+
+    if (flock(history_fd, LOCK_EX) == 0) {
+        ssize_t written = write(history_fd, entry, length + 1);
+        flock(history_fd, LOCK_UN);
+        if (written == (ssize_t)(length + 1)) {
+            histfile_lines++;
+        }
+    }
+    free(entry);
+
+    long slack = histfile_size / 10;
+    if (slack < HISTORY_COMPACT_SLACK_MIN) slack = HISTORY_COMPACT_SLACK_MIN;
+    if (histfile_size >= 0 && histfile_lines > histfile_size + slack) {
+        compact_history_file();
+    }
+    TRACE_END(TRACE_HISTORY, start);
+}
+
+void history_close(void) {
+    if (history_fd < 0) return;
+
+    if (histfile_size >= 0 && histfile_lines > histfile_size) {
+        compact_history_file();
+    }
+    close(history_fd);
+    history_fd = -1;
+}
@@ -0,0 +1,20 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "common.h"
+
+// Load HISTFILE into the in-memory history and apply HISTSIZE
+void history_init(void);
+
+// Add a line to the in-memory history and append it to HISTFILE right away,
+// so concurrent shells never overwrite each other's commands
+void history_record(const char *line);
+
+// Called on exit: compacts HISTFILE down to HISTFILESIZE if it grew past it
+void history_close(void);
+
+// Add every non-empty line of a file to the in-memory history.
+// Returns the number of lines read, or -1 if the file cannot be opened.
+long history_read_file(const char *path);
+
+#endif
@@ -0,0 +1,663 @@
+#include "jobs.h"
+#include "outbuf.h"
+#include "shell.h"
+#include "trace.h"
+#include "spawn.h"
+#include <errno.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+typedef enum {
+    JOB_RUNNING,
+    JOB_STOPPED,
+    JOB_DONE
+} JobState;
+
+typedef struct {
+    pid_t pid;
+    int pidfd;      // readable once the process exits, -1 if unavailable
+    bool done;
+    int status;     // wait status once done
+} JobProcess;
+
+typedef struct Job {
+    int id;
+    pid_t pgid;     // -1 when job control is off
+    JobProcess *procs;
+    int count;
+    JobState state;
+    bool reported;  // current state already shown to the user
+    bool inherited; // the parent's, in a forked subshell: listed, never waited for
+    char *command;
+    unsigned long seq;  // bumped when the job starts or stops, newest is current
+    struct Job *next;
+} Job;
+
+static Job *jobs = NULL;    // ordered by job number
+static unsigned long job_seq = 0;
+
+static bool job_control = false;
+static pid_t shell_pgid = -1;
+static int shell_terminal = STDIN_FILENO;
+
+void jobs_init(void) {
+    if (!isatty(shell_terminal)) return;
+
+    // wait until the shell is in the foreground before taking over
+    while (tcgetpgrp(shell_terminal) != (shell_pgid = getpgrp())) {
+        kill(-shell_pgid, SIGTTIN);
+    }
+
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+
+    // a session leader already leads its group, so failure here is fine
+    setpgid(0, 0);
+    shell_pgid = getpgrp();
+    tcsetpgrp(shell_terminal, shell_pgid);
+    job_control = true;
+}
+
+bool job_control_enabled(void) {
+    return job_control;
+}
+
+pid_t job_new_pgid(void) {
+    return job_control ? 0 : -1;
+}
+
+void job_give_terminal(pid_t pgid) {
+    if (job_control && pgid > 0) {
+        tcsetpgrp(shell_terminal, pgid);
+    }
+}
+
+static void take_terminal(void) {
+    if (job_control) {
+        tcsetpgrp(shell_terminal, shell_pgid);
+    }
+}
+
+static void update_process(Job *job, JobProcess *proc, int status) {
+    if (WIFSTOPPED(status)) {
+        job->state = JOB_STOPPED;
+        job->reported = false;
+        return;
+    }
+    if (WIFCONTINUED(status)) {
+        job->state = JOB_RUNNING;
+        return;
+    }
+
+    proc->done = true;
+    proc->status = status;
+    if (proc->pidfd >= 0) {
+        close(proc->pidfd);
+        proc->pidfd = -1;
+    }
+
+    for (int i = 0; i < job->count; i++) {
+        if (!job->procs[i].done) return;
+    }
+    job->state = JOB_DONE;
+    job->reported = false;
+}
+
+// exit status of a job: that of its last process
+static int job_status(const Job *job) {
+    const JobProcess *last = &job->procs[job->count - 1];
+    if (last->done) {
+        return exit_status_from_wait(last->status);
+    }
+    return 0;
+}
+
+static Job *new_job(pid_t pgid, const pid_t *pids, const int *statuses, int count, const char *command) {
+    Job *job = calloc(1, sizeof(Job));
+    if (job == NULL) return NULL;
+
+    job->procs = calloc(count, sizeof(JobProcess));
+    job->command = strdup(command != NULL ? command : "");
+    if (job->procs == NULL || job->command == NULL) {
+        free(job->procs);
+        free(job->command);
+        free(job);
+        return NULL;
+    }
+
+    job->pgid = pgid;
+    job->state = JOB_RUNNING;
+    for (int i = 0; i < count; i++) {
+        JobProcess *proc = &job->procs[job->count++];
+        proc->pid = pids[i];
+        proc->pidfd = -1;
+        if (proc->pid <= 0) {
+            // a stage that never started: waitpid(0) would reap someone else
+            proc->done = true;
+            proc->status = 0;
+        } else if (statuses != NULL && statuses[i] != -1 && !WIFSTOPPED(statuses[i])) {
+            proc->done = true;
+            proc->status = statuses[i];
+        }
+    }
+    return job;
+}
+
+static void free_job(Job *job) {
+    for (int i = 0; i < job->count; i++) {
+        if (job->procs[i].pidfd >= 0) {
+            close(job->procs[i].pidfd);
+        }
+    }
+    free(job->procs);
+    free(job->command);
+    free(job);
+}
+
+void jobs_subshell(void) {
+    // "jobs | wc -l" still lists them, as they were at the fork
+    for (Job *job = jobs; job != NULL; job = job->next) {
+        job->inherited = true;
+        for (int i = 0; i < job->count; i++) {
+            if (job->procs[i].pidfd >= 0) {
+                close(job->procs[i].pidfd);
+                job->procs[i].pidfd = -1;
+            }
+        }
+    }
+    job_control = false;
+}
+
+// give the job the next number and put it in the table
+static void insert_job(Job *job) {
+    int id = 1;
+    Job **link = &jobs;
+    while (*link != NULL) {
+        id = (*link)->id + 1;
+        link = &(*link)->next;
+    }
+    job->id = id;
+    job->seq = ++job_seq;
+    job->next = NULL;
+    *link = job;
+
+    for (int i = 0; i < job->count; i++) {
+        if (!job->procs[i].done) {
+            job->procs[i].pidfd = open_pidfd(job->procs[i].pid);
+        }
+    }
+}
+
+static void remove_job(Job *job) {
+    for (Job **link = &jobs; *link != NULL; link = &(*link)->next) {
+        if (*link == job) {
+            *link = job->next;
+            free_job(job);
+            return;
+        }
+    }
+}
+
+// '+' marks the current job, '-' the previous one
+static char job_marker(const Job *job) {
+    unsigned long newest = 0;
+    unsigned long second = 0;
+    for (Job *j = jobs; j != NULL; j = j->next) {
+        if (j->seq > newest) {
+            second = newest;
+            newest = j->seq;
+        } else if (j->seq > second) {
+            second = j->seq;
+        }
+    }
+    if (job->seq == newest) return '+';
+    if (job->seq == second) return '-';
+    return ' ';
+}
+
+static void describe_state(const Job *job, char *buf, size_t size) {
+    if (job->state == JOB_RUNNING) {
+        snprintf(buf, size, "Running");
+    } else if (job->state == JOB_STOPPED) {
+        snprintf(buf, size, "Stopped");
+    } else {
+        int status = job->procs[job->count - 1].status;
+        if (WIFSIGNALED(status)) {
+            snprintf(buf, size, "%s", strsignal(WTERMSIG(status)));
+        } else if (WEXITSTATUS(status) != 0) {
+            snprintf(buf, size, "Exit %d", WEXITSTATUS(status));
+        } else {
+            snprintf(buf, size, "Done");
+        }
+    }
+}
+
+static void print_job(int fd, const Job *job) {
+    char state[64];
+    describe_state(job, state, sizeof(state));
+    outbuf_printf(fd, "[%d]%c  %-24s%s%s\n", job->id, job_marker(job), state, job->command,
+                  job->state == JOB_RUNNING ? " &" : "");
+}
+
+// Wait for every unfinished process of a job in the foreground
+static void wait_job(Job *job) {
+    job->state = JOB_RUNNING;
+    for (int i = 0; i < job->count; i++) {
+        JobProcess *proc = &job->procs[i];
+        if (proc->done) continue;
+
+        int status;
+        pid_t result;
+        while ((result = waitpid(proc->pid, &status, job_control ? WUNTRACED : 0)) == -1 && errno == EINTR) {
+        }
+        if (result == -1) {
+            // not our child any more: treat it as gone
+            proc->done = true;
+            proc->status = 0;
+            continue;
+        }
+        update_process(job, proc, status);
+    }
+    take_terminal();
+}
+
+// Wait for one process of a foreground pipeline, taking its rusage and end
+// time when it is being timed. Returns false if it is not our child.
+static bool wait_stage(pid_t pid, int *status, StageTimes *times) {
+    struct rusage usage;
+    pid_t result;
+    while ((result = wait4(pid, status, job_control ? WUNTRACED : 0, &usage)) == -1 && errno == EINTR) {
+    }
+    if (result == -1) return false;
+
+    if (times != NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &times->end);
+        times->usage = usage;
+        times->measured = true;
+    }
+    return true;
+}
+
+// Reap the processes of a timed pipeline in the order they finish, so each
+// end time is taken when it happens rather than when the stage before it
+// is done. Anything left over is waited for in order.
+static void wait_stages_as_they_finish(pid_t pgid, const pid_t *pids, int count, int *statuses, StageTimes *times) {
+    int remaining = 0;
+    for (int i = 0; i < count; i++) {
+        if (pids[i] > 0) remaining++;
+    }
+
+    while (remaining > 0) {
+        siginfo_t info;
+        info.si_pid = 0;
+        // WNOWAIT only peeks, so a child that is not ours stays unreaped
+        int flags = WEXITED | WNOWAIT | (job_control ? WSTOPPED : 0);
+        if (waitid(pgid > 0 ? P_PGID : P_ALL, pgid > 0 ? (id_t)pgid : 0, &info, flags) == -1) {
+            if (errno == EINTR) continue;
+            return;
+        }
+
+        int index = -1;
+        for (int i = 0; i < count; i++) {
+            if (pids[i] == info.si_pid && statuses[i] == -1) index = i;
+        }
+        // a background job finished first: leave it for jobs_reap
+        if (index < 0) return;
+
+        int status;
+        if (wait_stage(pids[index], &status, &times[index])) {
+            statuses[index] = status;
+        } else {
+            statuses[index] = 0;
+        }
+        remaining--;
+    }
+}
+
+int job_wait_foreground(pid_t pgid, const pid_t *pids, int count, int *statuses, StageTimes *times,
+                        const char *command) {
+    int last = 0;
+    bool stopped = false;
+
+    TRACE_BEGIN(start);
+    for (int i = 0; i < count; i++) {
+        statuses[i] = -1;
+    }
+    if (times != NULL) {
+        wait_stages_as_they_finish(pgid, pids, count, statuses, times);
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (pids[i] <= 0) continue;
+
+        int status = statuses[i];
+        if (status == -1) {
+            if (!wait_stage(pids[i], &status, times != NULL ? &times[i] : NULL)) continue;
+            statuses[i] = status;
+        }
+
+        if (WIFSTOPPED(status)) {
+            stopped = true;
+            last = 128 + WSTOPSIG(status);
+        } else if (!stopped) {
+            last = exit_status_from_wait(status);
+        }
+    }
+    TRACE_END(TRACE_WAIT, start);
+
+    take_terminal();
+
+    // the terminal echoed ^C without a newline
+    if (job_control && last == 128 + SIGINT) {
+        printf("\n");
+    }
+
+    // Ctrl+Z: the pipeline lives on as a stopped job
+    if (stopped) {
+        Job *job = new_job(pgid, pids, statuses, count, command);
+        if (job != NULL) {
+            insert_job(job);
+            job->state = JOB_STOPPED;
+            job->reported = true;
+            printf("\n");
+            print_job(STDOUT_FILENO, job);
+            outbuf_flush();
+        }
+    }
+
+    return last;
+}
+
+int job_add_background(pid_t pgid, const pid_t *pids, int count, const char *command) {
+    Job *job = new_job(pgid, pids, NULL, count, command);
+    if (job == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    insert_job(job);
+    job->reported = true;
+    // $! is the last process that started
+    for (int i = count - 1; i >= 0; i--) {
+        if (pids[i] > 0) {
+            shell.last_background = pids[i];
+            break;
+        }
+    }
+
+    if (shell.interactive) {
+        printf("[%d] %d\n", job->id, (int)shell.last_background);
+    }
+    return job->id;
+}
+
+void jobs_reap(void) {
+    for (Job *job = jobs; job != NULL; job = job->next) {
+        if (job->inherited) continue;
+        for (int i = 0; i < job->count; i++) {
+            JobProcess *proc = &job->procs[i];
+            if (proc->done) continue;
+
+            int status;
+            int flags = WNOHANG | (job_control ? WUNTRACED | WCONTINUED : 0);
+            pid_t result = waitpid(proc->pid, &status, flags);
+            if (result == proc->pid) {
+                update_process(job, proc, status);
+            } else if (result == -1 && errno == ECHILD) {
+                update_process(job, proc, 0);
+            }
+        }
+    }
+}
+
+bool jobs_changed(void) {
+    for (Job *job = jobs; job != NULL; job = job->next) {
+        if (!job->reported) return true;
+    }
+    return false;
+}
+
+void jobs_notify(void) {
+    Job *job = jobs;
+    while (job != NULL) {
+        Job *next = job->next;
+        if (!job->reported) {
+            if (shell.interactive) {
+                print_job(STDOUT_FILENO, job);
+            }
+            job->reported = true;
+        }
+        if (job->state == JOB_DONE) {
+            remove_job(job);
+        }
+        job = next;
+    }
+    outbuf_flush();
+}
+
+int jobs_poll_fds(struct pollfd *fds, int max, bool *need_timeout) {
+    int count = 0;
+    *need_timeout = false;
+
+    for (Job *job = jobs; job != NULL; job = job->next) {
+        if (job->inherited) continue;
+        for (int i = 0; i < job->count; i++) {
+            JobProcess *proc = &job->procs[i];
+            if (proc->done) continue;
+            if (proc->pidfd < 0 || count == max) {
+                *need_timeout = true;
+                continue;
+            }
+            fds[count].fd = proc->pidfd;
+            fds[count].events = POLLIN;
+            fds[count].revents = 0;
+            count++;
+        }
+    }
+    return count;
+}
+
+int jobs_count(void) {
+    int count = 0;
+    for (Job *job = jobs; job != NULL; job = job->next) {
+        count++;
+    }
+    return count;
+}
+
+// Find a job from a job spec: %n, %+, %%, %-, %prefix or a process id
+static Job *find_job(const char *spec) {
+    Job *current = NULL;
+    Job *previous = NULL;
+    for (Job *job = jobs; job != NULL; job = job->next) {
+        char marker = job_marker(job);
+        if (marker == '+') current = job;
+        if (marker == '-') previous = job;
+    }
+
+    if (spec == NULL || strcmp(spec, "%+") == 0 || strcmp(spec, "%%") == 0 || strcmp(spec, "%") == 0) {
+        return current;
+    }
+    if (strcmp(spec, "%-") == 0) {
+        return previous;
+    }
+
+    if (spec[0] == '%') {
+        char *end;
+        long id = strtol(spec + 1, &end, 10);
+        for (Job *job = jobs; job != NULL; job = job->next) {
+            if (*end == '\0' && end != spec + 1) {
+                if (job->id == id) return job;
+            } else if (strncmp(job->command, spec + 1, strlen(spec + 1)) == 0) {
+                return job;
+            }
+        }
+        return NULL;
+    }
+
+    char *end;
+    long pid = strtol(spec, &end, 10);
+    if (*end != '\0' || end == spec) return NULL;
+    for (Job *job = jobs; job != NULL; job = job->next) {
+        for (int i = 0; i < job->count; i++) {
+            if (job->procs[i].pid == pid) return job;
+        }
+    }
+    return NULL;
+}
+
+int handle_jobs(char **argv, const BuiltinIO *io) {
+    jobs_reap();
+
+    if (argv[1] != NULL) {
+        int status = 0;
+        for (int i = 1; argv[i] != NULL; i++) {
+            Job *job = find_job(argv[i]);
+            if (job == NULL) {
+                outbuf_printf(io->err, "jobs: %s: no such job\n", argv[i]);
+                status = 1;
+                continue;
+            }
+            print_job(io->out, job);
+            job->reported = true;
+        }
+        return status;
+    }
+
+    for (Job *job = jobs; job != NULL; job = job->next) {
+        print_job(io->out, job);
+        job->reported = true;
+    }
+
+    // finished jobs have been shown now
+    Job *job = jobs;
+    while (job != NULL) {
+        Job *next = job->next;
+        if (job->state == JOB_DONE) remove_job(job);
+        job = next;
+    }
+    return 0;
+}
+
+// send SIGCONT to the job's process group, or to each process without one
+static void continue_job(Job *job) {
+    if (job->pgid > 0) {
+        kill(-job->pgid, SIGCONT);
+        return;
+    }
+    for (int i = 0; i < job->count; i++) {
+        if (!job->procs[i].done) kill(job->procs[i].pid, SIGCONT);
+    }
+}
+
+int handle_fg(char **argv, const BuiltinIO *io) {
+    if (!job_control) {
+        outbuf_printf(io->err, "fg: no job control\n");
+        return 1;
+    }
+
+    jobs_reap();
+    Job *job = find_job(argv[1]);
+    if (job == NULL) {
+        outbuf_printf(io->err, "fg: %s: no such job\n", argv[1] != NULL ? argv[1] : "current");
+        return 1;
+    }
+
+    outbuf_printf(io->out, "%s\n", job->command);
+    outbuf_flush();
+    job_give_terminal(job->pgid);
+    continue_job(job);
+    wait_job(job);
+
+    if (job->state == JOB_STOPPED) {
+        job->seq = ++job_seq;
+        job->reported = true;
+        printf("\n");
+        print_job(STDOUT_FILENO, job);
+        return 128 + SIGTSTP;
+    }
+
+    int status = job_status(job);
+    if (status == 128 + SIGINT) {
+        printf("\n");
+    }
+    remove_job(job);
+    return status;
+}
+
+int handle_bg(char **argv, const BuiltinIO *io) {
+    if (!job_control) {
+        outbuf_printf(io->err, "bg: no job control\n");
+        return 1;
+    }
+
+    jobs_reap();
+    Job *job = find_job(argv[1]);
+    if (job == NULL) {
+        outbuf_printf(io->err, "bg: %s: no such job\n", argv[1] != NULL ? argv[1] : "current");
+        return 1;
+    }
+    if (job->state != JOB_STOPPED) {
+        outbuf_printf(io->err, "bg: job %d already in background\n", job->id);
+        return 0;
+    }
+
+    continue_job(job);
+    job->state = JOB_RUNNING;
+    job->reported = true;
+    outbuf_printf(io->out, "[%d]%c %s &\n", job->id, job_marker(job), job->command);
+    return 0;
+}
+
+// block until every process of a job has exited. Ctrl+C reaches only the
+// shell, not the job in its own group: then this returns false early and
+// the job stays as it is.
+static bool wait_for_exit(Job *job) {
+    for (int i = 0; i < job->count; i++) {
+        JobProcess *proc = &job->procs[i];
+        while (!proc->done) {
+            if (shell_interrupted) return false;
+            int status;
+            pid_t result = waitpid(proc->pid, &status, 0);
+            if (result == -1) {
+                if (errno == EINTR) continue;
+                update_process(job, proc, 0);
+                break;
+            }
+            update_process(job, proc, status);
+        }
+    }
+    return true;
+}
+
+int handle_wait(char **argv, const BuiltinIO *io) {
+    if (argv[1] == NULL) {
+        // wait for every job; their completion needs no further report
+        Job *job = jobs;
+        while (job != NULL) {
+            Job *next = job->next;
+            if (!job->inherited) {
+                if (!wait_for_exit(job)) return 128 + SIGINT;
+                remove_job(job);
+            }
+            job = next;
+        }
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; argv[i] != NULL; i++) {
+        // a subshell cannot wait for its parent's children
+        Job *job = find_job(argv[i]);
+        if (job == NULL || job->inherited) {
+            outbuf_printf(io->err, "wait: %s: no such job\n", argv[i]);
+            status = 127;
+            continue;
+        }
+        if (!wait_for_exit(job)) return 128 + SIGINT;
+        status = job_status(job);
+        remove_job(job);
+    }
+    return status;
+}
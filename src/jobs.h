@@ -0,0 +1,60 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "common.h"
+#include "timing.h"
+#include <poll.h>
+
+// Set up job control for an interactive shell: put the shell in its own
+// process group, take the terminal and ignore the job control signals
+void jobs_init(void);
+
+// In a forked subshell: keep the parent's jobs only to list them, and run
+// without job control
+void jobs_subshell(void);
+
+// Whether new jobs get their own process group and the terminal
+bool job_control_enabled(void);
+
+// Process group a new pipeline should join: 0 to start a new one, -1 when
+// job control is off and children stay in the shell's group
+pid_t job_new_pgid(void);
+
+// Hand the terminal to a foreground process group
+void job_give_terminal(pid_t pgid);
+
+// Wait for the processes of a foreground pipeline and take the terminal
+// back. statuses[i] receives each process's wait status (-1 for pids that
+// are <= 0). If times is not NULL, times[i] receives each process's rusage
+// and end time. If the pipeline is stopped it becomes a job in the table.
+// Returns the shell exit status of the last process.
+int job_wait_foreground(pid_t pgid, const pid_t *pids, int count, int *statuses, StageTimes *times,
+                        const char *command);
+
+// Register a pipeline started in the background; prints "[n] pid" when
+// interactive. Returns the job number.
+int job_add_background(pid_t pgid, const pid_t *pids, int count, const char *command);
+
+// Reap finished background processes without blocking
+void jobs_reap(void);
+
+// Whether some job changed state since it was last reported
+bool jobs_changed(void);
+
+// Report and forget jobs that finished since the last call
+void jobs_notify(void);
+
+// Fill fds with one pidfd per running background process to poll on.
+// Returns how many were stored; *need_timeout is set when some process
+// has no pidfd and has to be checked periodically instead.
+int jobs_poll_fds(struct pollfd *fds, int max, bool *need_timeout);
+
+// Number of jobs in the table
+int jobs_count(void);
+
+int handle_jobs(char **argv, const BuiltinIO *io);
+int handle_fg(char **argv, const BuiltinIO *io);
+int handle_bg(char **argv, const BuiltinIO *io);
+int handle_wait(char **argv, const BuiltinIO *io);
+
+#endif
@@ -0,0 +1,352 @@
+#include "lexer.h"
+
+// characters that end an unquoted word
+static bool is_operator_char(char c) {
+    return c == '|' || c == ';' || c == '>' || c == '<' || c == '(' || c == ')';
+}
+
+bool lexer_init(Lexer *lexer, Arena *arena, const char *input) {
+    lexer->input = input;
+    lexer->len = strlen(input);
+    lexer->pos = 0;
+    lexer->heredoc_end = 0;
+    lexer->incomplete = false;
+    // a word and its terminator never take more than twice the room of the
+    // input they were read from: "$a" becomes mark, name and end mark, and a
+    // marker byte in the input gets an escape in front of it
+    lexer->out = arena_alloc(arena, 2 * lexer->len + 1);
+    return lexer->out != NULL;
+}
+
+static Token make_token(TokenType type, const char *text) {
+    Token token = {type, (char *)text, 0, 0, REDIRECT_OUTPUT, false, false, false, 0, 0};
+    return token;
+}
+
+static bool is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// Write the expansion mark for the "$" at pos, returning the input
+// characters it used, or 0 if the "$" is an ordinary character
+static size_t lex_expansion(const Lexer *lexer, size_t pos, char *out, size_t *length, bool in_double_quote) {
+    const char *input = lexer->input + pos + 1;
+    size_t avail = lexer->len - pos - 1;
+    size_t name_start = 0;
+    size_t name_len = 0;
+    size_t used;
+
+    if (avail > 0 && (input[0] == '?' || input[0] == '$' || input[0] == '!')) {
+        name_len = 1;
+        used = 2;
+    } else if (avail > 0 && input[0] == '{') {
+        name_start = 1;
+        while (name_start + name_len < avail && is_name_char(input[name_start + name_len])) {
+            name_len++;
+        }
+        if (name_start + name_len >= avail || input[name_start + name_len] != '}') {
+            return 0;
+        }
+        used = name_len + 3;
+    } else {
+        while (name_len < avail && is_name_char(input[name_len])) {
+            name_len++;
+        }
+        used = name_len + 1;
+    }
+    if (name_len == 0 || isdigit((unsigned char)input[name_start])) {
+        return 0;
+    }
+
+    out[(*length)++] = in_double_quote ? WORD_EXPAND_QUOTED : WORD_EXPAND;
+    memcpy(out + *length, input + name_start, name_len);
+    *length += name_len;
+    out[(*length)++] = WORD_EXPAND_END;
+    return used;
+}
+
+static bool is_glob_char(char c) {
+    return c == '*' || c == '?' || c == '[';
+}
+
+// Copy a character into word text. Marker bytes, and pattern characters
+// that were quoted, are escaped so they are taken literally; an unquoted
+// pattern character makes the word one to expand into file names.
+static void put_literal(char *word, size_t *length, char c, bool quoted, bool *expand) {
+    if ((c >= WORD_EXPAND && c <= WORD_ESCAPE) || (quoted && is_glob_char(c))) {
+        word[(*length)++] = WORD_ESCAPE;
+        *expand = true;
+    } else if (is_glob_char(c)) {
+        *expand = true;
+    }
+    word[(*length)++] = c;
+}
+
+// read a word, removing quotes and escapes
+static Token lex_word(Lexer *lexer) {
+    const char *input = lexer->input;
+    char *word = lexer->out;
+    size_t length = 0;
+    int in_single_quote = 0;
+    int in_double_quote = 0;
+    bool quoted = false;
+    bool expand = false;
+    bool assignment = false;
+    bool name_so_far = true;    // only unquoted name characters read yet
+
+    while (lexer->pos < lexer->len) {
+        char c = input[lexer->pos];
+
+        if (!in_single_quote && !in_double_quote &&
+            (c == ' ' || c == '\t' || c == '\n' || is_operator_char(c))) {
+            break;
+        }
+        if (!in_single_quote && !in_double_quote && c == '&') {
+            break;
+        }
+
+        if (c == '\\' || c == '\'' || c == '"') {
+            quoted = true;
+        }
+        if (name_so_far && !assignment) {
+            if (c == '=' && length > 0 && !isdigit((unsigned char)word[0])) {
+                assignment = true;
+            } else if (!is_name_char(c)) {
+                name_so_far = false;
+            }
+        }
+
+        if (c == '$' && !in_single_quote) {
+            size_t used = lex_expansion(lexer, lexer->pos, word, &length, in_double_quote);
+            if (used > 0) {
+                expand = true;
+                lexer->pos += used;
+                continue;
+            }
+        }
+
+        // handle escape character
+        if (c == '\\' && !in_single_quote) {
+            if (lexer->pos + 1 < lexer->len) {
+                char next_char = input[lexer->pos + 1];
+                if (next_char == '\n') {
+                    // line continuation, which may be the last thing typed
+                    lexer->pos += 2;
+                    if (lexer->pos == lexer->len) {
+                        lexer->incomplete = true;
+                    }
+                    continue;
+                }
+                if (in_double_quote) {
+                    if (next_char == '"' || next_char == '$' || next_char == '`' || next_char == '\\') {
+                        word[length++] = next_char;
+                        lexer->pos++;
+                    } else {
+                        word[length++] = c;
+                    }
+                } else {
+                    put_literal(word, &length, next_char, true, &expand);
+                    lexer->pos++;
+                }
+            } else {
+                // a backslash ending the input escapes the newline to come
+                lexer->incomplete = true;
+            }
+        } else if (c == '\'' && !in_double_quote) {
+            in_single_quote = !in_single_quote;
+        } else if (c == '"' && !in_single_quote) {
+            in_double_quote = !in_double_quote;
+        } else {
+            put_literal(word, &length, c, in_single_quote || in_double_quote, &expand);
+        }
+        lexer->pos++;
+    }
+
+    if (in_single_quote || in_double_quote) {
+        lexer->incomplete = true;
+    }
+
+    word[length] = '\0';
+    lexer->out += length + 1;
+    Token token = make_token(TOK_WORD, word);
+    token.quoted = quoted;
+    token.expand = expand;
+    token.assignment = assignment;
+    return token;
+}
+
+// scan the token starting at the current position
+static Token next_token(Lexer *lexer) {
+    const char *input = lexer->input;
+
+    if (lexer->pos >= lexer->len) {
+        return make_token(TOK_END, "newline");
+    }
+
+    char c = input[lexer->pos];
+    char next = lexer->pos + 1 < lexer->len ? input[lexer->pos + 1] : '\0';
+
+    if (c == '\n') {
+        // the here-document bodies read from the next lines are not commands
+        lexer->pos = lexer->heredoc_end > lexer->pos ? lexer->heredoc_end : lexer->pos + 1;
+        lexer->heredoc_end = 0;
+        return make_token(TOK_NEWLINE, "newline");
+    }
+    if (c == ';') {
+        if (next == ';') {
+            lexer->pos += 2;
+            return make_token(TOK_DSEMI, ";;");
+        }
+        lexer->pos++;
+        return make_token(TOK_SEMI, ";");
+    }
+    if (c == '(' || c == ')') {
+        lexer->pos++;
+        return make_token(c == '(' ? TOK_LPAREN : TOK_RPAREN, c == '(' ? "(" : ")");
+    }
+    if (c == '|') {
+        if (next == '|') {
+            lexer->pos += 2;
+            return make_token(TOK_OR_IF, "||");
+        }
+        lexer->pos++;
+        return make_token(TOK_PIPE, "|");
+    }
+    if (c == '&') {
+        if (next == '&') {
+            lexer->pos += 2;
+            return make_token(TOK_AND_IF, "&&");
+        }
+        if (next == '>') {
+            // &> and &>>: stdout and stderr to the same file
+            bool append = lexer->pos + 2 < lexer->len && input[lexer->pos + 2] == '>';
+            Token token = make_token(TOK_REDIRECT, append ? "&>>" : "&>");
+            token.fd = 1;
+            token.append = append;
+            lexer->pos += append ? 3 : 2;
+            return token;
+        }
+        lexer->pos++;
+        return make_token(TOK_AMP, "&");
+    }
+
+    // redirection, optionally prefixed by the descriptor it redirects
+    size_t op = lexer->pos;
+    int fd = -1;
+    if (isdigit((unsigned char)c) && (next == '<' || next == '>')) {
+        fd = c - '0';
+        op++;
+    }
+    if (input[op] == '<' || input[op] == '>') {
+        char after = op + 1 < lexer->len ? input[op + 1] : '\0';
+        Token token = make_token(TOK_REDIRECT, input[op] == '<' ? "<" : ">");
+        token.kind = input[op] == '<' ? REDIRECT_INPUT : REDIRECT_OUTPUT;
+        token.fd = fd >= 0 ? fd : input[op] == '<' ? 0 : 1;
+
+        if (input[op] == '<' && after == '<') {
+            char third = op + 2 < lexer->len ? input[op + 2] : '\0';
+            if (third == '<') {
+                token.text = "<<<";
+                token.kind = REDIRECT_HERESTRING;
+            } else {
+                token.text = third == '-' ? "<<-" : "<<";
+                token.kind = REDIRECT_HEREDOC;
+            }
+        } else if (after == '&') {
+            // the word after says which descriptor to copy, or - to close
+            token.text = input[op] == '<' ? "<&" : ">&";
+            token.kind = REDIRECT_DUP;
+        } else if (input[op] == '>' && after == '>') {
+            token.text = ">>";
+            token.append = 1;
+        }
+        lexer->pos = op + strlen(token.text);
+        return token;
+    }
+
+    return lex_word(lexer);
+}
+
+char *lexer_heredoc(Lexer *lexer, const Token *delimiter, bool strip_tabs) {
+    const char *input = lexer->input;
+    size_t pos = lexer->heredoc_end;
+    if (pos == 0) {
+        const char *newline = memchr(input + lexer->pos, '\n', lexer->len - lexer->pos);
+        if (newline == NULL) {
+            lexer->incomplete = true;
+            return NULL;
+        }
+        pos = newline - input + 1;
+    }
+
+    // with a quoted delimiter the body is taken as it is
+    bool expand = !delimiter->quoted;
+    bool escaped = false;
+    size_t delimiter_len = strlen(delimiter->text);
+    char *body = lexer->out;
+    size_t length = 0;
+
+    while (1) {
+        if (pos >= lexer->len) {
+            lexer->incomplete = true;
+            return NULL;
+        }
+        if (strip_tabs) {
+            while (pos < lexer->len && input[pos] == '\t') pos++;
+        }
+        const char *newline = memchr(input + pos, '\n', lexer->len - pos);
+        size_t line_end = newline != NULL ? (size_t)(newline - input) : lexer->len;
+
+        if (line_end - pos == delimiter_len && memcmp(input + pos, delimiter->text, delimiter_len) == 0) {
+            lexer->heredoc_end = newline != NULL ? line_end + 1 : line_end;
+            break;
+        }
+
+        for (; pos < line_end; pos++) {
+            char c = input[pos];
+            if (expand && c == '\\' && pos + 1 < line_end &&
+                (input[pos + 1] == '$' || input[pos + 1] == '`' || input[pos + 1] == '\\')) {
+                put_literal(body, &length, input[++pos], false, &escaped);
+                continue;
+            }
+            if (expand && c == '$') {
+                size_t used = lex_expansion(lexer, pos, body, &length, true);
+                if (used > 0) {
+                    pos += used - 1;
+                    continue;
+                }
+            }
+            put_literal(body, &length, c, false, &escaped);
+        }
+        body[length++] = '\n';
+        pos = line_end + 1;
+    }
+
+    body[length] = '\0';
+    lexer->out += length + 1;
+    return body;
+}
+
+Token lexer_next(Lexer *lexer) {
+    const char *input = lexer->input;
+
+    while (lexer->pos < lexer->len) {
+        char c = input[lexer->pos];
+        if (c == ' ' || c == '\t') {
+            lexer->pos++;
+        } else if (c == '#') {
+            // a comment runs to the end of the line
+            while (lexer->pos < lexer->len && input[lexer->pos] != '\n') {
+                lexer->pos++;
+            }
+        } else {
+            break;
+        }
+    }
+
+    size_t start = lexer->pos;
+    Token token = next_token(lexer);
+    token.start = start;
+    token.end = lexer->pos;
+    return token;
+}
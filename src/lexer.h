@@ -0,0 +1,66 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include "common.h"
+#include "arena.h"
+
+typedef enum {
+    TOK_WORD,       // a word with quotes and escapes already removed
+    TOK_PIPE,       // |
+    TOK_AND_IF,     // &&
+    TOK_OR_IF,      // ||
+    TOK_SEMI,       // ;
+    TOK_DSEMI,      // ;; ending a case item
+    TOK_LPAREN,     // ( before a case pattern
+    TOK_RPAREN,     // ) after case patterns
+    TOK_AMP,        // & ending a background command
+    TOK_NEWLINE,    // end of a line inside the input
+    TOK_REDIRECT,   // [N]>, [N]>>, [N]<, <<, <<-, <<<, [N]>&M, [N]<&-, &>, &>> ...
+    TOK_END,        // end of input
+    TOK_ERROR       // a character sequence the shell does not understand
+} TokenType;
+
+// Bytes marking expansions inside word text. "$NAME", "${NAME}", "$?", "$$"
+// and "$!" become a mark, the name and WORD_EXPAND_END; the expansion is done
+// when the command runs. A marker byte typed in the input itself, or a
+// quoted *, ? or [, is written after WORD_ESCAPE so it is taken literally.
+#define WORD_EXPAND         '\x01'    // unquoted: the value is split into fields
+#define WORD_EXPAND_QUOTED  '\x02'    // inside double quotes: the value stays one field
+#define WORD_EXPAND_END     '\x03'
+#define WORD_ESCAPE         '\x04'    // the next byte is literal
+
+typedef struct {
+    TokenType type;
+    char *text;     // word text, or the operator as written for error messages
+    int fd;         // TOK_REDIRECT: descriptor being redirected
+    int append;     // TOK_REDIRECT: 1 for >> and &>>, 0 otherwise
+    RedirectKind kind;  // TOK_REDIRECT: what the operator redirects from or to
+    bool quoted;    // TOK_WORD: some part was quoted or escaped
+    bool expand;    // TOK_WORD: the text holds expansion marks, escapes or patterns
+    bool assignment;    // TOK_WORD: NAME=value with the name unquoted
+    size_t start;   // offsets of the token in the input
+    size_t end;
+} Token;
+
+// Single-pass scanner over one command line. Word text is written into one
+// arena buffer sized from the input, so lexing never allocates per token.
+typedef struct {
+    const char *input;
+    size_t len;
+    size_t pos;
+    char *out;      // where the next word's text is written
+    size_t heredoc_end; // where the line after the here-document bodies read so far starts, 0 if none
+    bool incomplete;    // the input ended inside a quote, escape or here-document
+} Lexer;
+
+bool lexer_init(Lexer *lexer, Arena *arena, const char *input);
+Token lexer_next(Lexer *lexer);
+
+// Read the body of a here-document ended by a line holding just delimiter.
+// Bodies start on the line after the current one, one after the other, and
+// are skipped when the lexer reaches that line. Unless the delimiter was
+// quoted, expansions in the body are marked like those in words. Returns
+// NULL and sets incomplete if the input ends before the delimiter.
+char *lexer_heredoc(Lexer *lexer, const Token *delimiter, bool strip_tabs);
+
+#endif
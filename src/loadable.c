@@ -0,0 +1,146 @@
+#include "loadable.h"
+#include "outbuf.h"
+#include "builtins.h"
+#include <dlfcn.h>
+
+// The symbol a library exports for a builtin: the name with characters
+// other than letters and digits as '_', then "_builtin"
+static void symbol_name(const char *name, char *symbol, size_t size) {
+    size_t used = 0;
+    for (const char *p = name; *p != '\0' && used + 1 < size; p++) {
+        symbol[used++] = isalnum((unsigned char)*p) ? *p : '_';
+    }
+    snprintf(symbol + used, size - used, "_builtin");
+}
+
+static void unload(Builtin *builtin) {
+    dlclose(builtin->library);
+    free((char *)builtin->name);
+    free(builtin);
+}
+
+static int load_builtin(const char *library, const char *name, const BuiltinIO *io) {
+    // RTLD_LOCAL: two plugins may use the same names for their own symbols
+    void *handle = dlopen(library, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        outbuf_printf(io->err, "enable: %s\n", dlerror());
+        return 1;
+    }
+
+    char symbol[256];
+    symbol_name(name, symbol, sizeof(symbol));
+    const shell_builtin *definition = dlsym(handle, symbol);
+    const char *problem = NULL;
+    if (definition == NULL) {
+        problem = "no such builtin in the library";
+    } else if (definition->abi_version != SHELL_BUILTIN_ABI_VERSION) {
+        problem = "built for another version of the shell";
+    } else if (definition->run == NULL || definition->name == NULL || definition->name[0] == '\0') {
+        problem = "incomplete builtin definition";
+    }
+    if (problem != NULL) {
+        outbuf_printf(io->err, "enable: %s: %s: %s\n", library, name, problem);
+        dlclose(handle);
+        return 1;
+    }
+
+    Builtin *builtin = calloc(1, sizeof(Builtin));
+    char *builtin_name = strdup(definition->name);
+    if (builtin == NULL || builtin_name == NULL) {
+        free(builtin);
+        free(builtin_name);
+        dlclose(handle);
+        outbuf_printf(io->err, "enable: %s: out of memory\n", name);
+        return 1;
+    }
+    builtin->name = builtin_name;
+    builtin->handler = definition->run;
+    builtin->flags = definition->flags & BUILTIN_SUBSHELL;
+    builtin->library = handle;
+
+    Builtin *replaced;
+    if (!builtin_add(builtin, &replaced)) {
+        outbuf_printf(io->err, "enable: %s: is a shell builtin\n", builtin->name);
+        unload(builtin);
+        return 1;
+    }
+    if (replaced != NULL) {
+        unload(replaced);
+    }
+    return 0;
+}
+
+static void count_builtin(const Builtin *builtin, void *data) {
+    (void)builtin;
+    (*(int *)data)++;
+}
+
+typedef struct {
+    const Builtin **list;
+    int count;
+} BuiltinList;
+
+static void add_builtin(const Builtin *builtin, void *data) {
+    BuiltinList *list = data;
+    list->list[list->count++] = builtin;
+}
+
+static int compare_builtins(const void *a, const void *b) {
+    return strcmp((*(const Builtin *const *)a)->name, (*(const Builtin *const *)b)->name);
+}
+
+// Every builtin, sorted, the loaded ones with the library they came from
+static int list_builtins(const BuiltinIO *io) {
+    int total = 0;
+    builtin_foreach(count_builtin, &total);
+    BuiltinList list = {malloc(total * sizeof(Builtin *)), 0};
+    if (list.list == NULL) return 1;
+    builtin_foreach(add_builtin, &list);
+    qsort(list.list, list.count, sizeof(Builtin *), compare_builtins);
+
+    for (int i = 0; i < list.count; i++) {
+        const Builtin *builtin = list.list[i];
+        Dl_info info;
+        if (builtin->library != NULL && dladdr((void *)builtin->handler, &info) != 0 && info.dli_fname != NULL) {
+            outbuf_printf(io->out, "enable -f %s %s\n", info.dli_fname, builtin->name);
+        } else {
+            outbuf_printf(io->out, "enable %s\n", builtin->name);
+        }
+    }
+    free(list.list);
+    return 0;
+}
+
+int handle_enable(char **argv, const BuiltinIO *io) {
+    if (argv[1] == NULL) {
+        return list_builtins(io);
+    }
+
+    int status = 0;
+    if (strcmp(argv[1], "-f") == 0) {
+        if (argv[2] == NULL || argv[3] == NULL) {
+            outbuf_printf(io->err, "enable: usage: enable -f library name...\n");
+            return 2;
+        }
+        for (int i = 3; argv[i] != NULL; i++) {
+            if (load_builtin(argv[2], argv[i], io) != 0) status = 1;
+        }
+        return status;
+    }
+
+    if (strcmp(argv[1], "-d") == 0) {
+        for (int i = 2; argv[i] != NULL; i++) {
+            Builtin *builtin = builtin_remove(argv[i]);
+            if (builtin == NULL) {
+                outbuf_printf(io->err, "enable: %s: not a dynamically loaded builtin\n", argv[i]);
+                status = 1;
+                continue;
+            }
+            unload(builtin);
+        }
+        return status;
+    }
+
+    outbuf_printf(io->err, "enable: usage: enable [-f library name... | -d name...]\n");
+    return 2;
+}
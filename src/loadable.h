@@ -0,0 +1,11 @@
+#ifndef LOADABLE_H
+#define LOADABLE_H
+
+#include "common.h"
+
+// "enable" lists the builtins, "enable -f library name..." loads builtins
+// from a shared library (see shell_builtin.h), "enable -d name..." unloads
+// them again
+int handle_enable(char **argv, const BuiltinIO *io);
+
+#endif
@@ -1,79 +1,342 @@
 #include "common.h"
 #include "parser.h"
-#include "builtins.h"
-#include "executor.h"
+#include "history.h"
 #include "completion.h"
-#include "pipeline.h"
+#include "eval.h"
+#include "shell.h"
+#include "arena.h"
+#include "jobs.h"
+#include "trace.h"
+#include "vars.h"
+#include "plancache.h"
+#include "prompt.h"
+#include "workdir.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
 #include <readline/readline.h>
-#include <readline/history.h>
 
-int main(int argc, char *argv[]) {
-    // disable output buffering for stdout
-    setbuf(stdout, NULL);
-    
+// size of the stdio buffer used when reading commands without readline
+#define BATCH_BUFFER_SIZE (64 * 1024)
+
+// background processes watched through pidfds while at the prompt
+#define MAX_POLLED_JOBS 64
+
+// how often jobs without a pidfd are checked while at the prompt, in ms
+#define JOB_CHECK_INTERVAL 1000
+
+// what running a line gives when the command goes on past its end
+#define STATUS_INCOMPLETE -1
+
+// memory for the command line being executed, reset after every line
+static Arena line_arena;
+
+// lines of a command that is not complete yet, joined by newlines
+static char *pending = NULL;
+static size_t pending_len = 0;
+
+// Add a line to the command being collected and return the whole of it
+static const char *pending_add(const char *line) {
+    size_t len = strlen(line);
+    char *grown = realloc(pending, pending_len + len + 2);
+    if (grown == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+    pending = grown;
+    if (pending_len > 0) {
+        pending[pending_len++] = '\n';
+    }
+    memcpy(pending + pending_len, line, len + 1);
+    pending_len += len;
+    return pending;
+}
+
+static void pending_clear(void) {
+    free(pending);
+    pending = NULL;
+    pending_len = 0;
+}
+
+// Run one line of input and return its exit status, or STATUS_INCOMPLETE
+// without running anything if the line needs more lines after it. A line
+// that parses, even into a syntax error, is added to the history if asked.
+static int execute_line(const char *line, bool record) {
+    // a line run before skips the lexer and parser altogether
+    const CommandList *plan = plan_lookup(line);
+    if (plan != NULL) {
+        if (record) {
+            history_record(line);
+        }
+        return execute_list(&line_arena, plan);
+    }
+
+    CommandList list;
+    TRACE_BEGIN(start);
+    bool parsed = parse_command_line(&line_arena, line, &list);
+    TRACE_END(TRACE_PARSE, start);
+    if (list.incomplete) {
+        return STATUS_INCOMPLETE;
+    }
+    if (record) {
+        history_record(line);
+    }
+    if (!parsed) {
+        // syntax error
+        return 2;
+    }
+
+    plan = plan_store(line, &list);
+    return execute_list(&line_arena, plan != NULL ? plan : &list);
+}
+
+static int run_line(const char *line, bool record) {
+    shell_interrupted = 0;
+    TRACE_BEGIN(start);
+    int status = execute_line(line, record);
+    TRACE_END(TRACE_LINE, start);
+    // Ctrl+C caught by the shell itself, in a loop of builtins: the line
+    // stops as if its command had been killed
+    if (shell_interrupted && status != 128 + SIGINT && status != STATUS_INCOMPLETE) {
+        status = 128 + SIGINT;
+        if (shell.interactive) printf("\n");
+    }
+    arena_reset(&line_arena);
+    // forget background jobs that finished, reporting them when interactive
+    jobs_reap();
+    jobs_notify();
+    return status;
+}
+
+// Run every line of a stream without readline, history or completion.
+// When shared, the commands read the same descriptor as the shell (stdin)
+// and must find their input right after the line that runs them: a file
+// is seeked back to that point before each line, anything else is read a
+// byte at a time so the shell never takes more than one line.
+static int run_stream(FILE *input, bool shared) {
+    int fd = fileno(input);
+    bool seekable = lseek(fd, 0, SEEK_CUR) != -1;
+    if (shared && !seekable) {
+        setvbuf(input, NULL, _IONBF, 0);
+    } else {
+        setvbuf(input, NULL, _IOFBF, BATCH_BUFFER_SIZE);
+    }
+    bool resync = shared && seekable;
+
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+
+    while ((length = getline(&line, &capacity, input)) != -1) {
+        if (length > 0 && line[length - 1] == '\n') {
+            line[length - 1] = '\0';
+        }
+
+        // a command spread over several lines is parsed again as a whole
+        const char *command = pending != NULL ? pending_add(line) : line;
+        if (command == NULL) break;
+        if (resync) lseek(fd, ftello(input), SEEK_SET);
+        int status = run_line(command, false);
+        // pick up wherever the line's commands left off
+        if (resync) fseeko(input, lseek(fd, 0, SEEK_CUR), SEEK_SET);
+        if (status == STATUS_INCOMPLETE) {
+            if (pending == NULL) pending_add(line);
+            continue;
+        }
+        pending_clear();
+        shell.last_status = status;
+    }
+
+    if (pending != NULL) {
+        fprintf(stderr, "syntax error: unexpected end of file\n");
+        pending_clear();
+        shell.last_status = 2;
+    }
+    free(line);
+    return shell.last_status;
+}
+
+// Run a "-c" command string
+static int run_string(const char *commands) {
+    shell.last_status = run_line(commands, false);
+    if (shell.last_status == STATUS_INCOMPLETE) {
+        fprintf(stderr, "syntax error: unexpected end of file\n");
+        shell.last_status = 2;
+    }
+    return shell.last_status;
+}
+
+// line handed over by readline's callback interface
+static char *input_line;
+static bool input_ready;
+
+static void handle_sigint(int sig) {
+    (void)sig;
+    shell_interrupted = 1;
+}
+
+static void line_handler(char *line) {
+    input_line = line;
+    input_ready = true;
+    // stop reading from the terminal while the line runs
+    rl_callback_handler_remove();
+}
+
+// Ctrl+C at the prompt throws away the line being edited, and the lines
+// of the command it continued
+static void discard_line(void) {
+    printf("\n");
+    pending_clear();
+    rl_set_prompt(prompt_get(false));
+    rl_replace_line("", 0);
+    rl_on_new_line();
+    rl_redisplay();
+}
+
+// Report jobs that finished while the prompt was shown, then redraw it
+static void report_jobs(void) {
+    jobs_reap();
+    if (!jobs_changed()) return;
+    rl_clear_visible_line();
+    jobs_notify();
+    // the prompt may count the jobs
+    rl_set_prompt(prompt_get(pending != NULL));
+    rl_forced_update_display();
+}
+
+// Read commands from the terminal through readline. The prompt waits in
+// poll() on the terminal and on a pidfd per background process, so job
+// completion is reported as it happens instead of at the next line.
+static int run_interactive(void) {
+    shell.interactive = true;
+
+    jobs_init();
+
+    // SIGINT only interrupts poll(); readline must not install its own handlers
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_sigint;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    rl_catch_signals = 0;
+
     // set up tab completion
     setup_completion();
 
     // load history from HISTFILE on startup
-    char *histfile = getenv("HISTFILE");
-    if (histfile != NULL) {
-        FILE *file = fopen(histfile, "r");
-        if (file != NULL) {
-            char line[1024];
-            while (fgets(line, sizeof(line), file)) {
-                // remove trailing newline
-                line[strcspn(line, "\n")] = 0;
-                if (strlen(line) > 0) {
-                    add_history(line);
-                }
+    history_init();
+
+    prompt_init();
+    rl_callback_handler_install(prompt_get(false), line_handler);
+
+    while (1) {
+        struct pollfd fds[1 + MAX_POLLED_JOBS];
+        bool need_timeout;
+        fds[0].fd = STDIN_FILENO;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        int count = 1 + jobs_poll_fds(fds + 1, MAX_POLLED_JOBS, &need_timeout);
+
+        int ready = poll(fds, count, need_timeout ? JOB_CHECK_INTERVAL : -1);
+        if (ready == -1) {
+            if (errno != EINTR) {
+                perror("poll");
+                break;
+            }
+            if (shell_interrupted) {
+                shell_interrupted = 0;
+                discard_line();
             }
-            fclose(file);
+            continue;
         }
-    }
 
-    while (1) {
-        char *user_input = readline("$ ");
-        
-        if (user_input == NULL) {
-            // EOF (Ctrl+D): save history before exiting
-            save_history_to_file();
+        if (count > 1 || need_timeout) {
+            report_jobs();
+        }
+
+        if (fds[0].revents == 0) continue;
+        rl_callback_read_char();
+        if (!input_ready) continue;
+        input_ready = false;
+
+        if (input_line == NULL) {
+            if (pending != NULL) {
+                fprintf(stderr, "syntax error: unexpected end of file\n");
+                pending_clear();
+            }
+            // EOF (Ctrl+D): every command is already in HISTFILE
+            history_close();
             break;
         }
-        
-        // skip empty input
-        if (strlen(user_input) == 0) {
-            free(user_input);
-            continue;
+
+        // skip empty input, unless it is a line of a longer command
+        bool continue_line = false;
+        if (input_line[0] != '\0' || pending != NULL) {
+            const char *command = pending != NULL ? pending_add(input_line) : input_line;
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            int status = command != NULL ? run_line(command, true) : 1;
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            if (status == STATUS_INCOMPLETE) {
+                if (pending == NULL) pending_add(input_line);
+                continue_line = true;
+            } else {
+                pending_clear();
+                shell.last_status = status;
+                prompt_set_duration((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+            }
         }
+        free(input_line);
+        input_line = NULL;
 
-        // Add input to history
-        add_history(user_input);
+        rl_callback_handler_install(prompt_get(continue_line), line_handler);
+    }
 
-        // Check for pipeline first
-        if (has_pipeline(user_input)) {
-            execute_pipeline(user_input);
-            free(user_input);
-            continue;
-        }
+    return shell.last_status;
+}
 
-        Args args = parse_arguments(user_input);
-        
-        if (args.count == 0) {
-            free(user_input);
-            continue;
+int main(int argc, char *argv[]) {
+    // the shell's own messages go out unbuffered; builtins write through outbuf
+    setbuf(stdout, NULL);
+
+    // builtins write into pipes from the shell process; a reader that went
+    // away must show up as EPIPE, not kill the shell
+    signal(SIGPIPE, SIG_IGN);
+
+    trace_init();
+
+    // variables come from the environment; from here on the shell's store
+    // is what commands see
+    vars_init();
+    workdir_init();
+    shell.pid = getpid();
+
+    // "shell -c 'commands'"
+    if (argc >= 2 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "%s: -c: option requires an argument\n", argv[0]);
+            return 2;
         }
-        
-        cmd_handler_t handler = find_builtin_handler(args.args[0]);
-        
-        if (handler != NULL) {
-            execute_with_redirection(handler, (char **)args.args, &args.output_redirect);
-        } else {
-            handle_external_command((char **)args.args, &args.output_redirect);
+        return run_string(argv[2]);
+    }
+
+    // "shell script.sh"
+    if (argc >= 2) {
+        FILE *script = fopen(argv[1], "r");
+        if (script == NULL) {
+            perror(argv[1]);
+            return 127;
         }
-        
-        free_arguments(&args);
-        free(user_input);
+        int status = run_stream(script, false);
+        fclose(script);
+        return status;
+    }
+
+    // commands piped in on stdin
+    if (!isatty(STDIN_FILENO)) {
+        return run_stream(stdin, true);
     }
 
-    return 0;
+    return run_interactive();
 }
@@ -0,0 +1,135 @@
+#include "outbuf.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <sys/uio.h>
+
+// What one thread's builtin wrote and the kernel has not been given yet.
+// Pending output is always for a single descriptor: writing to another
+// flushes first, which keeps stdout and stderr in the order they were
+// written when both lead to the same place.
+typedef struct {
+    int fd;             // where the pending bytes go
+    size_t len;
+    int failed_fd;      // a descriptor a write failed on since the last flush, or -1
+    int error;          // the errno it failed with
+    char data[OUTBUF_SIZE];
+} OutBuf;
+
+// pipeline stages run builtins on threads of their own, each with its own buffer
+static _Thread_local OutBuf buffer = {.fd = -1, .failed_fd = -1};
+
+static int fail(OutBuf *b, int fd, int error) {
+    if (b->failed_fd < 0) {
+        b->failed_fd = fd;
+        b->error = error;
+    }
+    errno = error;
+    return -1;
+}
+
+// Write the count pieces at iov to fd in as few calls as the kernel allows
+static int write_vector(OutBuf *b, int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                // a descriptor someone left non-blocking: wait for the reader
+                struct pollfd pfd = {fd, POLLOUT, 0};
+                if (poll(&pfd, 1, -1) >= 0 || errno == EINTR) continue;
+            }
+            return fail(b, fd, errno);
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+static int flush_pending(OutBuf *b) {
+    if (b->len == 0) return 0;
+    struct iovec iov = {b->data, b->len};
+    b->len = 0;
+    return write_vector(b, b->fd, &iov, 1);
+}
+
+// Make the buffer hold fd's output, flushing another descriptor's
+static void switch_fd(OutBuf *b, int fd) {
+    if (b->len > 0 && b->fd != fd) {
+        // a failure is remembered for that descriptor; fd is still writable
+        flush_pending(b);
+    }
+    b->fd = fd;
+}
+
+int outbuf_write(int fd, const void *data, size_t len) {
+    OutBuf *b = &buffer;
+    if (fd == b->failed_fd) return fail(b, fd, b->error);
+    switch_fd(b, fd);
+
+    if (len <= OUTBUF_SIZE - b->len) {
+        memcpy(b->data + b->len, data, len);
+        b->len += len;
+        return 0;
+    }
+
+    // what is pending and what does not fit go out in one writev
+    struct iovec iov[2] = {{b->data, b->len}, {(void *)data, len}};
+    int first = b->len == 0 ? 1 : 0;
+    b->len = 0;
+    return write_vector(b, fd, iov + first, 2 - first);
+}
+
+int outbuf_printf(int fd, const char *format, ...) {
+    OutBuf *b = &buffer;
+    if (fd == b->failed_fd) return fail(b, fd, b->error);
+    switch_fd(b, fd);
+
+    // format straight into the free space; only a miss formats twice
+    va_list args, again;
+    va_start(args, format);
+    va_copy(again, args);
+    size_t room = OUTBUF_SIZE - b->len;
+    int n = vsnprintf(b->data + b->len, room, format, args);
+    va_end(args);
+
+    int status = n;
+    if (n < 0 || (size_t)n < room) {
+        if (n > 0) b->len += n;
+    } else if (n < OUTBUF_SIZE) {
+        if (flush_pending(b) < 0) {
+            status = -1;
+        } else {
+            vsnprintf(b->data, OUTBUF_SIZE, format, again);
+            b->len = n;
+        }
+    } else {
+        char *text = malloc((size_t)n + 1);
+        if (text == NULL) {
+            status = -1;
+        } else {
+            vsnprintf(text, (size_t)n + 1, format, again);
+            if (outbuf_write(fd, text, n) < 0) status = -1;
+            free(text);
+        }
+    }
+    va_end(again);
+    return status;
+}
+
+int outbuf_flush(void) {
+    OutBuf *b = &buffer;
+    flush_pending(b);
+    if (b->failed_fd < 0) return 0;
+    b->failed_fd = -1;
+    errno = b->error;
+    return -1;
+}
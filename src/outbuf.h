@@ -0,0 +1,29 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include "common.h"
+
+// Output of the shell's own builtins. Each thread keeps what its builtin
+// wrote in one buffer and hands it to the kernel in as few write(2) calls
+// as possible: when the buffer fills, when the builtin writes to another
+// descriptor, and when the builtin returns. Whoever runs a builtin calls
+// outbuf_flush afterwards, so nothing is pending between commands and a
+// fork never copies unwritten output into the child.
+
+#define OUTBUF_SIZE (64 * 1024)
+
+// Queue len bytes for fd. Returns 0, or -1 with errno set when writing to
+// fd failed; output for that descriptor is then dropped until the next
+// outbuf_flush.
+int outbuf_write(int fd, const void *data, size_t len);
+
+// Formatted like dprintf. Returns the number of bytes queued, or -1.
+int outbuf_printf(int fd, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Write out everything the calling thread has queued. Call it before the
+// builtin blocks on input or writes to a descriptor some other way.
+// Returns 0, or -1 with the errno of the first write that failed since
+// the last flush.
+int outbuf_flush(void);
+
+#endif
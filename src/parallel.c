@@ -0,0 +1,462 @@
+#include "parallel.h"
+#include "outbuf.h"
+#include "executor.h"
+#include "spawn.h"
+#include "shell.h"
+#include "copy.h"
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+
+// highest status, as GNU parallel: more failures than this still give 101
+#define PARALLEL_MAX_STATUS 101
+
+// with -k, jobs may run at most this many times -j ahead of the oldest one
+// whose output has not been written, which bounds the held output files
+#define PARALLEL_KEEP_WINDOW 4
+
+#define PARALLEL_READ_SIZE 4096
+
+typedef struct {
+    pid_t pid;          // 0 when the slot is free
+    int pidfd;          // readable once the job exits, -1 if unavailable
+    int output;         // -k: memfd holding the job's stdout, -1 otherwise
+    bool done;          // reaped, output not yet written
+    int status;
+    long seq;           // job number, from 1
+    char *input;
+} ParallelJob;
+
+typedef struct {
+    int fd;
+    char *buffer;
+    size_t start;
+    size_t length;
+    size_t capacity;
+    bool eof;
+} LineReader;
+
+typedef struct {
+    char **template;    // command words, NULL-terminated; empty to split inputs
+    bool has_placeholder;
+    const char *path;   // template[0] resolved once, when it has no "{}"
+    char **words;       // inputs after ":::", NULL when reading stdin
+    LineReader reader;
+    int child_in;       // stdin of every job
+    const BuiltinIO *io;
+    bool keep_order;
+    int jobs;           // at most this many running at once
+    ParallelJob *slots;
+    int slot_count;
+    int running;
+    long started;
+    long flushed;       // -k: jobs whose output has been written
+    int failed;
+    bool output_broken; // stdout went away, held output is dropped
+} Parallel;
+
+// Next line of input without its newline, malloc'd, or NULL at the end
+static char *read_line(LineReader *reader) {
+    for (;;) {
+        char *newline = memchr(reader->buffer + reader->start, '\n', reader->length - reader->start);
+        if (newline != NULL || (reader->eof && reader->start < reader->length)) {
+            size_t end = newline != NULL ? (size_t)(newline - reader->buffer) : reader->length;
+            char *line = strndup(reader->buffer + reader->start, end - reader->start);
+            reader->start = newline != NULL ? end + 1 : end;
+            return line;
+        }
+        if (reader->eof) return NULL;
+
+        // keep the partial line at the front and make room after it
+        memmove(reader->buffer, reader->buffer + reader->start, reader->length - reader->start);
+        reader->length -= reader->start;
+        reader->start = 0;
+        if (reader->capacity - reader->length < PARALLEL_READ_SIZE) {
+            size_t capacity = reader->capacity ? reader->capacity * 2 : PARALLEL_READ_SIZE * 2;
+            char *grown = realloc(reader->buffer, capacity);
+            if (grown == NULL) return NULL;
+            reader->buffer = grown;
+            reader->capacity = capacity;
+        }
+
+        ssize_t n = read(reader->fd, reader->buffer + reader->length, reader->capacity - reader->length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            reader->eof = true;
+        } else {
+            reader->length += n;
+        }
+    }
+}
+
+static char *next_input(Parallel *par) {
+    if (par->words != NULL) {
+        if (*par->words == NULL) return NULL;
+        return strdup(*par->words++);
+    }
+    return read_line(&par->reader);
+}
+
+// word with every "{}" replaced by input
+static char *substitute(const char *word, const char *input) {
+    size_t input_len = strlen(input);
+    size_t count = 0;
+    for (const char *p = strstr(word, "{}"); p != NULL; p = strstr(p + 2, "{}")) count++;
+
+    char *result = malloc(strlen(word) + count * input_len + 1);
+    if (result == NULL) return NULL;
+    char *out = result;
+    for (const char *p = word; *p != '\0'; ) {
+        if (p[0] == '{' && p[1] == '}') {
+            memcpy(out, input, input_len);
+            out += input_len;
+            p += 2;
+        } else {
+            *out++ = *p++;
+        }
+    }
+    *out = '\0';
+    return result;
+}
+
+static void free_words(char **words) {
+    if (words == NULL) return;
+    for (int i = 0; words[i] != NULL; i++) free(words[i]);
+    free(words);
+}
+
+// The argv of the job for one input
+static char **build_argv(const Parallel *par, const char *input) {
+    int template_count = 0;
+    while (par->template[template_count] != NULL) template_count++;
+
+    if (template_count == 0) {
+        // the input is the command line itself
+        char **argv = calloc(strlen(input) / 2 + 2, sizeof(char *));
+        if (argv == NULL) return NULL;
+        int count = 0;
+        for (const char *p = input; *p != '\0'; ) {
+            while (*p == ' ' || *p == '\t') p++;
+            if (*p == '\0') break;
+            size_t len = strcspn(p, " \t");
+            argv[count] = strndup(p, len);
+            if (argv[count++] == NULL) {
+                free_words(argv);
+                return NULL;
+            }
+            p += len;
+        }
+        return argv;
+    }
+
+    char **argv = calloc(template_count + 2, sizeof(char *));
+    if (argv == NULL) return NULL;
+    for (int i = 0; i < template_count; i++) {
+        argv[i] = par->has_placeholder ? substitute(par->template[i], input) : strdup(par->template[i]);
+        if (argv[i] == NULL) {
+            free_words(argv);
+            return NULL;
+        }
+    }
+    if (!par->has_placeholder) {
+        argv[template_count] = strdup(input);
+        if (argv[template_count] == NULL) {
+            free_words(argv);
+            return NULL;
+        }
+    }
+    return argv;
+}
+
+static void report_failure(Parallel *par, const ParallelJob *job) {
+    par->failed++;
+    outbuf_printf(par->io->err, "parallel: job %ld (%s) exited with status %d\n", job->seq, job->input, job->status);
+}
+
+static void release_job(ParallelJob *job) {
+    if (job->output >= 0) close(job->output);
+    free(job->input);
+    job->output = -1;
+    job->input = NULL;
+    job->pid = 0;
+    job->done = false;
+}
+
+// A job has its status. Its output waits for the earlier jobs with -k,
+// otherwise the slot is free again at once.
+static void end_job(Parallel *par, ParallelJob *job) {
+    job->done = true;
+    if (job->status != 0) report_failure(par, job);
+    if (!par->keep_order) release_job(job);
+}
+
+// Start the job for one input in slot. A job that cannot start is
+// finished at once with 127 or 126, like a command line would be.
+static void start_job(Parallel *par, ParallelJob *job, char *input) {
+    job->seq = ++par->started;
+    job->input = input;
+    job->pid = 0;
+    job->pidfd = -1;
+    job->output = -1;
+    job->done = false;
+
+    char **argv = build_argv(par, input);
+    if (argv == NULL) {
+        outbuf_printf(par->io->err, "parallel: %s\n", strerror(ENOMEM));
+        job->status = 1;
+        end_job(par, job);
+        return;
+    }
+    if (argv[0] == NULL) {
+        // a blank line with no command: nothing to run
+        free(argv);
+        job->status = 0;
+        end_job(par, job);
+        return;
+    }
+
+    char *found = NULL;
+    const char *path = par->path;
+    if (path == NULL) {
+        // the lookup the shell does for a command line, walked per job
+        // only when the command name itself holds "{}"
+        found = strchr(argv[0], '/') != NULL ? strdup(argv[0]) : find_command_in_path(argv[0]);
+        path = found;
+    }
+
+    if (path == NULL) {
+        outbuf_printf(par->io->err, "parallel: %s: command not found\n", argv[0]);
+        job->status = 127;
+    } else {
+        if (par->keep_order) {
+            job->output = memfd_create("parallel", MFD_CLOEXEC);
+            if (job->output < 0) {
+                outbuf_printf(par->io->err, "parallel: memfd_create: %s\n", strerror(errno));
+            }
+        }
+        SpawnIO spawn_io = {par->child_in, job->output >= 0 ? job->output : par->io->out, par->io->err,
+                            NULL, 0, -1, NULL};
+        pid_t pid = spawn_command(path, argv, &spawn_io);
+        if (pid > 0) {
+            job->pid = pid;
+            job->pidfd = open_pidfd(pid);
+            par->running++;
+        } else {
+            job->status = errno == ENOENT ? 127 : 126;
+        }
+    }
+
+    free(found);
+    free_words(argv);
+    if (job->pid == 0) {
+        end_job(par, job);
+    }
+}
+
+// -k: write the output of finished jobs in job order, up to the first
+// one still running
+static void flush_in_order(Parallel *par) {
+    while (par->flushed < par->started) {
+        ParallelJob *job = &par->slots[par->flushed % par->slot_count];
+        if (!job->done) return;
+
+        if (job->output >= 0 && !par->output_broken) {
+            outbuf_flush();
+            bool write_failed;
+            if (lseek(job->output, 0, SEEK_SET) != 0 ||
+                (copy_fd(job->output, par->io->out, &write_failed) != 0 && write_failed)) {
+                par->output_broken = true;
+            }
+        }
+        release_job(job);
+        par->flushed++;
+    }
+}
+
+static void finish_job(Parallel *par, ParallelJob *job, int wait_status) {
+    if (job->pidfd >= 0) close(job->pidfd);
+    job->pidfd = -1;
+    job->pid = 0;
+    job->status = exit_status_from_wait(wait_status);
+    par->running--;
+    end_job(par, job);
+}
+
+// Block until at least one running job has exited and reap all that have.
+// Jobs are waited for by pid, never with waitpid(-1), so the shell's own
+// background jobs are left alone.
+static void reap_jobs(Parallel *par) {
+    struct pollfd *fds = malloc(par->slot_count * sizeof(struct pollfd));
+    int count = 0;
+    bool need_timeout = fds == NULL;
+    for (int i = 0; i < par->slot_count && fds != NULL; i++) {
+        ParallelJob *job = &par->slots[i];
+        if (job->pid == 0) continue;
+        if (job->pidfd >= 0) {
+            fds[count++] = (struct pollfd){job->pidfd, POLLIN, 0};
+        } else {
+            need_timeout = true;
+        }
+    }
+
+    // failures reported so far are shown while the rest run
+    outbuf_flush();
+
+    // processes without a pidfd are checked every 10ms
+    if (count > 0 || need_timeout) {
+        if (fds == NULL) {
+            poll(NULL, 0, 10);
+        } else if (poll(fds, count, need_timeout ? 10 : -1) < 0 && errno != EINTR) {
+            need_timeout = true;
+        }
+    }
+    free(fds);
+
+    for (int i = 0; i < par->slot_count; i++) {
+        ParallelJob *job = &par->slots[i];
+        if (job->pid == 0) continue;
+
+        int status;
+        pid_t result = waitpid(job->pid, &status, WNOHANG);
+        if (result == job->pid) {
+            finish_job(par, job, status);
+        } else if (result == -1 && errno == ECHILD) {
+            // reaped by someone else, nothing more to learn about it
+            finish_job(par, job, 0);
+        }
+    }
+}
+
+// A slot for the next job, or NULL while none is free
+static ParallelJob *free_slot(Parallel *par) {
+    if (par->running >= par->jobs) return NULL;
+
+    if (par->keep_order) {
+        // slots are used round-robin and come free once flushed
+        if (par->started - par->flushed >= par->slot_count) return NULL;
+        return &par->slots[par->started % par->slot_count];
+    }
+    for (int i = 0; i < par->slot_count; i++) {
+        if (par->slots[i].pid == 0) return &par->slots[i];
+    }
+    return NULL;
+}
+
+static int default_jobs(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+int handle_parallel(char **argv, const BuiltinIO *io) {
+    int jobs = default_jobs();
+    bool keep_order = false;
+
+    int i = 1;
+    for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        const char *value = NULL;
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        } else if (strcmp(argv[i], "-k") == 0 || strcmp(argv[i], "--keep-order") == 0) {
+            keep_order = true;
+            continue;
+        } else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) {
+            value = argv[++i];
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            value = argv[i] + 2;
+        } else {
+            outbuf_printf(io->err, "parallel: %s: invalid option\n", argv[i]);
+            return 2;
+        }
+
+        char *end;
+        long n = value != NULL ? strtol(value, &end, 10) : 0;
+        if (value == NULL || *value == '\0' || *end != '\0' || n < 1 || n > 4096) {
+            outbuf_printf(io->err, "parallel: -j: %s: invalid number of jobs\n", value != NULL ? value : "");
+            return 2;
+        }
+        jobs = (int)n;
+    }
+
+    // the command runs up to ":::", which starts the inputs
+    int template_end = i;
+    while (argv[template_end] != NULL && strcmp(argv[template_end], ":::") != 0) template_end++;
+
+    Parallel par = {0};
+    par.io = io;
+    par.keep_order = keep_order;
+    par.jobs = jobs;
+    par.template = calloc(template_end - i + 1, sizeof(char *));
+    if (par.template == NULL) {
+        outbuf_printf(io->err, "parallel: %s\n", strerror(ENOMEM));
+        return 1;
+    }
+    for (int j = i; j < template_end; j++) {
+        par.template[j - i] = argv[j];
+        par.has_placeholder |= strstr(argv[j], "{}") != NULL;
+    }
+
+    if (argv[template_end] != NULL) {
+        par.words = argv + template_end + 1;
+        par.child_in = io->in;
+    } else {
+        par.reader.fd = io->in;
+        // the jobs must not eat the inputs meant for later jobs
+        par.child_in = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+
+    char *resolved = NULL;
+    if (par.template[0] != NULL && strstr(par.template[0], "{}") == NULL) {
+        resolved = strchr(par.template[0], '/') != NULL ? strdup(par.template[0])
+                                                        : find_command_in_path(par.template[0]);
+        if (resolved == NULL) {
+            outbuf_printf(io->err, "parallel: %s: command not found\n", par.template[0]);
+            free(par.template);
+            if (par.words == NULL && par.child_in >= 0) close(par.child_in);
+            return 127;
+        }
+        par.path = resolved;
+    }
+
+    par.slot_count = keep_order ? jobs * PARALLEL_KEEP_WINDOW : jobs;
+    par.slots = calloc(par.slot_count, sizeof(ParallelJob));
+    if (par.slots == NULL) {
+        outbuf_printf(io->err, "parallel: %s\n", strerror(ENOMEM));
+        free(resolved);
+        free(par.template);
+        if (par.words == NULL && par.child_in >= 0) close(par.child_in);
+        return 1;
+    }
+    for (int j = 0; j < par.slot_count; j++) {
+        par.slots[j].pidfd = -1;
+        par.slots[j].output = -1;
+    }
+
+    bool inputs_left = true;
+    for (;;) {
+        ParallelJob *slot;
+        while (inputs_left && (slot = free_slot(&par)) != NULL) {
+            char *input = next_input(&par);
+            if (input == NULL) {
+                inputs_left = false;
+                break;
+            }
+            start_job(&par, slot, input);
+        }
+        if (keep_order) flush_in_order(&par);
+        if (par.running == 0 && !inputs_left) break;
+        if (par.running > 0) reap_jobs(&par);
+    }
+    if (keep_order) flush_in_order(&par);
+
+    for (int j = 0; j < par.slot_count; j++) {
+        release_job(&par.slots[j]);
+    }
+    free(par.slots);
+    free(par.reader.buffer);
+    free(resolved);
+    free(par.template);
+    if (par.words == NULL && par.child_in >= 0) close(par.child_in);
+
+    return par.failed < PARALLEL_MAX_STATUS ? par.failed : PARALLEL_MAX_STATUS;
+}
@@ -0,0 +1,17 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "common.h"
+
+// parallel [-j N] [-k] [--] [command [arg ...]] [::: input ...]
+//
+// Run command once per input, at most N at a time (the CPU count by
+// default). Inputs are the words after ":::" or else the lines of stdin.
+// "{}" in the command is replaced by the input; without one the input is
+// added as the last argument, and with no command at all the input is
+// split on blanks into the command itself. Output is interleaved as jobs
+// write it, or with -k kept in input order. Every failed job is reported
+// on stderr; the status is the number of failed jobs, at most 101.
+int handle_parallel(char **argv, const BuiltinIO *io);
+
+#endif
@@ -1,106 +1,567 @@
 #include "parser.h"
+#include "lexer.h"
+#include "vars.h"
 
-Args parse_arguments(const char *input) {
-    Args args = {{NULL}, 0, {NULL, 0}};
-    char buffer[MAX_INPUT];
-    int buf_index = 0;
-    int in_single_quote = 0;
-    int in_double_quote = 0;
-
-    for (int i = 0; input[i] != '\0' && args.count < MAX_ARGS; i++) {
-        char c = input[i];
-
-        // handle escape character
-        if (c == '\\' && !in_single_quote) {
-            if (i + 1 < strlen(input)) {
-                char next_char = input[i + 1];
-                if (in_double_quote) {
-                    if (next_char == '"' || next_char == '$' || next_char == '`' || next_char == '\\') {
-                        buffer[buf_index++] = next_char;
-                        i++;
-                    } else {
-                        buffer[buf_index++] = c;
-                    }
-                } else {
-                    buffer[buf_index++] = next_char;
-                    i++;
-                }
+typedef struct {
+    Lexer lexer;
+    Arena *arena;
+    Token current;  // one token of lookahead
+    size_t last_end;    // end of the token before current
+    bool incomplete;    // stopped at the end of input that needs more lines
+} Parser;
+
+static void advance(Parser *parser) {
+    parser->last_end = parser->current.end;
+    parser->current = lexer_next(&parser->lexer);
+}
+
+static bool syntax_error(const Token *token) {
+    fprintf(stderr, "syntax error near unexpected token `%s'\n", token->text);
+    return false;
+}
+
+// the input ended where more was needed: not an error, the caller reads on
+static bool need_more_input(Parser *parser) {
+    parser->incomplete = true;
+    return false;
+}
+
+// grow an arena array by doubling, copying the old contents across
+static void *grow_array(Arena *arena, void *items, int count, int *capacity, size_t size) {
+    int new_capacity = *capacity ? *capacity * 2 : 4;
+    void *grown = arena_alloc(arena, new_capacity * size);
+    if (grown == NULL) return NULL;
+    if (count > 0) {
+        memcpy(grown, items, count * size);
+    }
+    *capacity = new_capacity;
+    return grown;
+}
+
+// append a word to a NULL-terminated arena array
+static bool push_word(Parser *parser, char ***words, int *count, int *capacity, char *word) {
+    // keep room for the NULL terminator
+    if (*count + 1 >= *capacity) {
+        *words = grow_array(parser->arena, *words, *count, capacity, sizeof(char *));
+        if (*words == NULL) {
+            perror("malloc");
+            return false;
+        }
+    }
+    (*words)[(*count)++] = word;
+    (*words)[*count] = NULL;
+    return true;
+}
+
+static bool push_redirect(Parser *parser, Args *command, int *capacity, Redirection redirect) {
+    if (command->redirect_count == *capacity) {
+        command->redirects = grow_array(parser->arena, command->redirects, command->redirect_count,
+                                        capacity, sizeof(Redirection));
+        if (command->redirects == NULL) {
+            perror("malloc");
+            return false;
+        }
+    }
+    command->redirects[command->redirect_count++] = redirect;
+    return true;
+}
+
+// Turn a redirection operator and the word after it into the command's
+// next redirection
+static bool parse_redirect(Parser *parser, Args *command, int *capacity) {
+    Token op = parser->current;
+    advance(parser);
+    if (parser->current.type != TOK_WORD) {
+        return syntax_error(&parser->current);
+    }
+
+    const char *word = parser->current.text;
+    Redirection redirect = {parser->current.text, op.fd, op.append, -1, op.kind};
+    bool both = op.text[0] == '&';
+    command->expand |= parser->current.expand;
+
+    if (op.kind == REDIRECT_DUP) {
+        redirect.filename = NULL;
+        if (strcmp(word, "-") == 0) {
+            redirect.kind = REDIRECT_CLOSE;
+        } else if (isdigit((unsigned char)word[0]) && word[1] == '\0') {
+            redirect.source_fd = word[0] - '0';
+        } else if (op.text[0] == '>' && op.fd == 1) {
+            // ">& file" is the old spelling of "&> file"
+            redirect.filename = parser->current.text;
+            redirect.kind = REDIRECT_OUTPUT;
+            both = true;
+        } else {
+            return syntax_error(&parser->current);
+        }
+    } else if (op.kind == REDIRECT_HEREDOC) {
+        // read before the lookahead moves on to the body's lines
+        redirect.filename = lexer_heredoc(&parser->lexer, &parser->current, strcmp(op.text, "<<-") == 0);
+        if (redirect.filename == NULL) {
+            return need_more_input(parser);
+        }
+        command->expand = true;
+    }
+    advance(parser);
+
+    if (!push_redirect(parser, command, capacity, redirect)) return false;
+    if (both) {
+        Redirection dup = {NULL, 2, 0, 1, REDIRECT_DUP};
+        return push_redirect(parser, command, capacity, dup);
+    }
+    return true;
+}
+
+static bool parse_list(Parser *parser, CommandList *list, bool nested);
+static bool parse_compound(Parser *parser, Args *command);
+
+// skip newlines allowed after |, && and ||
+static void skip_newlines(Parser *parser) {
+    while (parser->current.type == TOK_NEWLINE) {
+        advance(parser);
+    }
+}
+
+// an unquoted word spelled like a reserved word
+static bool is_keyword(const Token *token, const char *word) {
+    return token->type == TOK_WORD && !token->quoted && strcmp(token->text, word) == 0;
+}
+
+// a reserved word or ;; that closes the list inside a compound command
+static bool at_list_end(const Parser *parser) {
+    static const char *const closers[] = {"then", "elif", "else", "fi", "do", "done", "esac"};
+    if (parser->current.type == TOK_DSEMI) return true;
+    for (size_t i = 0; i < sizeof(closers) / sizeof(closers[0]); i++) {
+        if (is_keyword(&parser->current, closers[i])) return true;
+    }
+    return false;
+}
+
+// a reserved word that starts a compound command
+static bool at_compound(const Parser *parser) {
+    static const char *const openers[] = {"if", "while", "until", "for", "case"};
+    for (size_t i = 0; i < sizeof(openers) / sizeof(openers[0]); i++) {
+        if (is_keyword(&parser->current, openers[i])) return true;
+    }
+    return false;
+}
+
+// consume the reserved word a compound command needs next
+static bool expect_keyword(Parser *parser, const char *word) {
+    if (is_keyword(&parser->current, word)) {
+        advance(parser);
+        return true;
+    }
+    if (parser->current.type == TOK_END) {
+        return need_more_input(parser);
+    }
+    return syntax_error(&parser->current);
+}
+
+// command := compound_command REDIRECT*
+//          | (ASSIGNMENT | REDIRECT WORD)* (WORD | REDIRECT WORD)*
+// with at least one assignment or word
+static bool parse_command(Parser *parser, Args *command) {
+    int capacity = 0;
+    int assign_capacity = 0;
+    int redirect_capacity = 0;
+    command->args = NULL;
+    command->count = 0;
+    command->redirects = NULL;
+    command->redirect_count = 0;
+    command->assigns = NULL;
+    command->assign_count = 0;
+    command->expand = false;
+    command->compound = NULL;
+    command->path_cache = NULL;
+
+    if (at_list_end(parser)) {
+        return syntax_error(&parser->current);
+    }
+    if (at_compound(parser)) {
+        if (!parse_compound(parser, command)) return false;
+        while (parser->current.type == TOK_REDIRECT) {
+            if (!parse_redirect(parser, command, &redirect_capacity)) return false;
+        }
+        // a compound command still needs its NULL-terminated argv
+        command->args = arena_alloc(parser->arena, sizeof(char *));
+        if (command->args == NULL) {
+            perror("malloc");
+            return false;
+        }
+        command->args[0] = NULL;
+        return true;
+    }
+
+    while (parser->current.type == TOK_WORD || parser->current.type == TOK_REDIRECT) {
+        if (parser->current.type == TOK_REDIRECT) {
+            if (!parse_redirect(parser, command, &redirect_capacity)) return false;
+            continue;
+        }
+
+        // assignments count only until the command name
+        bool ok;
+        if (parser->current.assignment && command->count == 0) {
+            ok = push_word(parser, &command->assigns, &command->assign_count, &assign_capacity,
+                           parser->current.text);
+        } else {
+            ok = push_word(parser, &command->args, &command->count, &capacity, parser->current.text);
+        }
+        if (!ok) return false;
+        command->expand |= parser->current.expand;
+        advance(parser);
+    }
+
+    if (command->count == 0 && command->assign_count == 0) {
+        return syntax_error(&parser->current);
+    }
+    if (command->args == NULL) {
+        // assignments alone: an empty argv, still NULL-terminated
+        command->args = arena_alloc(parser->arena, sizeof(char *));
+        if (command->args == NULL) {
+            perror("malloc");
+            return false;
+        }
+        command->args[0] = NULL;
+    }
+    return true;
+}
+
+// add an empty list to a compound command's parts and return it
+static CommandList *push_part(Parser *parser, Compound *compound, int *capacity) {
+    if (compound->part_count == *capacity) {
+        compound->parts = grow_array(parser->arena, compound->parts, compound->part_count, capacity,
+                                     sizeof(CommandList));
+        if (compound->parts == NULL) {
+            perror("malloc");
+            return NULL;
+        }
+    }
+    return &compound->parts[compound->part_count++];
+}
+
+// a list inside a compound command, which must not be empty
+static bool parse_body(Parser *parser, Compound *compound, int *capacity) {
+    CommandList *list = push_part(parser, compound, capacity);
+    if (list == NULL || !parse_list(parser, list, true)) return false;
+    if (list->count == 0) {
+        return syntax_error(&parser->current);
+    }
+    return true;
+}
+
+// if_clause := 'if' list 'then' list ('elif' list 'then' list)* ['else' list] 'fi'
+static bool parse_if(Parser *parser, Compound *compound) {
+    int capacity = 0;
+    do {
+        advance(parser);
+        if (!parse_body(parser, compound, &capacity)) return false;
+        if (!expect_keyword(parser, "then")) return false;
+        if (!parse_body(parser, compound, &capacity)) return false;
+    } while (is_keyword(&parser->current, "elif"));
+
+    if (is_keyword(&parser->current, "else")) {
+        advance(parser);
+        if (!parse_body(parser, compound, &capacity)) return false;
+        compound->has_else = true;
+    }
+    return expect_keyword(parser, "fi");
+}
+
+// do_group := 'do' list 'done'
+static bool parse_do_group(Parser *parser, Compound *compound, int *capacity) {
+    if (!expect_keyword(parser, "do")) return false;
+    if (!parse_body(parser, compound, capacity)) return false;
+    return expect_keyword(parser, "done");
+}
+
+// for_clause := 'for' NAME [linebreak 'in' WORD* (';' | NEWLINE)] linebreak do_group
+static bool parse_for(Parser *parser, Compound *compound) {
+    advance(parser);
+    const Token *name = &parser->current;
+    if (name->type != TOK_WORD || name->quoted || name->expand ||
+        !var_valid_name(name->text, strlen(name->text))) {
+        if (name->type == TOK_END) return need_more_input(parser);
+        return syntax_error(name);
+    }
+    compound->name = name->text;
+    advance(parser);
+
+    if (parser->current.type == TOK_SEMI) {
+        advance(parser);
+    }
+    skip_newlines(parser);
+    if (is_keyword(&parser->current, "in")) {
+        advance(parser);
+        int capacity = 0;
+        while (parser->current.type == TOK_WORD) {
+            if (!push_word(parser, &compound->words, &compound->word_count, &capacity, parser->current.text)) {
+                return false;
             }
-        } else if (c == '\'' && !in_double_quote) {
-            in_single_quote = !in_single_quote;
-        } else if (c == '"' && !in_single_quote) {
-            in_double_quote = !in_double_quote;
-        } else if (isspace(c) && !in_single_quote && !in_double_quote) {
-            if (buf_index > 0) {
-                buffer[buf_index] = '\0';
-                args.args[args.count] = malloc(buf_index + 1);
-                strcpy(args.args[args.count], buffer);
-                args.count++;
-                buf_index = 0;
+            advance(parser);
+        }
+        if (parser->current.type == TOK_END) return need_more_input(parser);
+        if (parser->current.type != TOK_SEMI && parser->current.type != TOK_NEWLINE) {
+            return syntax_error(&parser->current);
+        }
+        advance(parser);
+        skip_newlines(parser);
+    }
+
+    int capacity = 0;
+    return parse_do_group(parser, compound, &capacity);
+}
+
+// case_clause := 'case' WORD linebreak 'in' linebreak case_item* 'esac'
+// case_item := ['('] WORD ('|' WORD)* ')' linebreak [list] [';;' linebreak]
+static bool parse_case(Parser *parser, Compound *compound) {
+    advance(parser);
+    if (parser->current.type != TOK_WORD) {
+        if (parser->current.type == TOK_END) return need_more_input(parser);
+        return syntax_error(&parser->current);
+    }
+    compound->subject = parser->current.text;
+    advance(parser);
+    skip_newlines(parser);
+    if (!expect_keyword(parser, "in")) return false;
+    skip_newlines(parser);
+
+    int capacity = 0;
+    while (!is_keyword(&parser->current, "esac")) {
+        if (compound->item_count == capacity) {
+            compound->items = grow_array(parser->arena, compound->items, compound->item_count, &capacity,
+                                         sizeof(CaseItem));
+            if (compound->items == NULL) {
+                perror("malloc");
+                return false;
             }
-        } else {
-            buffer[buf_index++] = c;
-        }
-    }
-
-    if (buf_index > 0) {
-        buffer[buf_index] = '\0';
-        args.args[args.count] = malloc(buf_index + 1);
-        strcpy(args.args[args.count], buffer);
-        args.count++;
-    }
-    
-    // process redirections
-    for (int i = 0; i < args.count; i++) {
-        int fd_type = 0;
-        int append = 0;
-        
-        // check for output redirection symbols
-        if (strcmp(args.args[i], ">") == 0 || strcmp(args.args[i], "1>") == 0) {
-            fd_type = 1;
-            append = 0;
-        } else if (strcmp(args.args[i], ">>") == 0 || strcmp(args.args[i], "1>>") == 0) {
-            fd_type = 1;
-            append = 1;
-        } else if (strcmp(args.args[i], "2>") == 0) {
-            fd_type = 2;
-            append = 0;
-        } else if (strcmp(args.args[i], "2>>") == 0) {
-            fd_type = 2;
-            append = 1;
-        }
-
-        // if a redirection is found
-        if (fd_type != 0) {
-            if (i + 1 < args.count) {
-                args.output_redirect.filename = malloc(strlen(args.args[i + 1]) + 1);
-                strcpy(args.output_redirect.filename, args.args[i + 1]);
-                args.output_redirect.fd_type = fd_type;
-                args.output_redirect.append = append;
-                
-                free(args.args[i]);
-                free(args.args[i + 1]);
-                
-                for (int j = i; j < args.count - 2; j++) {
-                    args.args[j] = args.args[j + 2];
+        }
+        CaseItem *item = &compound->items[compound->item_count++];
+        item->patterns = NULL;
+
+        if (parser->current.type == TOK_LPAREN) {
+            advance(parser);
+        }
+        int pattern_count = 0, pattern_capacity = 0;
+        while (1) {
+            if (parser->current.type != TOK_WORD) {
+                if (parser->current.type == TOK_END) return need_more_input(parser);
+                return syntax_error(&parser->current);
+            }
+            if (!push_word(parser, &item->patterns, &pattern_count, &pattern_capacity, parser->current.text)) {
+                return false;
+            }
+            advance(parser);
+            if (parser->current.type != TOK_PIPE) break;
+            advance(parser);
+        }
+        if (parser->current.type != TOK_RPAREN) {
+            if (parser->current.type == TOK_END) return need_more_input(parser);
+            return syntax_error(&parser->current);
+        }
+        advance(parser);
+
+        // an item may have no commands at all
+        if (!parse_list(parser, &item->body, true)) return false;
+        if (parser->current.type == TOK_DSEMI) {
+            advance(parser);
+            skip_newlines(parser);
+        } else if (!is_keyword(&parser->current, "esac")) {
+            return syntax_error(&parser->current);
+        }
+    }
+    advance(parser);
+    return true;
+}
+
+static bool parse_compound(Parser *parser, Args *command) {
+    Compound *compound = arena_alloc(parser->arena, sizeof(Compound));
+    if (compound == NULL) {
+        perror("malloc");
+        return false;
+    }
+    memset(compound, 0, sizeof(Compound));
+    command->compound = compound;
+
+    const char *word = parser->current.text;
+    if (strcmp(word, "if") == 0) {
+        compound->kind = COMPOUND_IF;
+        return parse_if(parser, compound);
+    }
+    if (strcmp(word, "for") == 0) {
+        compound->kind = COMPOUND_FOR;
+        return parse_for(parser, compound);
+    }
+    if (strcmp(word, "case") == 0) {
+        compound->kind = COMPOUND_CASE;
+        return parse_case(parser, compound);
+    }
+
+    int capacity = 0;
+    compound->kind = strcmp(word, "while") == 0 ? COMPOUND_WHILE : COMPOUND_UNTIL;
+    advance(parser);
+    if (!parse_body(parser, compound, &capacity)) return false;
+    return parse_do_group(parser, compound, &capacity);
+}
+
+// pipeline := ['time' ['-p']] command ('|' command)*
+static bool parse_pipeline(Parser *parser, Pipeline *pipeline) {
+    int capacity = 0;
+    pipeline->commands = NULL;
+    pipeline->count = 0;
+    pipeline->start = parser->current.start;
+    pipeline->end = parser->current.end;
+    pipeline->timed = false;
+    pipeline->time_posix = false;
+
+    if (is_keyword(&parser->current, "time")) {
+        pipeline->timed = true;
+        advance(parser);
+        if (is_keyword(&parser->current, "-p")) {
+            pipeline->time_posix = true;
+            advance(parser);
+        }
+        // "time" on its own just reports the time of nothing
+        if (parser->current.type != TOK_WORD && parser->current.type != TOK_REDIRECT) {
+            pipeline->end = parser->last_end;
+            return true;
+        }
+    }
+
+    while (1) {
+        if (pipeline->count == capacity) {
+            pipeline->commands = grow_array(parser->arena, pipeline->commands, pipeline->count, &capacity, sizeof(Args));
+            if (pipeline->commands == NULL) {
+                perror("malloc");
+                return false;
+            }
+        }
+        if (!parse_command(parser, &pipeline->commands[pipeline->count])) {
+            return false;
+        }
+        pipeline->count++;
+        pipeline->end = parser->last_end;
+
+        if (parser->current.type != TOK_PIPE) {
+            return true;
+        }
+        advance(parser);
+        skip_newlines(parser);
+        if (parser->current.type == TOK_END) {
+            return need_more_input(parser);
+        }
+    }
+}
+
+// list := pipeline ((';' | '&' | '&&' | '||' | NEWLINE) pipeline)* [';' | '&' | NEWLINE]
+// A nested list, inside a compound command, ends before the reserved
+// word or ;; that closes it; the caller checks which one that is.
+static bool parse_list(Parser *parser, CommandList *list, bool nested) {
+    int capacity = 0;
+    list->items = NULL;
+    list->count = 0;
+    list->source = parser->lexer.input;
+    list->incomplete = false;
+
+    while (1) {
+        // blank lines and stray separators between items are fine
+        while (parser->current.type == TOK_NEWLINE ||
+               (parser->current.type == TOK_SEMI && list->count > 0)) {
+            advance(parser);
+        }
+        if (parser->current.type == TOK_END) {
+            // a compound command still open needs more lines as well
+            if (parser->lexer.incomplete || nested) {
+                return need_more_input(parser);
+            }
+            return true;
+        }
+        if (at_list_end(parser)) {
+            if (nested) return true;
+            return syntax_error(&parser->current);
+        }
+
+        if (list->count == capacity) {
+            list->items = grow_array(parser->arena, list->items, list->count, &capacity, sizeof(ListItem));
+            if (list->items == NULL) {
+                perror("malloc");
+                return false;
+            }
+        }
+
+        ListItem *item = &list->items[list->count];
+        item->background = false;
+        if (!parse_pipeline(parser, &item->pipeline)) {
+            return false;
+        }
+        list->count++;
+
+        switch (parser->current.type) {
+            case TOK_AND_IF:
+            case TOK_OR_IF:
+                item->connector = parser->current.type == TOK_AND_IF ? CONNECT_AND : CONNECT_OR;
+                advance(parser);
+                skip_newlines(parser);
+                if (parser->current.type == TOK_END) {
+                    return need_more_input(parser);
                 }
-                args.count -= 2;
                 break;
-            }
+            case TOK_AMP:
+                item->background = true;
+                item->connector = CONNECT_SEQ;
+                advance(parser);
+                // a ; straight after & would be an empty command
+                if (parser->current.type == TOK_SEMI) {
+                    return syntax_error(&parser->current);
+                }
+                break;
+            case TOK_SEMI:
+            case TOK_NEWLINE:
+                item->connector = CONNECT_SEQ;
+                advance(parser);
+                break;
+            case TOK_END:
+            case TOK_DSEMI:
+                item->connector = CONNECT_SEQ;
+                break;
+            default:
+                // "fi" and the like after a compound command close the list
+                // around it; anywhere else they were taken as words
+                if (nested && at_list_end(parser)) {
+                    item->connector = CONNECT_SEQ;
+                    break;
+                }
+                return syntax_error(&parser->current);
         }
     }
-    
-    args.args[args.count] = NULL;
-    return args;
 }
 
-void free_arguments(Args *args) {
-    // free each argument string
-    for (int i = 0; i < args->count; i++) {
-        free(args->args[i]);
+bool parse_command_line(Arena *arena, const char *input, CommandList *list) {
+    Parser parser;
+    parser.arena = arena;
+    parser.current.end = 0;
+    parser.incomplete = false;
+
+    list->items = NULL;
+    list->count = 0;
+    list->source = input;
+    list->incomplete = false;
+    if (!lexer_init(&parser.lexer, arena, input)) {
+        perror("malloc");
+        return false;
     }
-    // free redirection filename if allocated
-    if (args->output_redirect.filename != NULL) {
-        free(args->output_redirect.filename);
+    advance(&parser);
+
+    bool ok = parse_list(&parser, list, false);
+    list->incomplete = parser.incomplete;
+    return ok;
+}
+
+bool is_reserved_word(const char *word) {
+    static const char *const reserved[] = {"time", "if", "then", "elif", "else", "fi", "for", "in",
+                                           "while", "until", "do", "done", "case", "esac"};
+    for (size_t i = 0; i < sizeof(reserved) / sizeof(reserved[0]); i++) {
+        if (strcmp(word, reserved[i]) == 0) return true;
     }
-}
\ No newline at end of file
+    return false;
+}
@@ -2,8 +2,79 @@
 #define PARSER_H
 
 #include "common.h"
+#include "arena.h"
 
-Args parse_arguments(const char *input);
-void free_arguments(Args *args);
+// Commands joined by pipes
+typedef struct {
+    Args *commands;
+    int count;      // 0 only for a bare "time"
+    size_t start;   // where the pipeline was written in the input
+    size_t end;
+    bool timed;     // prefixed by the "time" reserved word
+    bool time_posix;    // "time -p": POSIX output format
+} Pipeline;
 
-#endif
\ No newline at end of file
+// How a list item is joined to the one after it
+typedef enum {
+    CONNECT_SEQ,    // ; or newline: always run the next item
+    CONNECT_AND,    // &&: run the next item if this one succeeded
+    CONNECT_OR      // ||: run the next item if this one failed
+} Connector;
+
+typedef struct {
+    Pipeline pipeline;
+    Connector connector;
+    bool background;    // the and-or chain ending here was followed by &
+} ListItem;
+
+// A whole command line: pipelines joined by ;, &, && and ||
+typedef struct {
+    ListItem *items;
+    int count;
+    const char *source; // the input, for showing job commands
+    bool incomplete;    // parsing failed only because the input ended too soon
+} CommandList;
+
+typedef enum {
+    COMPOUND_IF,
+    COMPOUND_WHILE,
+    COMPOUND_UNTIL,
+    COMPOUND_FOR,
+    COMPOUND_CASE
+} CompoundKind;
+
+// One "pattern | pattern) list ;;" of a case command
+typedef struct {
+    char **patterns;    // NULL-terminated, expanded when matched
+    CommandList body;   // may be empty
+} CaseItem;
+
+// A compound command. Its lists are parsed once and run as often as the
+// command loops; only expansions are done again on every run.
+typedef struct Compound {
+    CompoundKind kind;
+    // if: a condition and a body for the if and each elif, then the else
+    // body; while and until: the condition and the body; for: the body
+    CommandList *parts;
+    int part_count;
+    bool has_else;
+    char *name;         // for: the loop variable
+    char **words;       // for: the words after "in"
+    int word_count;
+    char *subject;      // case: the word matched against the patterns
+    CaseItem *items;
+    int item_count;
+} Compound;
+
+// Parse a command line in a single pass. All memory comes from the arena
+// and is released when the arena is reset. On a syntax error the error is
+// reported on stderr and false is returned. When the input just ends too
+// early (an open quote, a trailing |, a here-document without its end)
+// nothing is reported, incomplete is set and false is returned, so the
+// caller can read another line and parse the lot again.
+bool parse_command_line(Arena *arena, const char *input, CommandList *list);
+
+// Whether a word is a reserved word when it starts a command
+bool is_reserved_word(const char *word);
+
+#endif
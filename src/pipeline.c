@@ -1,345 +1,449 @@
 #include "pipeline.h"
-#include "parser.h"
 #include "executor.h"
 #include "builtins.h"
+#include "hash.h"
+#include "spawn.h"
+#include "shell.h"
+#include "jobs.h"
+#include "vars.h"
+#include "expand.h"
+#include "redirect.h"
+#include "timing.h"
+#include "trace.h"
+#include "eval.h"
+#include "outbuf.h"
 #include <sys/wait.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
+#include <signal.h>
 
-// Check if the input contains a pipeline operator (|)
-// Returns 1 if pipeline is found, 0 otherwise
-int has_pipeline(const char *input) {
-    if (input == NULL) return 0;
-    
-    int in_single_quote = 0;
-    int in_double_quote = 0;
-    
-    for (int i = 0; input[i] != '\0'; i++) {
-        char c = input[i];
-        
-        // Handle escape character
-        if (c == '\\' && !in_single_quote) {
-            if (i + 1 < strlen(input)) {
-                i++; // Skip next character
-            }
-            continue;
-        }
-        
-        // Handle quotes
-        if (c == '\'' && !in_double_quote) {
-            in_single_quote = !in_single_quote;
-        } else if (c == '"' && !in_single_quote) {
-            in_double_quote = !in_double_quote;
-        } else if (c == '|' && !in_single_quote && !in_double_quote) {
-            return 1; // Found pipeline operator
+// How one stage of a pipeline is being run
+typedef enum {
+    STAGE_NONE,     // not started (lookup or spawn failed)
+    STAGE_PROCESS,  // external command or forked builtin, waited with waitpid
+    STAGE_THREAD,   // builtin on a helper thread writing into its pipe
+    STAGE_SHELL     // builtin run by the shell itself as the last stage
+} StageKind;
+
+typedef struct {
+    StageKind kind;
+    pid_t pid;
+    pthread_t thread;
+    const Builtin *builtin;
+    bool in_shell;      // run without a fork, on a thread or by the shell
+    char **argv;
+    BuiltinIO io;
+    int close_fds[2];   // pipe ends owned by the stage, closed when it ends
+    RedirectPlan plan;  // what its redirections opened, for a builtin in the shell
+    int status;
+    StageTimes *times;  // where the stage's cost goes when timed, else NULL
+} Stage;
+
+// builtins run without a fork unless they would change the shell itself
+// or the pipeline needs every stage in its own process
+static bool runs_in_shell(const Stage *stage, bool fork_builtins) {
+    return stage->builtin != NULL && !(stage->builtin->flags & BUILTIN_SUBSHELL) && !fork_builtins;
+}
+
+static void close_stage_fds(Stage *stage) {
+    for (int i = 0; i < 2; i++) {
+        if (stage->close_fds[i] >= 0) {
+            close(stage->close_fds[i]);
+            stage->close_fds[i] = -1;
         }
     }
-    
-    return 0;
+    redirect_plan_close(&stage->plan);
 }
 
-// Find all pipeline operator positions
-// Returns the number of pipeline operators found, and stores positions in positions array
-static int find_all_pipeline_positions(const char *input, int *positions, int max_positions) {
-    if (input == NULL) return 0;
-    
-    int count = 0;
-    int in_single_quote = 0;
-    int in_double_quote = 0;
-    
-    for (int i = 0; input[i] != '\0' && count < max_positions; i++) {
-        char c = input[i];
-        
-        // Handle escape character
-        if (c == '\\' && !in_single_quote) {
-            if (i + 1 < strlen(input)) {
-                i++; // Skip next character
-            }
-            continue;
-        }
-        
-        // Handle quotes
-        if (c == '\'' && !in_double_quote) {
-            in_single_quote = !in_single_quote;
-        } else if (c == '"' && !in_single_quote) {
-            in_double_quote = !in_double_quote;
-        } else if (c == '|' && !in_single_quote && !in_double_quote) {
-            positions[count++] = i;
+// body of a helper thread running a builtin that is not the last stage;
+// closing its pipe end when done is what lets the next stage see EOF
+static void *run_builtin_thread(void *data) {
+    Stage *stage = data;
+    if (stage->times != NULL) timing_thread_begin(stage->times);
+    TRACE_BEGIN(start);
+    stage->status = stage->builtin->handler(stage->argv, &stage->io);
+    outbuf_flush();
+    TRACE_END(TRACE_BUILTIN, start);
+    close_stage_fds(stage);
+    if (stage->times != NULL) timing_thread_end(stage->times);
+    return NULL;
+}
+
+// The program a command runs. A cached plan keeps the hash table entry it
+// found, which holds until the table drops or replaces one; each run still
+// counts as a hit.
+static const char *command_path(const Args *command) {
+    PathCache *cache = command->path_cache;
+    if (cache != NULL && cache->entry != NULL && cache->generation == hash_generation()) {
+        return hash_hit(cache->entry);
+    }
+
+    HashEntry *entry;
+    const char *path = resolve_command_entry(command->args[0], &entry);
+    if (cache != NULL) {
+        // a path found through a relative PATH entry depends on the
+        // working directory, so it is looked up on every run instead
+        cache->entry = path != NULL && path[0] == '/' ? entry : NULL;
+        cache->generation = hash_generation();
+    }
+    return path;
+}
+
+// Start an external command, spawned with the pipe ends wired in
+static void start_external(Arena *arena, Stage *stage, const Args *command, int in_fd, int out_fd,
+                           pid_t pgid) {
+    const char *fullpath = command_path(command);
+    if (fullpath == NULL) {
+        printf("%s: command not found\n", command->args[0]);
+        stage->status = 127;
+        return;
+    }
+
+    // assignments before the command name go into its environment only
+    char **envp = vars_environ_with(arena, command->assigns, command->assign_count);
+    SpawnIO io = {in_fd, out_fd, -1, command->redirects, command->redirect_count, pgid, envp};
+    stage->pid = spawn_command(fullpath, command->args, &io);
+    if (stage->pid == SPAWN_REDIRECT_FAILED) {
+        stage->status = 1;
+        return;
+    }
+    if (stage->pid == -1) {
+        stage->status = errno == ENOENT ? 127 : 126;
+        // the remembered path no longer exists
+        if (errno == ENOENT) {
+            hash_remove(command->args[0]);
         }
+        return;
     }
-    
-    return count;
+    stage->kind = STAGE_PROCESS;
 }
 
-// Execute a pipeline with multiple commands
-void execute_pipeline(const char *input) {
-    if (input == NULL) return;
-    
-    // Find all pipeline positions
-    int pipe_positions[64]; // Maximum 64 pipeline operators
-    int pipe_count = find_all_pipeline_positions(input, pipe_positions, 64);
-    
-    if (pipe_count == 0) {
-        return; // No pipeline found
-    }
-    
-    int num_commands = pipe_count + 1;
-    
-    // Split input into command strings
-    char **commands = malloc(num_commands * sizeof(char *));
-    if (commands == NULL) {
-        perror("malloc");
+// Start a builtin that changes shell state, or a compound command, in a
+// forked child
+static void start_forked_builtin(Arena *arena, Stage *stage, const Args *command, int in_fd, int out_fd,
+                                 int (*pipefds)[2], int num_pipes, pid_t pgid) {
+    TRACE_BEGIN(start);
+    // the child would write out a copy of anything still pending
+    outbuf_flush();
+    stage->pid = fork();
+
+    if (stage->pid == -1) {
+        perror("fork");
+        stage->status = 1;
         return;
     }
-    
-    // Extract first command
-    int start = 0;
-    for (int i = 0; i < num_commands; i++) {
-        int end;
-        if (i < pipe_count) {
-            end = pipe_positions[i];
-        } else {
-            end = strlen(input);
+
+    if (stage->pid == 0) {
+        shell.subshell = true;
+        if (pgid >= 0) {
+            setpgid(0, pgid);
         }
-        
-        // Trim leading whitespace
-        while (start < end && isspace(input[start])) {
-            start++;
+        shell_reset_signals();
+        jobs_subshell();
+        if (in_fd >= 0) {
+            dup2(in_fd, STDIN_FILENO);
         }
-        
-        // Trim trailing whitespace
-        int cmd_end = end - 1;
-        while (cmd_end >= start && isspace(input[cmd_end])) {
-            cmd_end--;
+        if (out_fd >= 0) {
+            dup2(out_fd, STDOUT_FILENO);
         }
-        
-        if (cmd_end < start) {
-            // Empty command
-            commands[i] = NULL;
-        } else {
-            int cmd_len = cmd_end - start + 1;
-            commands[i] = malloc(cmd_len + 1);
-            if (commands[i] == NULL) {
-                perror("malloc");
-                // Free already allocated commands
-                for (int j = 0; j < i; j++) {
-                    if (commands[j]) free(commands[j]);
-                }
-                free(commands);
-                return;
-            }
-            strncpy(commands[i], input + start, cmd_len);
-            commands[i][cmd_len] = '\0';
+        // Close all pipe ends, the ones we need were duplicated above
+        for (int j = 0; j < num_pipes; j++) {
+            close(pipefds[j][0]);
+            close(pipefds[j][1]);
         }
-        
-        // Move start to after the pipe operator
-        if (i < pipe_count) {
-            start = pipe_positions[i] + 1;
+        // The command's own redirections override the pipe wiring
+        if (!redirect_apply(command->redirects, command->redirect_count)) {
+            _exit(1);
         }
-    }
-    
-    // Parse all commands
-    Args *args_array = malloc(num_commands * sizeof(Args));
-    if (args_array == NULL) {
-        perror("malloc");
-        for (int i = 0; i < num_commands; i++) {
-            if (commands[i]) free(commands[i]);
-        }
-        free(commands);
-        return;
-    }
-    
-    for (int i = 0; i < num_commands; i++) {
-        if (commands[i] == NULL) {
-            args_array[i].count = 0;
-            args_array[i].output_redirect.filename = NULL;
+
+        int status;
+        if (command->compound != NULL) {
+            // the pipelines inside run like the shell's own, builtins on threads
+            signal(SIGPIPE, SIG_IGN);
+            status = execute_compound(arena, command->compound);
         } else {
-            args_array[i] = parse_arguments(commands[i]);
+            BuiltinIO io = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+            status = stage->builtin->handler(command->args, &io);
         }
+        // _exit skips stdio cleanup, which would rewind the parent's
+        // buffered input stream when reading a script
+        outbuf_flush();
+        fflush(stdout);
+        _exit(status);
     }
-    
-    // Free command strings
-    for (int i = 0; i < num_commands; i++) {
-        if (commands[i]) free(commands[i]);
+
+    if (pgid >= 0) {
+        setpgid(stage->pid, pgid > 0 ? pgid : stage->pid);
     }
-    free(commands);
-    
-    // Validate all commands
-    for (int i = 0; i < num_commands; i++) {
-        if (args_array[i].count == 0) {
-            // Invalid command, clean up and return
-            for (int j = 0; j < num_commands; j++) {
-                free_arguments(&args_array[j]);
-            }
-            free(args_array);
-            return;
+    TRACE_END(TRACE_SPAWN, start);
+    stage->kind = STAGE_PROCESS;
+}
+
+// Hand a builtin its descriptors directly, so nothing in the shell has to
+// be dup'ed and restored. The stage owns the pipe ends from here on.
+static bool prepare_builtin_io(Stage *stage, const Args *command, int in_fd, int out_fd) {
+    stage->close_fds[0] = in_fd;
+    stage->close_fds[1] = out_fd;
+
+    if (!redirect_plan(&stage->plan, command->redirects, command->redirect_count,
+                       in_fd >= 0 ? in_fd : STDIN_FILENO, out_fd >= 0 ? out_fd : STDOUT_FILENO,
+                       STDERR_FILENO)) {
+        stage->status = 1;
+        close_stage_fds(stage);
+        return false;
+    }
+    stage->io.in = stage->plan.fds[STDIN_FILENO];
+    stage->io.out = stage->plan.fds[STDOUT_FILENO];
+    stage->io.err = stage->plan.fds[STDERR_FILENO];
+    return true;
+}
+
+// Run a compound command in the shell with its redirections applied to
+// the shell's own descriptors for as long as it runs
+static int run_compound(Arena *arena, const Args *command) {
+    if (command->redirect_count == 0) {
+        return execute_compound(arena, command->compound);
+    }
+
+    RedirectSave save;
+    if (!redirect_save_apply(&save, command->redirects, command->redirect_count)) {
+        return 1;
+    }
+    int status = execute_compound(arena, command->compound);
+    redirect_restore(&save);
+    return status;
+}
+
+// Run a pipeline with one or more commands, recording what each stage
+// cost in times[] when it is not NULL
+static int run_pipeline(Arena *arena, const Pipeline *pipeline, const char *text, bool background,
+                        StageTimes *times) {
+    int num_commands = pipeline->count;
+
+    // A compound command on its own runs in the shell, so what its loops
+    // assign stays set
+    if (num_commands == 1 && !background && pipeline->commands[0].compound != NULL) {
+        if (times != NULL) timing_thread_begin(&times[0]);
+        int status = run_compound(arena, &pipeline->commands[0]);
+        if (times != NULL) timing_thread_end(&times[0]);
+        return status;
+    }
+
+    // Only assignments: they set shell variables, unless the command would
+    // run in a subshell of its own
+    if (num_commands == 1 && pipeline->commands[0].count == 0 && pipeline->commands[0].compound == NULL) {
+        const Args *command = &pipeline->commands[0];
+        for (int i = 0; i < command->assign_count && !background; i++) {
+            var_assign(command->assigns[i], 0);
         }
+        return 0;
     }
-    
-    // Create pipes (n commands need n-1 pipes
+
+    // A single builtin needs no pipes and no process
+    if (num_commands == 1 && !background && find_builtin(pipeline->commands[0].args[0]) != NULL) {
+        if (times == NULL) {
+            return execute_builtin(&pipeline->commands[0]);
+        }
+        timing_thread_begin(&times[0]);
+        int status = execute_builtin(&pipeline->commands[0]);
+        timing_thread_end(&times[0]);
+        return status;
+    }
+
+    // n commands need n-1 pipes
     int num_pipes = num_commands - 1;
-    int (*pipefds)[2] = malloc(num_pipes * sizeof(int[2]));
-    if (pipefds == NULL) {
+    int (*pipefds)[2] = NULL;
+    Stage *stages = arena_alloc(arena, num_commands * sizeof(Stage));
+    pid_t *pids = arena_alloc(arena, num_commands * sizeof(pid_t));
+    if (num_pipes > 0) {
+        pipefds = arena_alloc(arena, num_pipes * sizeof(int[2]));
+    }
+    if ((num_pipes > 0 && pipefds == NULL) || stages == NULL || pids == NULL) {
         perror("malloc");
-        for (int i = 0; i < num_commands; i++) {
-            free_arguments(&args_array[i]);
-        }
-        free(args_array);
-        return;
+        return 1;
     }
-    
+
     // Create all pipes
     for (int i = 0; i < num_pipes; i++) {
-        if (pipe(pipefds[i]) == -1) {
+        if (pipe2(pipefds[i], O_CLOEXEC) == -1) {
             perror("pipe");
             // Close already created pipes
             for (int j = 0; j < i; j++) {
                 close(pipefds[j][0]);
                 close(pipefds[j][1]);
             }
-            for (int j = 0; j < num_commands; j++) {
-                free_arguments(&args_array[j]);
-            }
-            free(pipefds);
-            free(args_array);
-            return;
+            return 1;
         }
     }
-    
-    // Fork processes for each command
-    pid_t *pids = malloc(num_commands * sizeof(pid_t));
-    if (pids == NULL) {
-        perror("malloc");
-        for (int i = 0; i < num_pipes; i++) {
-            close(pipefds[i][0]);
-            close(pipefds[i][1]);
-        }
-        for (int i = 0; i < num_commands; i++) {
-            free_arguments(&args_array[i]);
+
+    bool has_external = false;
+    for (int i = 0; i < num_commands; i++) {
+        Stage *stage = &stages[i];
+        memset(stage, 0, sizeof(Stage));
+        stage->kind = STAGE_NONE;
+        stage->argv = pipeline->commands[i].args;
+        stage->builtin = stage->argv[0] != NULL ? find_builtin(stage->argv[0]) : NULL;
+        stage->close_fds[0] = stage->close_fds[1] = -1;
+        stage->times = times != NULL ? &times[i] : NULL;
+        if (stage->builtin == NULL && (stage->argv[0] != NULL || pipeline->commands[i].compound != NULL)) {
+            has_external = true;
         }
-        free(pipefds);
-        free(args_array);
-        return;
     }
-    
-    // Fork all processes
+
+    // build the cached environment now, while no helper thread can be
+    // spawning from it
+    vars_environ();
+
+    // Under job control Ctrl+Z must stop the whole pipeline, which a builtin
+    // in the shell blocked on a stopped process's pipe cannot do
+    bool fork_builtins = background || (has_external && job_control_enabled());
     for (int i = 0; i < num_commands; i++) {
-        pids[i] = fork();
-        
-        if (pids[i] == -1) {
-            perror("fork");
-            // Close all pipes
-            for (int j = 0; j < num_pipes; j++) {
-                close(pipefds[j][0]);
-                close(pipefds[j][1]);
-            }
-            // Wait for already forked processes
-            for (int j = 0; j < i; j++) {
-                waitpid(pids[j], NULL, 0);
-            }
-            for (int j = 0; j < num_commands; j++) {
-                free_arguments(&args_array[j]);
-            }
-            free(pids);
-            free(pipefds);
-            free(args_array);
-            return;
+        stages[i].in_shell = runs_in_shell(&stages[i], fork_builtins);
+    }
+
+    // without job control a background job must not read the terminal
+    int null_fd = -1;
+    if (background && !job_control_enabled()) {
+        null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+
+    // Start processes first, before any builtin thread: the first process
+    // started leads the pipeline's process group and the others join it.
+    pid_t pgid = job_new_pgid();
+    for (int i = 0; i < num_commands; i++) {
+        Stage *stage = &stages[i];
+        const Args *command = &pipeline->commands[i];
+        int in_fd = i > 0 ? pipefds[i - 1][0] : null_fd;
+        int out_fd = i < num_commands - 1 ? pipefds[i][1] : -1;
+
+        if (command->compound != NULL) {
+            start_forked_builtin(arena, stage, command, in_fd, out_fd, pipefds, num_pipes, pgid);
+        } else if (stage->argv[0] == NULL) {
+            // a stage whose words all expanded to nothing
+            stage->status = 0;
+        } else if (stage->builtin == NULL) {
+            start_external(arena, stage, command, in_fd, out_fd, pgid);
+        } else if (!stage->in_shell) {
+            start_forked_builtin(arena, stage, command, in_fd, out_fd, pipefds, num_pipes, pgid);
         }
-        
-        if (pids[i] == 0) {
-            // Child process for command i
-            
-            // Close all pipe ends that this process doesn't need
-            for (int j = 0; j < num_pipes; j++) {
-                // Close read end of pipe j if not the one we need (i-1)
-                if (j != i - 1) {
-                    close(pipefds[j][0]);
-                }
-                // Close write end of pipe j if not the one we need (i)
-                if (j != i) {
-                    close(pipefds[j][1]);
-                }
-            }
-            
-            // Set up stdin redirection
-            if (i > 0) {
-                // Not the first command: read from previous pipe
-                dup2(pipefds[i - 1][0], STDIN_FILENO);
-                close(pipefds[i - 1][0]);
-            }
-            // First command uses original stdin (no redirection needed)
-            
-            // Set up stdout redirection
-            int original_fd = -1;
-            if (i < num_commands - 1) {
-                // Not the last command: write to next pipe
-                dup2(pipefds[i][1], STDOUT_FILENO);
-                close(pipefds[i][1]);
-            } else {
-                // Last command: apply output redirection if specified
-                if (args_array[i].output_redirect.filename != NULL) {
-                    original_fd = apply_redirection(&args_array[i].output_redirect);
-                }
-            }
-            
-            // Execute the command (same logic for all commands)
-            cmd_handler_t handler = find_builtin_handler(args_array[i].args[0]);
-            
-            if (handler != NULL) {
-                // Execute builtin
-                handler((char **)args_array[i].args);
-                if (original_fd >= 0) {
-                    restore_fd(original_fd, args_array[i].output_redirect.fd_type);
-                }
-                // Free all arguments
-                for (int j = 0; j < num_commands; j++) {
-                    free_arguments(&args_array[j]);
-                }
-                free(args_array);
-                free(pipefds);
-                free(pids);
-                exit(0);
-            } else {
-                // Execute external command
-                char *fullpath = find_command_in_path(args_array[i].args[0]);
-                if (fullpath != NULL) {
-                    execvp(fullpath, (char **)args_array[i].args);
-                    perror(args_array[i].args[0]);
-                    free(fullpath);
-                } else {
-                    printf("%s: command not found\n", args_array[i].args[0]);
-                }
-                if (original_fd >= 0) {
-                    restore_fd(original_fd, args_array[i].output_redirect.fd_type);
-                }
-                // Free all arguments
-                for (int j = 0; j < num_commands; j++) {
-                    free_arguments(&args_array[j]);
-                }
-                free(args_array);
-                free(pipefds);
-                free(pids);
-                exit(1);
+
+        if (stage->kind == STAGE_PROCESS && pgid == 0) {
+            pgid = stage->pid;
+            if (!background) {
+                job_give_terminal(pgid);
             }
         }
     }
-    
-    // Parent process: close all pipe ends
+
+    if (null_fd >= 0) {
+        close(null_fd);
+    }
+
+    // Builtins before the last stage run on helper threads
+    for (int i = 0; i < num_commands - 1; i++) {
+        Stage *stage = &stages[i];
+        if (!stage->in_shell) continue;
+
+        int in_fd = i > 0 ? pipefds[i - 1][0] : -1;
+        if (!prepare_builtin_io(stage, &pipeline->commands[i], in_fd, pipefds[i][1])) continue;
+        if (pthread_create(&stage->thread, NULL, run_builtin_thread, stage) != 0) {
+            perror("pthread_create");
+            stage->status = 1;
+            close_stage_fds(stage);
+            continue;
+        }
+        stage->kind = STAGE_THREAD;
+    }
+
+    // Parent process: close the pipe ends no builtin in the shell owns
     for (int i = 0; i < num_pipes; i++) {
-        close(pipefds[i][0]);
-        close(pipefds[i][1]);
+        if (!stages[i + 1].in_shell) close(pipefds[i][0]);
+        if (!stages[i].in_shell) close(pipefds[i][1]);
     }
-    
-    // Wait for all child processes to complete
+
+    int num_pids = 0;
     for (int i = 0; i < num_commands; i++) {
-        waitpid(pids[i], NULL, 0);
+        pids[i] = stages[i].kind == STAGE_PROCESS ? stages[i].pid : 0;
+        if (pids[i] > 0) num_pids++;
+    }
+
+    Stage *last = &stages[num_commands - 1];
+    if (background) {
+        if (num_pids == 0) {
+            return last->status;
+        }
+        job_add_background(pgid, pids, num_commands, text);
+        return 0;
+    }
+
+    // A builtin as the last stage runs in the shell itself
+    if (last->in_shell &&
+        prepare_builtin_io(last, &pipeline->commands[num_commands - 1], pipefds[num_pipes - 1][0], -1)) {
+        if (last->times != NULL) timing_thread_begin(last->times);
+        TRACE_BEGIN(start);
+        last->status = last->builtin->handler(last->argv, &last->io);
+        outbuf_flush();
+        TRACE_END(TRACE_BUILTIN, start);
+        close_stage_fds(last);
+        if (last->times != NULL) timing_thread_end(last->times);
+        last->kind = STAGE_SHELL;
+    }
+
+    // Wait for every stage to complete, the last one gives the status
+    if (num_pids > 0) {
+        int *statuses = arena_alloc(arena, num_commands * sizeof(int));
+        if (statuses == NULL) {
+            perror("malloc");
+            return 1;
+        }
+        job_wait_foreground(pgid, pids, num_commands, statuses, times, text);
+        for (int i = 0; i < num_commands; i++) {
+            if (statuses[i] == -1) continue;
+            if (WIFSTOPPED(statuses[i])) {
+                stages[i].status = 128 + WSTOPSIG(statuses[i]);
+            } else {
+                stages[i].status = exit_status_from_wait(statuses[i]);
+            }
+        }
     }
-    
-    // Free all resources
     for (int i = 0; i < num_commands; i++) {
-        free_arguments(&args_array[i]);
+        if (stages[i].kind == STAGE_THREAD) {
+            pthread_join(stages[i].thread, NULL);
+        }
     }
-    free(args_array);
-    free(pipefds);
-    free(pids);
+
+    return last->status;
+}
+
+int execute_pipeline(Arena *arena, const Pipeline *pipeline, const char *text, bool background) {
+    // expansions are done each time the pipeline runs, never by the parser
+    Pipeline expanded = *pipeline;
+    expanded.commands = expand_commands(arena, pipeline->commands, pipeline->count);
+    if (pipeline->count > 0 && expanded.commands == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    pipeline = &expanded;
+
+    // a background pipeline is not waited for, so there is nothing to time
+    if (!pipeline->timed || background) {
+        return pipeline->count > 0 ? run_pipeline(arena, pipeline, text, background, NULL) : 0;
+    }
+
+    StageTimes *times = NULL;
+    if (pipeline->count > 0) {
+        times = arena_alloc(arena, pipeline->count * sizeof(StageTimes));
+        if (times == NULL) {
+            perror("malloc");
+            return 1;
+        }
+        memset(times, 0, pipeline->count * sizeof(StageTimes));
+    }
+
+    TimingStart start;
+    timing_start(&start);
+    int status = pipeline->count > 0 ? run_pipeline(arena, pipeline, text, false, times) : 0;
+    timing_report(&start, times, pipeline);
+    return status;
 }
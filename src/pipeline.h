@@ -2,11 +2,13 @@
 #define PIPELINE_H
 
 #include "common.h"
-
-// Check if the input contains a pipeline operator (|)
-int has_pipeline(const char *input);
-
-// Execute a pipeline with two commands
-void execute_pipeline(const char *input);
+#include "arena.h"
+#include "parser.h"
+
+// Execute a pipeline, returning the exit status of its last command.
+// text is the pipeline as written, shown if it becomes a job. A background
+// pipeline is registered as a job and 0 is returned without waiting. A
+// pipeline prefixed by "time" reports its cost on stderr when it is done.
+int execute_pipeline(Arena *arena, const Pipeline *pipeline, const char *text, bool background);
 
 #endif
@@ -0,0 +1,235 @@
+#include "plancache.h"
+#include "outbuf.h"
+#include "arena.h"
+#include "lexer.h"
+
+#define PLAN_BUCKETS 256
+
+// when this many lines are kept every plan is dropped and the cache starts
+// over, as the directory cache does
+#define PLAN_MAX_PLANS 512
+
+// longer lines, typically with big here-documents, are parsed every time
+#define PLAN_MAX_LINE 8192
+
+typedef struct Plan {
+    char *line;
+    unsigned int hash;
+    Arena arena;        // the copied CommandList and everything it points to
+    CommandList list;
+    unsigned long cache_generation;
+    struct Plan *next;
+} Plan;
+
+static Plan *buckets[PLAN_BUCKETS];
+static int plan_count = 0;
+
+// bumped by "plancache -r"; older plans are dropped when next met, never
+// while one of them may be running
+static unsigned long cache_generation = 1;
+
+static unsigned long hits = 0;
+static unsigned long misses = 0;
+
+static void free_plan(Plan *plan) {
+    arena_free(&plan->arena);
+    free(plan->line);
+    free(plan);
+    plan_count--;
+}
+
+static void drop_all(void) {
+    for (int i = 0; i < PLAN_BUCKETS; i++) {
+        Plan *plan = buckets[i];
+        buckets[i] = NULL;
+        while (plan != NULL) {
+            Plan *next = plan->next;
+            free_plan(plan);
+            plan = next;
+        }
+    }
+}
+
+const CommandList *plan_lookup(const char *line) {
+    unsigned int hash = hash_string(line);
+    for (Plan **link = &buckets[hash % PLAN_BUCKETS]; *link != NULL; link = &(*link)->next) {
+        Plan *plan = *link;
+        if (plan->hash != hash || strcmp(plan->line, line) != 0) continue;
+
+        if (plan->cache_generation != cache_generation) {
+            *link = plan->next;
+            free_plan(plan);
+            break;
+        }
+        hits++;
+        return &plan->list;
+    }
+    misses++;
+    return NULL;
+}
+
+static char **copy_words(Arena *arena, char **words, int count) {
+    if (words == NULL) return NULL;
+    char **copy = arena_alloc(arena, (count + 1) * sizeof(char *));
+    if (copy == NULL) return NULL;
+    for (int i = 0; i < count; i++) {
+        copy[i] = arena_strdup(arena, words[i]);
+        if (copy[i] == NULL) return NULL;
+    }
+    copy[count] = NULL;
+    return copy;
+}
+
+// Give a command whose name is a plain word somewhere to keep its program.
+// Nothing is looked up yet: a command in a branch that never runs costs
+// no lookup and leaves no entry in the hash table.
+static bool add_path_cache(Arena *arena, Args *command) {
+    if (command->count == 0) return true;
+
+    const char *name = command->args[0];
+    if (strpbrk(name, (const char[]){WORD_EXPAND, WORD_EXPAND_QUOTED, WORD_ESCAPE, '*', '?', '[', '\0'}) != NULL) {
+        return true;
+    }
+    command->path_cache = arena_alloc(arena, sizeof(PathCache));
+    if (command->path_cache == NULL) return false;
+    command->path_cache->entry = NULL;
+    command->path_cache->generation = 0;
+    return true;
+}
+
+static bool copy_list(Arena *arena, const CommandList *from, CommandList *to, const char *source);
+
+// an if, loop or case command, with every list inside it
+static Compound *copy_compound(Arena *arena, const Compound *from, const char *source) {
+    Compound *to = arena_alloc(arena, sizeof(Compound));
+    if (to == NULL) return NULL;
+    *to = *from;
+
+    if (from->part_count > 0) {
+        to->parts = arena_alloc(arena, from->part_count * sizeof(CommandList));
+        if (to->parts == NULL) return NULL;
+        for (int i = 0; i < from->part_count; i++) {
+            if (!copy_list(arena, &from->parts[i], &to->parts[i], source)) return NULL;
+        }
+    }
+    if (from->name != NULL && (to->name = arena_strdup(arena, from->name)) == NULL) return NULL;
+    if (from->subject != NULL && (to->subject = arena_strdup(arena, from->subject)) == NULL) return NULL;
+    to->words = copy_words(arena, from->words, from->word_count);
+    if (from->words != NULL && to->words == NULL) return NULL;
+
+    if (from->item_count > 0) {
+        to->items = arena_alloc(arena, from->item_count * sizeof(CaseItem));
+        if (to->items == NULL) return NULL;
+        for (int i = 0; i < from->item_count; i++) {
+            int count = 0;
+            while (from->items[i].patterns[count] != NULL) count++;
+            to->items[i].patterns = copy_words(arena, from->items[i].patterns, count);
+            if (to->items[i].patterns == NULL ||
+                !copy_list(arena, &from->items[i].body, &to->items[i].body, source)) {
+                return NULL;
+            }
+        }
+    }
+    return to;
+}
+
+static bool copy_command(Arena *arena, const Args *from, Args *to, const char *source) {
+    *to = *from;
+    to->args = copy_words(arena, from->args, from->count);
+    to->assigns = copy_words(arena, from->assigns, from->assign_count);
+    if (to->args == NULL || (from->assigns != NULL && to->assigns == NULL)) return false;
+
+    if (from->redirect_count > 0) {
+        to->redirects = arena_alloc(arena, from->redirect_count * sizeof(Redirection));
+        if (to->redirects == NULL) return false;
+        for (int i = 0; i < from->redirect_count; i++) {
+            to->redirects[i] = from->redirects[i];
+            if (from->redirects[i].filename == NULL) continue;
+            to->redirects[i].filename = arena_strdup(arena, from->redirects[i].filename);
+            if (to->redirects[i].filename == NULL) return false;
+        }
+    }
+    if (from->compound != NULL) {
+        to->compound = copy_compound(arena, from->compound, source);
+        return to->compound != NULL;
+    }
+    return add_path_cache(arena, to);
+}
+
+static bool copy_list(Arena *arena, const CommandList *from, CommandList *to, const char *source) {
+    *to = *from;
+    // job listings show text from the kept line
+    to->source = source;
+    to->items = arena_alloc(arena, (from->count > 0 ? from->count : 1) * sizeof(ListItem));
+    if (to->items == NULL) return false;
+
+    for (int i = 0; i < from->count; i++) {
+        const Pipeline *pipeline = &from->items[i].pipeline;
+        to->items[i] = from->items[i];
+        if (pipeline->count == 0) continue;
+
+        Args *commands = arena_alloc(arena, pipeline->count * sizeof(Args));
+        if (commands == NULL) return false;
+        for (int j = 0; j < pipeline->count; j++) {
+            if (!copy_command(arena, &pipeline->commands[j], &commands[j], source)) return false;
+        }
+        to->items[i].pipeline.commands = commands;
+    }
+    return true;
+}
+
+const CommandList *plan_store(const char *line, const CommandList *list) {
+    size_t len = strlen(line);
+    if (len > PLAN_MAX_LINE || list->incomplete) return NULL;
+
+    if (plan_count >= PLAN_MAX_PLANS) {
+        drop_all();
+    }
+
+    Plan *plan = calloc(1, sizeof(Plan));
+    if (plan == NULL) return NULL;
+    plan->line = strdup(line);
+    plan_count++;
+    if (plan->line == NULL || !copy_list(&plan->arena, list, &plan->list, plan->line)) {
+        free_plan(plan);
+        return NULL;
+    }
+    plan->hash = hash_string(line);
+    plan->cache_generation = cache_generation;
+
+    unsigned int bucket = plan->hash % PLAN_BUCKETS;
+    plan->next = buckets[bucket];
+    buckets[bucket] = plan;
+    return &plan->list;
+}
+
+int handle_plancache(char **argv, const BuiltinIO *io) {
+    bool reset = false;
+    for (int i = 1; argv[i] != NULL; i++) {
+        if (strcmp(argv[i], "-c") == 0) {
+            reset = true;
+        } else if (strcmp(argv[i], "-r") == 0) {
+            cache_generation++;
+        } else {
+            outbuf_printf(io->err, "plancache: usage: plancache [-c] [-r]\n");
+            return 2;
+        }
+    }
+
+    if (reset) {
+        hits = 0;
+        misses = 0;
+    } else if (argv[1] == NULL) {
+        int current = 0;
+        for (int i = 0; i < PLAN_BUCKETS; i++) {
+            for (Plan *plan = buckets[i]; plan != NULL; plan = plan->next) {
+                if (plan->cache_generation == cache_generation) current++;
+            }
+        }
+        unsigned long lookups = hits + misses;
+        outbuf_printf(io->out, "plans\thits\tmisses\thit rate\n");
+        outbuf_printf(io->out, "%d\t%lu\t%lu\t%.1f%%\n", current, hits, misses,
+                      lookups > 0 ? 100.0 * hits / lookups : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef PLANCACHE_H
+#define PLANCACHE_H
+
+#include "common.h"
+#include "parser.h"
+
+// Parsed command lines kept by their text, so a line run again (from a
+// script, the history or a loop) is not tokenized and parsed again. A
+// plan also remembers the program each command name resolved to on its
+// first run, used while hash_generation() is unchanged. Expansions are
+// kept as written and done on every run, so they never make a plan stale.
+
+// The plan for a line, or NULL if it has none. Counts a hit or a miss.
+const CommandList *plan_lookup(const char *line);
+
+// Keep a copy of a successfully parsed line and return it, or NULL if the
+// line is not worth keeping. Command paths are not resolved here: each
+// command carries a PathCache the pipeline fills on its first run. The
+// copy is freed only when plan_store starts the cache over at 512 plans,
+// or when plan_lookup finds it left over from before a "plancache -r".
+const CommandList *plan_store(const char *line, const CommandList *list);
+
+// plancache [-c] [-r]: show the hit and miss counts, -c resets them and
+// -r forgets every plan
+int handle_plancache(char **argv, const BuiltinIO *io);
+
+#endif
@@ -0,0 +1,215 @@
+#include "prompt.h"
+#include "jobs.h"
+#include "shell.h"
+#include "vars.h"
+#include "workdir.h"
+#include <pwd.h>
+#include <readline/readline.h>
+
+// shown when PS1 or PS2 is not set
+#define DEFAULT_PS1 "$ "
+#define DEFAULT_PS2 "> "
+
+// what a rendered prompt showed, so it is only rendered again on a change
+#define SHOWS_DIR 0x1
+#define SHOWS_STATUS 0x2
+#define SHOWS_JOBS 0x4
+#define SHOWS_DURATION 0x8
+
+typedef struct {
+    char *template;     // the PS1 or PS2 text it came from
+    char *text;
+    int shows;
+    unsigned long workdir_generation;
+    char *home;
+    int status;
+    int jobs;
+    double duration;
+} RenderedPrompt;
+
+static RenderedPrompt rendered[2];
+
+static char user[256] = "";
+static char host[256] = "";
+static bool root = false;
+static double last_duration = 0;
+
+void prompt_init(void) {
+    struct passwd *pw = getpwuid(geteuid());
+    const char *name = pw != NULL ? pw->pw_name : var_get("USER");
+    snprintf(user, sizeof(user), "%s", name != NULL ? name : "");
+    if (gethostname(host, sizeof(host)) != 0) {
+        host[0] = '\0';
+    }
+    host[sizeof(host) - 1] = '\0';
+    root = geteuid() == 0;
+}
+
+void prompt_set_duration(double seconds) {
+    last_duration = seconds;
+}
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+} Text;
+
+static void text_add(Text *text, const char *s, size_t len) {
+    if (text->len + len + 1 > text->capacity) {
+        size_t capacity = text->capacity ? text->capacity * 2 : 64;
+        while (text->len + len + 1 > capacity) capacity *= 2;
+        char *grown = realloc(text->data, capacity);
+        if (grown == NULL) return;
+        text->data = grown;
+        text->capacity = capacity;
+    }
+    memcpy(text->data + text->len, s, len);
+    text->len += len;
+    text->data[text->len] = '\0';
+}
+
+static void text_add_str(Text *text, const char *s) {
+    text_add(text, s, strlen(s));
+}
+
+// The working directory with a leading $HOME shown as ~
+static void add_dir(Text *text, const char *home, bool last_name) {
+    const char *dir = workdir_get();
+    if (dir == NULL) return;
+
+    size_t home_len = home != NULL ? strlen(home) : 0;
+    bool in_home = home_len > 1 && strncmp(dir, home, home_len) == 0 &&
+                   (dir[home_len] == '\0' || dir[home_len] == '/');
+    if (last_name) {
+        const char *slash = strrchr(dir, '/');
+        if (in_home && dir[home_len] == '\0') {
+            text_add_str(text, "~");
+        } else {
+            text_add_str(text, slash != NULL && slash[1] != '\0' ? slash + 1 : dir);
+        }
+    } else if (in_home) {
+        text_add_str(text, "~");
+        text_add_str(text, dir + home_len);
+    } else {
+        text_add_str(text, dir);
+    }
+}
+
+static void render(RenderedPrompt *prompt, const char *template, const char *home) {
+    Text text = {NULL, 0, 0};
+    char number[32];
+    prompt->shows = 0;
+
+    for (const char *p = template; *p != '\0'; p++) {
+        if (*p != '\\' || p[1] == '\0') {
+            text_add(&text, p, 1);
+            continue;
+        }
+        p++;
+        switch (*p) {
+        case 'w':
+        case 'W':
+            add_dir(&text, home, *p == 'W');
+            prompt->shows |= SHOWS_DIR;
+            break;
+        case 'u':
+            text_add_str(&text, user);
+            break;
+        case 'h':
+            text_add(&text, host, strcspn(host, "."));
+            break;
+        case 'H':
+            text_add_str(&text, host);
+            break;
+        case '$':
+            text_add_str(&text, root ? "#" : "$");
+            break;
+        case '?':
+            snprintf(number, sizeof(number), "%d", shell.last_status);
+            text_add_str(&text, number);
+            prompt->shows |= SHOWS_STATUS;
+            break;
+        case 'j':
+            snprintf(number, sizeof(number), "%d", jobs_count());
+            text_add_str(&text, number);
+            prompt->shows |= SHOWS_JOBS;
+            break;
+        case 'D':
+            if (last_duration < 60) {
+                snprintf(number, sizeof(number), "%.2fs", last_duration);
+            } else {
+                snprintf(number, sizeof(number), "%dm%02ds", (int)last_duration / 60, (int)last_duration % 60);
+            }
+            text_add_str(&text, number);
+            prompt->shows |= SHOWS_DURATION;
+            break;
+        case 'n':
+            text_add_str(&text, "\n");
+            break;
+        case 'e':
+            text_add_str(&text, "\033");
+            break;
+        case 'a':
+            text_add_str(&text, "\a");
+            break;
+        case '[':
+            text_add_str(&text, (char[]){RL_PROMPT_START_IGNORE, '\0'});
+            break;
+        case ']':
+            text_add_str(&text, (char[]){RL_PROMPT_END_IGNORE, '\0'});
+            break;
+        case '\\':
+            text_add_str(&text, "\\");
+            break;
+        default:
+            // not an escape: both characters as they are
+            text_add(&text, p - 1, 2);
+            break;
+        }
+    }
+
+    free(prompt->text);
+    prompt->text = text.data != NULL ? text.data : strdup("");
+}
+
+// Whether what a rendered prompt shows is still the same
+static bool still_valid(const RenderedPrompt *prompt, const char *template, const char *home) {
+    if (prompt->text == NULL || strcmp(prompt->template, template) != 0) return false;
+    if (prompt->shows & SHOWS_DIR) {
+        if (prompt->workdir_generation != workdir_generation()) return false;
+        if ((prompt->home == NULL) != (home == NULL)) return false;
+        if (home != NULL && strcmp(prompt->home, home) != 0) return false;
+    }
+    if ((prompt->shows & SHOWS_STATUS) && prompt->status != shell.last_status) return false;
+    if ((prompt->shows & SHOWS_JOBS) && prompt->jobs != jobs_count()) return false;
+    if ((prompt->shows & SHOWS_DURATION) && prompt->duration != last_duration) return false;
+    return true;
+}
+
+const char *prompt_get(bool continue_line) {
+    const char *template = var_get(continue_line ? "PS2" : "PS1");
+    if (template == NULL) {
+        template = continue_line ? DEFAULT_PS2 : DEFAULT_PS1;
+    }
+    const char *home = var_get("HOME");
+
+    RenderedPrompt *prompt = &rendered[continue_line];
+    if (still_valid(prompt, template, home)) {
+        return prompt->text;
+    }
+
+    char *template_copy = strdup(template);
+    char *home_copy = home != NULL ? strdup(home) : NULL;
+    if (template_copy == NULL) return template;
+    free(prompt->template);
+    free(prompt->home);
+    prompt->template = template_copy;
+    prompt->home = home_copy;
+    prompt->workdir_generation = workdir_generation();
+    prompt->status = shell.last_status;
+    prompt->jobs = jobs_count();
+    prompt->duration = last_duration;
+    render(prompt, template, home);
+    return prompt->text;
+}
@@ -0,0 +1,28 @@
+#ifndef PROMPT_H
+#define PROMPT_H
+
+#include "common.h"
+
+// Look up what the prompt may show but never changes during the session:
+// user name, host name, whether the shell runs as root
+void prompt_init(void);
+
+// Record how long the last command line took, for \D
+void prompt_set_duration(double seconds);
+
+// The prompt to show: PS1, or PS2 when continue_line is set, with its
+// backslash escapes replaced:
+//   \w \W  working directory with $HOME as ~, and its last name
+//   \u \h \H  user, short and full host name
+//   \$  # for root, $ otherwise
+//   \?  exit status of the last command
+//   \j  number of jobs
+//   \D  duration of the last command line, like 1.25s
+//   \n \e \a \\ \[ \]  newline, escape, bell, backslash, and the start
+//                      and end of characters that take no room
+// Everything comes from state the shell already keeps, and the text is
+// only rendered again when something it shows changed. Valid until the
+// next call.
+const char *prompt_get(bool continue_line);
+
+#endif
@@ -0,0 +1,240 @@
+#include "redirect.h"
+#include "trace.h"
+#include <errno.h>
+#include <sys/mman.h>
+
+// write all of data, retrying short writes
+static bool write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        len -= written;
+    }
+    return true;
+}
+
+// Stage text so that reading the descriptor returned yields it
+static int stage_text(const char *text, const char *suffix) {
+    size_t len = strlen(text);
+    size_t suffix_len = strlen(suffix);
+
+    // an empty pipe takes PIPE_BUF bytes without a reader, so the shell
+    // can fill it before the command even starts
+    if (len + suffix_len <= PIPE_BUF) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) == -1) {
+            perror("pipe");
+            return -1;
+        }
+        if (!write_all(fds[1], text, len) || !write_all(fds[1], suffix, suffix_len)) {
+            perror("write");
+            close(fds[0]);
+            close(fds[1]);
+            return -1;
+        }
+        close(fds[1]);
+        return fds[0];
+    }
+
+    int fd = memfd_create("heredoc", MFD_CLOEXEC);
+    if (fd == -1) {
+        perror("memfd_create");
+        return -1;
+    }
+    if (!write_all(fd, text, len) || !write_all(fd, suffix, suffix_len) ||
+        lseek(fd, 0, SEEK_SET) == -1) {
+        perror("write");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int redirect_open(const Redirection *redirect) {
+    TRACE_BEGIN(start);
+    int fd;
+    switch (redirect->kind) {
+        case REDIRECT_HEREDOC:
+            fd = stage_text(redirect->filename, "");
+            break;
+        case REDIRECT_HERESTRING:
+            // a here-string gets the newline a line of input would have
+            fd = stage_text(redirect->filename, "\n");
+            break;
+        case REDIRECT_INPUT:
+            fd = open(redirect->filename, O_RDONLY | O_CLOEXEC);
+            if (fd == -1) {
+                perror(redirect->filename);
+            }
+            break;
+        default:
+            fd = open(redirect->filename, O_WRONLY | O_CREAT | O_CLOEXEC | (redirect->append ? O_APPEND : O_TRUNC),
+                      0644);
+            if (fd == -1) {
+                perror(redirect->filename);
+            }
+            break;
+    }
+    TRACE_END(TRACE_REDIRECT, start);
+    return fd;
+}
+
+// a slot from 3 up no redirection has set: the shell's own descriptor of
+// that number, looked up only when a duplication names it
+#define SLOT_UNRESOLVED -2
+
+bool redirect_fd_inherited(int fd) {
+    int flags = fcntl(fd, F_GETFD);
+    return flags >= 0 && !(flags & FD_CLOEXEC);
+}
+
+// The descriptor behind a slot: one the shell has open stands for itself
+// when a program it started would inherit it
+static int slot_fd(RedirectPlan *plan, int slot) {
+    if (plan->fds[slot] == SLOT_UNRESOLVED) {
+        plan->fds[slot] = redirect_fd_inherited(slot) ? slot : -1;
+    }
+    return plan->fds[slot];
+}
+
+// stop using a table slot, closing its file unless another slot shares it
+static void release_slot(RedirectPlan *plan, int slot) {
+    if (plan->owned[slot]) {
+        plan->owned[slot] = false;
+        bool shared = false;
+        for (int i = 0; i < REDIRECT_FDS && !shared; i++) {
+            if (i != slot && plan->fds[i] == plan->fds[slot]) {
+                plan->owned[i] = true;
+                shared = true;
+            }
+        }
+        if (!shared) {
+            close(plan->fds[slot]);
+        }
+    }
+    plan->fds[slot] = -1;
+}
+
+bool redirect_plan(RedirectPlan *plan, const Redirection *redirects, int count, int in, int out, int err) {
+    for (int i = 0; i < REDIRECT_FDS; i++) {
+        plan->fds[i] = SLOT_UNRESOLVED;
+        plan->owned[i] = false;
+    }
+    plan->fds[STDIN_FILENO] = in;
+    plan->fds[STDOUT_FILENO] = out;
+    plan->fds[STDERR_FILENO] = err;
+
+    for (int i = 0; i < count; i++) {
+        const Redirection *redirect = &redirects[i];
+        int slot = redirect->fd_type;
+
+        if (redirect->kind == REDIRECT_DUP) {
+            int source = slot_fd(plan, redirect->source_fd);
+            if (source < 0) {
+                fprintf(stderr, "%d: Bad file descriptor\n", redirect->source_fd);
+                redirect_plan_close(plan);
+                return false;
+            }
+            if (redirect->source_fd != slot) {
+                release_slot(plan, slot);
+                plan->fds[slot] = source;
+            }
+        } else if (redirect->kind == REDIRECT_CLOSE) {
+            release_slot(plan, slot);
+        } else {
+            int fd = redirect_open(redirect);
+            if (fd < 0) {
+                redirect_plan_close(plan);
+                return false;
+            }
+            release_slot(plan, slot);
+            plan->fds[slot] = fd;
+            plan->owned[slot] = true;
+        }
+    }
+    return true;
+}
+
+void redirect_plan_close(RedirectPlan *plan) {
+    // only one slot owns each file, however many share it
+    for (int i = 0; i < REDIRECT_FDS; i++) {
+        if (plan->owned[i]) {
+            close(plan->fds[i]);
+            plan->owned[i] = false;
+        }
+    }
+}
+
+bool redirect_apply(const Redirection *redirects, int count) {
+    for (int i = 0; i < count; i++) {
+        const Redirection *redirect = &redirects[i];
+
+        if (redirect->kind == REDIRECT_CLOSE) {
+            close(redirect->fd_type);
+            continue;
+        }
+        if (redirect->kind == REDIRECT_DUP) {
+            // earlier redirections here have already made theirs inheritable
+            if (!redirect_fd_inherited(redirect->source_fd)) {
+                fprintf(stderr, "%d: %s\n", redirect->source_fd, strerror(EBADF));
+                return false;
+            }
+            if (dup2(redirect->source_fd, redirect->fd_type) == -1) {
+                fprintf(stderr, "%d: %s\n", redirect->source_fd, strerror(errno));
+                return false;
+            }
+            continue;
+        }
+
+        int fd = redirect_open(redirect);
+        if (fd < 0) return false;
+        if (fd != redirect->fd_type) {
+            dup2(fd, redirect->fd_type);
+            close(fd);
+        } else {
+            // opened right onto its number: keep it across an exec
+            fcntl(fd, F_SETFD, 0);
+        }
+    }
+    return true;
+}
+
+bool redirect_save_apply(RedirectSave *save, const Redirection *redirects, int count) {
+    for (int i = 0; i < REDIRECT_FDS; i++) {
+        save->saved[i] = -1;
+        save->touched[i] = false;
+    }
+    for (int i = 0; i < count; i++) {
+        int fd = redirects[i].fd_type;
+        if (save->touched[fd]) continue;
+        // above the descriptors a redirection can name, and not inherited
+        save->saved[fd] = fcntl(fd, F_DUPFD_CLOEXEC, REDIRECT_FDS);
+        save->touched[fd] = true;
+    }
+
+    // what the shell itself prints, like "command not found", goes there too
+    fflush(stdout);
+    if (!redirect_apply(redirects, count)) {
+        redirect_restore(save);
+        return false;
+    }
+    return true;
+}
+
+void redirect_restore(RedirectSave *save) {
+    fflush(stdout);
+    for (int i = 0; i < REDIRECT_FDS; i++) {
+        if (!save->touched[i]) continue;
+        if (save->saved[i] >= 0) {
+            dup2(save->saved[i], i);
+            close(save->saved[i]);
+        } else {
+            close(i);
+        }
+        save->touched[i] = false;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef REDIRECT_H
+#define REDIRECT_H
+
+#include "common.h"
+
+// descriptors a redirection can name: 0 to 9
+#define REDIRECT_FDS 10
+
+// Open what a file redirection points to: the file for <, > and >>, or
+// the text of a here-document or here-string staged in memory. A body
+// that fits in a pipe's buffer is written into a pipe, a larger one into
+// a memfd, so no temporary file and no writer process is needed either
+// way. Returns a close-on-exec descriptor, or -1 after reporting the
+// error on stderr.
+int redirect_open(const Redirection *redirect);
+
+// Whether fd is a descriptor of the shell's that a command may name in a
+// duplication: open, and passed on to the programs the shell starts. The
+// shell's close-on-exec descriptors (pidfds, the history file, pipe ends
+// of other stages) are its own, not the command's.
+bool redirect_fd_inherited(int fd);
+
+// What a builtin run by the shell sees through its redirections. They are
+// worked out on this table instead of being dup'ed over the shell's own
+// descriptors and restored afterwards: a file costs an open and a close,
+// a duplication or a close costs nothing.
+typedef struct {
+    int fds[REDIRECT_FDS];      // shell descriptor behind each of 0-9, -1 if closed; 3-9 are
+                                // only filled in once a duplication reads them
+    bool owned[REDIRECT_FDS];   // fds[i] was opened for the plan and closes with it
+} RedirectPlan;
+
+// Start a plan from in, out and err as 0, 1 and 2 and apply redirects in
+// order. On failure the error is reported, whatever was opened is closed
+// and false is returned.
+bool redirect_plan(RedirectPlan *plan, const Redirection *redirects, int count, int in, int out, int err);
+
+// Close the files a plan opened
+void redirect_plan_close(RedirectPlan *plan);
+
+// Apply redirects in order to the process's own descriptors. Only for a
+// forked child that will not need them back.
+bool redirect_apply(const Redirection *redirects, int count);
+
+// The shell's own descriptors a compound command's redirections replaced
+// while it runs in the shell: its commands, builtins or not, use 0-9 as
+// they are, so a plan of their own would not reach them
+typedef struct {
+    int saved[REDIRECT_FDS];    // copy of the original, -1 if it was closed
+    bool touched[REDIRECT_FDS];
+} RedirectSave;
+
+// Save the descriptors redirects change, then apply them. On failure
+// everything is put back and false is returned.
+bool redirect_save_apply(RedirectSave *save, const Redirection *redirects, int count);
+
+// Put the saved descriptors back
+void redirect_restore(RedirectSave *save);
+
+#endif
@@ -0,0 +1,32 @@
+#include "shell.h"
+
+ShellState shell = {false, 0, false, 0, 0};
+
+volatile sig_atomic_t shell_interrupted = 0;
+
+int exit_status_from_wait(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return 1;
+}
+
+// SIGPIPE is ignored so builtins writing to a closed pipe see EPIPE; the
+// rest are taken over by an interactive shell doing job control
+static const int shell_signals[] = {SIGPIPE, SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU};
+
+void shell_signal_set(sigset_t *set) {
+    sigemptyset(set);
+    for (size_t i = 0; i < sizeof(shell_signals) / sizeof(shell_signals[0]); i++) {
+        sigaddset(set, shell_signals[i]);
+    }
+}
+
+void shell_reset_signals(void) {
+    for (size_t i = 0; i < sizeof(shell_signals) / sizeof(shell_signals[0]); i++) {
+        signal(shell_signals[i], SIG_DFL);
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef SHELL_H
+#define SHELL_H
+
+#include "common.h"
+#include <signal.h>
+
+// State shared by the whole shell session
+typedef struct {
+    bool interactive;   // reading commands from a terminal through readline
+    int last_status;    // exit status of the most recent command ($?)
+    bool subshell;      // running in a forked child of the shell
+    pid_t pid;          // the shell's own pid ($$), the same in subshells
+    pid_t last_background;  // last process started in the background ($!)
+} ShellState;
+
+extern ShellState shell;
+
+// Set when Ctrl+C reaches the interactive shell or kills its foreground
+// command; the lists and loops still running stop early. Cleared before
+// each line.
+extern volatile sig_atomic_t shell_interrupted;
+
+// Turn a wait status into a shell exit status (128 + signal when killed)
+int exit_status_from_wait(int status);
+
+// Fill set with the signals the shell ignores or catches for itself
+void shell_signal_set(sigset_t *set);
+
+// Give a forked child the default disposition of those signals back
+void shell_reset_signals(void);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef SHELL_BUILTIN_H
+#define SHELL_BUILTIN_H
+
+// The interface between the shell and builtins loaded at run time with
+// "enable -f library.so name". A plugin needs this header and nothing
+// else from the shell. The structures below only ever grow at the end;
+// a change that breaks built plugins bumps SHELL_BUILTIN_ABI_VERSION, and
+// the shell refuses libraries made for another version.
+//
+// For "enable -f ./tools.so hello" the library exports a shell_builtin
+// named hello_builtin (a name's characters other than letters and digits
+// become '_'):
+//
+//     #include "shell_builtin.h"
+//     #include <stdio.h>
+//
+//     static int hello(char **argv, const shell_builtin_io *io) {
+//         dprintf(io->out, "hello %s\n", argv[1] != NULL ? argv[1] : "world");
+//         return 0;
+//     }
+//
+//     const shell_builtin hello_builtin = {SHELL_BUILTIN_ABI_VERSION, "hello", hello, 0};
+//
+// and is built with "cc -shared -fPIC -o tools.so tools.c".
+
+#define SHELL_BUILTIN_ABI_VERSION 1
+
+// the builtin changes or reads the shell itself, so inside a pipeline it
+// runs in a forked child instead of on a thread of the shell process
+#define SHELL_BUILTIN_SUBSHELL 0x1
+
+// Descriptors the builtin reads and writes. They are not 0, 1 and 2 when
+// it runs in a pipeline or with redirections, so it must not use stdio.
+typedef struct shell_builtin_io {
+    int in;
+    int out;
+    int err;
+} shell_builtin_io;
+
+// Run the builtin: argv[0] is its name and argv ends with NULL. The return
+// value is the exit status. In a pipeline this is called on a thread of
+// the shell, next to other builtins: no exit(), no process-wide state.
+typedef int (*shell_builtin_fn)(char **argv, const shell_builtin_io *io);
+
+typedef struct {
+    unsigned int abi_version;   // SHELL_BUILTIN_ABI_VERSION
+    const char *name;           // the command name it is run by
+    shell_builtin_fn run;
+    unsigned int flags;         // SHELL_BUILTIN_SUBSHELL
+} shell_builtin;
+
+#endif
@@ -0,0 +1,168 @@
+#include "spawn.h"
+#include "shell.h"
+#include "trace.h"
+#include "vars.h"
+#include "redirect.h"
+#include "outbuf.h"
+#include <spawn.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/syscall.h>
+
+// Open every file the redirections name, into opened[]. The child dup2s
+// them in order, so a file must not sit on a number an earlier redirection
+// replaces in the child: those are moved above every redirected number.
+static bool open_redirect_targets(const SpawnIO *io, int *opened) {
+    int highest = STDERR_FILENO;
+    for (int i = 0; i < io->redirect_count; i++) {
+        if (io->redirects[i].fd_type > highest) highest = io->redirects[i].fd_type;
+    }
+
+    for (int i = 0; i < io->redirect_count; i++) {
+        opened[i] = -1;
+        if (io->redirects[i].filename == NULL) continue;
+
+        int fd = redirect_open(&io->redirects[i]);
+        if (fd >= 0 && fd <= highest) {
+            int moved = fcntl(fd, F_DUPFD_CLOEXEC, highest + 1);
+            close(fd);
+            fd = moved;
+        }
+        if (fd < 0) {
+            for (int j = 0; j < i; j++) {
+                if (opened[j] >= 0) close(opened[j]);
+            }
+            return false;
+        }
+        opened[i] = fd;
+    }
+    return true;
+}
+
+// Check that every duplication names a descriptor the child will have:
+// one an earlier redirection of the command set, one wired in from a
+// pipe, or one of the shell's it inherits. dup2 in the child would
+// otherwise hand it the shell's close-on-exec descriptors.
+static bool check_dup_sources(const SpawnIO *io) {
+    enum { SLOT_UNKNOWN, SLOT_OPEN, SLOT_CLOSED } slots[REDIRECT_FDS] = {SLOT_UNKNOWN};
+    if (io->stdin_fd >= 0) slots[STDIN_FILENO] = SLOT_OPEN;
+    if (io->stdout_fd >= 0) slots[STDOUT_FILENO] = SLOT_OPEN;
+    if (io->stderr_fd >= 0) slots[STDERR_FILENO] = SLOT_OPEN;
+
+    for (int i = 0; i < io->redirect_count; i++) {
+        const Redirection *redirect = &io->redirects[i];
+        if (redirect->kind == REDIRECT_DUP) {
+            int source = redirect->source_fd;
+            if (slots[source] == SLOT_UNKNOWN) {
+                slots[source] = redirect_fd_inherited(source) ? SLOT_OPEN : SLOT_CLOSED;
+            }
+            if (slots[source] == SLOT_CLOSED) {
+                fprintf(stderr, "%d: %s\n", source, strerror(EBADF));
+                return false;
+            }
+        }
+        slots[redirect->fd_type] = redirect->kind == REDIRECT_CLOSE ? SLOT_CLOSED : SLOT_OPEN;
+    }
+    return true;
+}
+
+pid_t spawn_command(const char *path, char **argv, const SpawnIO *io) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    int redirect_count = io != NULL ? io->redirect_count : 0;
+    int *opened = NULL;
+    pid_t pid = -1;
+
+    // a builtin running the real command: what it wrote comes first
+    outbuf_flush();
+
+    if (redirect_count > 0) {
+        if (!check_dup_sources(io)) return SPAWN_REDIRECT_FAILED;
+        opened = malloc(redirect_count * sizeof(int));
+        if (opened == NULL) {
+            perror("malloc");
+            return SPAWN_REDIRECT_FAILED;
+        }
+        if (!open_redirect_targets(io, opened)) {
+            free(opened);
+            return SPAWN_REDIRECT_FAILED;
+        }
+    }
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    // signals the shell ignores or catches go back to their defaults
+    sigset_t default_signals;
+    shell_signal_set(&default_signals);
+    posix_spawnattr_setsigdefault(&attr, &default_signals);
+
+    short flags = POSIX_SPAWN_SETSIGDEF;
+    if (io != NULL && io->pgid >= 0) {
+        posix_spawnattr_setpgroup(&attr, io->pgid);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+#ifdef POSIX_SPAWN_USEVFORK
+    // glibc already shares the address space, older libcs need the hint
+    flags |= POSIX_SPAWN_USEVFORK;
+#endif
+    posix_spawnattr_setflags(&attr, flags);
+
+    if (io != NULL) {
+        if (io->stdin_fd >= 0) {
+            posix_spawn_file_actions_adddup2(&actions, io->stdin_fd, STDIN_FILENO);
+        }
+        if (io->stdout_fd >= 0) {
+            posix_spawn_file_actions_adddup2(&actions, io->stdout_fd, STDOUT_FILENO);
+        }
+        if (io->stderr_fd >= 0) {
+            posix_spawn_file_actions_adddup2(&actions, io->stderr_fd, STDERR_FILENO);
+        }
+        for (int i = 0; i < redirect_count; i++) {
+            const Redirection *redirect = &io->redirects[i];
+            if (redirect->kind == REDIRECT_CLOSE) {
+                posix_spawn_file_actions_addclose(&actions, redirect->fd_type);
+            } else if (redirect->kind == REDIRECT_DUP) {
+                posix_spawn_file_actions_adddup2(&actions, redirect->source_fd, redirect->fd_type);
+            } else {
+                posix_spawn_file_actions_adddup2(&actions, opened[i], redirect->fd_type);
+            }
+        }
+    }
+
+    // the cached array: nothing is copied or walked per command
+    char **envp = io != NULL && io->envp != NULL ? io->envp : vars_environ();
+    TRACE_BEGIN(start);
+    int err = posix_spawn(&pid, path, &actions, &attr, argv, envp);
+    TRACE_END(TRACE_SPAWN, start);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    for (int i = 0; i < redirect_count; i++) {
+        if (opened[i] >= 0) close(opened[i]);
+    }
+    free(opened);
+
+    // set the group from the parent too, so it exists before we hand it the
+    // terminal whichever process runs first
+    if (err == 0 && io != NULL && io->pgid >= 0) {
+        setpgid(pid, io->pgid > 0 ? io->pgid : pid);
+    }
+
+    if (err != 0) {
+        errno = err;
+        perror(argv[0]);
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    return -1;
+#endif
+}
@@ -0,0 +1,31 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include "common.h"
+
+// Descriptors wired into a spawned child before it executes
+typedef struct {
+    int stdin_fd;                   // becomes fd 0 in the child, -1 to inherit
+    int stdout_fd;                  // becomes fd 1 in the child, -1 to inherit
+    int stderr_fd;                  // becomes fd 2 in the child, -1 to inherit
+    const Redirection *redirects;   // applied in order after the pipe wiring
+    int redirect_count;
+    pid_t pgid;                     // process group to join, 0 for a new one, -1 to inherit
+    char **envp;                    // the child's environment, NULL for vars_environ()
+} SpawnIO;
+
+// spawn_command's result when a redirection could not be opened
+#define SPAWN_REDIRECT_FAILED -2
+
+// Launch an external program without copying the parent's address space.
+// Redirection targets are opened in the parent so errors are reported
+// before anything is started; duplications and closes become file actions
+// the child does. Failures are reported on stderr and the function returns
+// -1 with errno set, or SPAWN_REDIRECT_FAILED, otherwise the child pid.
+pid_t spawn_command(const char *path, char **argv, const SpawnIO *io);
+
+// A descriptor that becomes readable when the child pid exits, for poll();
+// -1 where the kernel has no pidfd_open
+int open_pidfd(pid_t pid);
+
+#endif
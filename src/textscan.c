@@ -0,0 +1,236 @@
+#include "textscan.h"
+#include <pthread.h>
+
+#if defined(__x86_64__)
+#define TEXTSCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// blocks textscan_nth counts whole before looking for the byte inside one
+#define NTH_BLOCK_SIZE 4096
+
+typedef struct {
+    const char *name;
+    size_t (*count)(const unsigned char *data, size_t len, unsigned char byte);
+    const char *(*find)(const unsigned char *data, size_t len, const char *needle, size_t needle_len);
+    bool (*has_high_bit)(const unsigned char *data, size_t len);
+} Kernels;
+
+static size_t count_scalar(const unsigned char *data, size_t len, unsigned char byte) {
+    size_t count = 0;
+    for (size_t i = 0; i < len; i++) {
+        count += data[i] == byte;
+    }
+    return count;
+}
+
+static const char *find_scalar(const unsigned char *data, size_t len, const char *needle, size_t needle_len) {
+    return memmem(data, len, needle, needle_len);
+}
+
+static bool has_high_bit_scalar(const unsigned char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] & 0x80) return true;
+    }
+    return false;
+}
+
+static const Kernels scalar_kernels = {"scalar", count_scalar, find_scalar, has_high_bit_scalar};
+
+#ifdef TEXTSCAN_X86
+
+// The vector versions below share one shape. Counting compares a vector
+// at a time and subtracts the all-ones matches from per-byte counters,
+// folded into 64-bit sums with psadbw before they can wrap at 255.
+// Searching compares the needle's first and last bytes at every position
+// of a vector at once and checks the rest only where both agree.
+
+__attribute__((target("sse2")))
+static size_t count_sse2(const unsigned char *data, size_t len, unsigned char byte) {
+    const __m128i target = _mm_set1_epi8((char)byte);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sums = zero;
+    size_t i = 0;
+    while (i + 16 <= len) {
+        __m128i counters = zero;
+        for (int round = 0; round < 255 && i + 16 <= len; round++, i += 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+            counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(chunk, target));
+        }
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(counters, zero));
+    }
+    size_t count = (size_t)_mm_cvtsi128_si64(sums) + (size_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(sums, sums));
+    return count + count_scalar(data + i, len - i, byte);
+}
+
+__attribute__((target("sse2")))
+static const char *find_sse2(const unsigned char *data, size_t len, const char *needle, size_t needle_len) {
+    if (needle_len < 2 || len < needle_len) return find_scalar(data, len, needle, needle_len);
+
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+    size_t i = 0;
+    for (; i + needle_len - 1 + 16 <= len; i += 16) {
+        __m128i head = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i tail = _mm_loadu_si128((const __m128i *)(data + i + needle_len - 1));
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last)));
+        while (mask != 0) {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(data + i + bit + 1, needle + 1, needle_len - 2) == 0) {
+                return (const char *)data + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return find_scalar(data + i, len - i, needle, needle_len);
+}
+
+__attribute__((target("sse2")))
+static bool has_high_bit_sse2(const unsigned char *data, size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(data + i))) != 0) return true;
+    }
+    return has_high_bit_scalar(data + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t count_avx2(const unsigned char *data, size_t len, unsigned char byte) {
+    const __m256i target = _mm256_set1_epi8((char)byte);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sums = zero;
+    size_t i = 0;
+    while (i + 32 <= len) {
+        __m256i counters = zero;
+        for (int round = 0; round < 255 && i + 32 <= len; round++, i += 32) {
+            __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+            counters = _mm256_sub_epi8(counters, _mm256_cmpeq_epi8(chunk, target));
+        }
+        sums = _mm256_add_epi64(sums, _mm256_sad_epu8(counters, zero));
+    }
+    size_t count = (size_t)_mm256_extract_epi64(sums, 0) + (size_t)_mm256_extract_epi64(sums, 1) +
+                   (size_t)_mm256_extract_epi64(sums, 2) + (size_t)_mm256_extract_epi64(sums, 3);
+    return count + count_sse2(data + i, len - i, byte);
+}
+
+__attribute__((target("avx2")))
+static const char *find_avx2(const unsigned char *data, size_t len, const char *needle, size_t needle_len) {
+    if (needle_len < 2 || len < needle_len) return find_scalar(data, len, needle, needle_len);
+
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+    size_t i = 0;
+    for (; i + needle_len - 1 + 32 <= len; i += 32) {
+        __m256i head = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i tail = _mm256_loadu_si256((const __m256i *)(data + i + needle_len - 1));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(head, first),
+                                                                  _mm256_cmpeq_epi8(tail, last)));
+        while (mask != 0) {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(data + i + bit + 1, needle + 1, needle_len - 2) == 0) {
+                return (const char *)data + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return find_sse2(data + i, len - i, needle, needle_len);
+}
+
+__attribute__((target("avx2")))
+static bool has_high_bit_avx2(const unsigned char *data, size_t len) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        if (_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(data + i))) != 0) return true;
+    }
+    return has_high_bit_sse2(data + i, len - i);
+}
+
+static const Kernels sse2_kernels = {"sse2", count_sse2, find_sse2, has_high_bit_sse2};
+static const Kernels avx2_kernels = {"avx2", count_avx2, find_avx2, has_high_bit_avx2};
+
+#endif
+
+static const Kernels *kernels = &scalar_kernels;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+// The widest kernels the CPU runs
+static const Kernels *best_kernels(void) {
+#ifdef TEXTSCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return &avx2_kernels;
+    if (__builtin_cpu_supports("sse2")) return &sse2_kernels;
+#endif
+    return &scalar_kernels;
+}
+
+static void select_best(void) {
+    kernels = best_kernels();
+}
+
+static const Kernels *current(void) {
+    // builtins run on pipeline threads: pick once, before any of them reads
+    pthread_once(&kernels_once, select_best);
+    return kernels;
+}
+
+size_t textscan_count(const void *data, size_t len, unsigned char byte) {
+    return current()->count(data, len, byte);
+}
+
+const char *textscan_find(const void *data, size_t len, const char *needle, size_t needle_len) {
+    return current()->find(data, len, needle, needle_len);
+}
+
+bool textscan_has_high_bit(const void *data, size_t len) {
+    return current()->has_high_bit(data, len);
+}
+
+const char *textscan_nth(const void *data, size_t len, unsigned char byte, size_t *n, bool reverse) {
+    const unsigned char *bytes = data;
+    const Kernels *k = current();
+
+    // whole blocks are only counted; the one holding the n-th is searched
+    size_t done = 0;
+    while (done < len && *n > 0) {
+        size_t block = len - done < NTH_BLOCK_SIZE ? len - done : NTH_BLOCK_SIZE;
+        const unsigned char *start = reverse ? bytes + len - done - block : bytes + done;
+        size_t found = k->count(start, block, byte);
+        if (found < *n) {
+            *n -= found;
+            done += block;
+            continue;
+        }
+        const unsigned char *p = reverse ? start + block : start;
+        for (;;) {
+            p = reverse ? memrchr(start, byte, p - start) : memchr(p, byte, start + block - p);
+            if (--*n == 0) return (const char *)p;
+            if (!reverse) p++;
+        }
+    }
+    return NULL;
+}
+
+const char *textscan_level(void) {
+    return current()->name;
+}
+
+bool textscan_select(const char *level) {
+    // narrowest first: a level is usable up to the best one
+    static const Kernels *const levels[] = {
+        &scalar_kernels,
+#ifdef TEXTSCAN_X86
+        &sse2_kernels,
+        &avx2_kernels,
+#endif
+    };
+    current();
+    const Kernels *best = best_kernels();
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+        if (strcmp(levels[i]->name, level) == 0) {
+            kernels = levels[i];
+            return true;
+        }
+        if (levels[i] == best) break;
+    }
+    return false;
+}
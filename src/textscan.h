@@ -0,0 +1,32 @@
+#ifndef TEXTSCAN_H
+#define TEXTSCAN_H
+
+#include "common.h"
+
+// Byte-scanning kernels for the text builtins. Each has an AVX2, an SSE2
+// and a plain C version; the best one the CPU runs is picked on first use.
+
+// Number of times byte occurs in the len bytes at data
+size_t textscan_count(const void *data, size_t len, unsigned char byte);
+
+// First occurrence of needle in the len bytes at data, or NULL. An empty
+// needle is found at data.
+const char *textscan_find(const void *data, size_t len, const char *needle, size_t needle_len);
+
+// The n-th occurrence of byte (n >= 1) counting from the start, or from
+// the end when reverse is set. Returns NULL when there are fewer, with n
+// lowered by as many as there were, so a search can go on in the next
+// block.
+const char *textscan_nth(const void *data, size_t len, unsigned char byte, size_t *n, bool reverse);
+
+// Whether any byte has its high bit set
+bool textscan_has_high_bit(const void *data, size_t len);
+
+// Name of the kernels in use: "avx2", "sse2" or "scalar"
+const char *textscan_level(void);
+
+// Use the kernels with the given name instead, if the CPU runs them.
+// For benchmarks; returns false and changes nothing otherwise.
+bool textscan_select(const char *level);
+
+#endif
@@ -0,0 +1,900 @@
+#include "textutils.h"
+#include "outbuf.h"
+#include "copy.h"
+#include "executor.h"
+#include "textscan.h"
+#include "vars.h"
+#include <errno.h>
+#include <sys/stat.h>
+
+// Input is read in large blocks rather than mapped: a file truncated
+// under a mapping raises SIGBUS, which would take the whole shell down
+#define READ_BLOCK_SIZE (1024 * 1024)
+
+// how much of a pipe tail keeps before dropping lines it will not print
+#define TAIL_TRIM_SIZE (8 * 1024 * 1024)
+
+// Whether the locale the commands would run in has multibyte characters.
+// The shell itself stays in the C locale, so this is read off the
+// variables; where it matters the real command is run instead.
+static bool multibyte_locale(void) {
+    static const char *const names[] = {"LC_ALL", "LC_CTYPE", "LANG"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        const char *value = var_get(names[i]);
+        if (value != NULL && value[0] != '\0') {
+            return strcasestr(value, "utf-8") != NULL || strcasestr(value, "utf8") != NULL;
+        }
+    }
+    return false;
+}
+
+// A count argument: decimal digits only, anything else is for the real
+// command to interpret
+static bool parse_count(const char *text, unsigned long long *count) {
+    if (text == NULL || !isdigit((unsigned char)text[0])) return false;
+    errno = 0;
+    char *end;
+    *count = strtoull(text, &end, 10);
+    return *end == '\0' && errno == 0;
+}
+
+// Output goes through the shell's builtin buffer; the first failed write
+// is remembered so a command can stop early
+typedef struct {
+    int fd;
+    int error;          // errno of a failed write; later output is dropped
+} Output;
+
+static void output_init(Output *out, int fd) {
+    out->fd = fd;
+    out->error = 0;
+}
+
+static void output_flush(Output *out) {
+    if (outbuf_flush() < 0 && out->error == 0) out->error = errno;
+}
+
+static void output_add(Output *out, const void *data, size_t len) {
+    if (out->error != 0) return;
+    if (outbuf_write(out->fd, data, len) < 0) out->error = errno;
+}
+
+static void output_str(Output *out, const char *text) {
+    output_add(out, text, strlen(text));
+}
+
+// Flush the output; returns status, or 1 if a write failed.
+// A reader that went away is not worth a message.
+static int output_finish(Output *out, const char *command, int status, const BuiltinIO *io) {
+    output_flush(out);
+    if (out->error != 0) {
+        if (out->error != EPIPE) {
+            outbuf_printf(io->err, "%s: write error: %s\n", command, strerror(out->error));
+        }
+        return 1;
+    }
+    return status;
+}
+
+// Blocks of an input read into one buffer. A fill may keep the end of
+// what was there in front of the new data, for a line cut by the block.
+typedef struct {
+    int fd;
+    char *buffer;
+    size_t capacity;
+    size_t len;         // valid bytes at buffer
+    bool may_block;     // a pipe or terminal, which may wait for its writer
+} Reader;
+
+// Whether reading fd may wait for a writer. Output already produced is
+// written out before such a read, so lines found in a slow stream are
+// not held back until the buffer fills.
+static bool may_block(int fd) {
+    struct stat st;
+    return fstat(fd, &st) != 0 || !S_ISREG(st.st_mode);
+}
+
+static bool reader_init(Reader *reader, int fd) {
+    reader->fd = fd;
+    reader->len = 0;
+    reader->may_block = may_block(fd);
+    reader->capacity = READ_BLOCK_SIZE;
+    reader->buffer = malloc(reader->capacity);
+    return reader->buffer != NULL;
+}
+
+// Keep the last keep bytes and read more after them. Returns the number
+// of new bytes, 0 at end of input, -1 with errno set on error.
+static ssize_t reader_fill(Reader *reader, size_t keep) {
+    if (keep > 0 && keep < reader->len) {
+        memmove(reader->buffer, reader->buffer + reader->len - keep, keep);
+    }
+    reader->len = keep;
+    // a line longer than half the buffer grows it
+    if (reader->capacity - keep < READ_BLOCK_SIZE / 2) {
+        char *grown = realloc(reader->buffer, reader->capacity * 2);
+        if (grown == NULL) return -1;
+        reader->buffer = grown;
+        reader->capacity *= 2;
+    }
+    // a failed write shows again on the next one, so the result can wait
+    if (reader->may_block) outbuf_flush();
+    ssize_t n;
+    do {
+        n = read(reader->fd, reader->buffer + keep, reader->capacity - keep);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) reader->len += n;
+    return n;
+}
+
+static void reader_free(Reader *reader) {
+    free(reader->buffer);
+}
+
+static int open_input(const char *name, const BuiltinIO *io) {
+    if (strcmp(name, "-") != 0) return open(name, O_RDONLY | O_CLOEXEC);
+    // closed with <&-
+    if (io->in < 0) errno = EBADF;
+    return io->in;
+}
+
+static void close_input(int fd, const BuiltinIO *io) {
+    if (fd != io->in) close(fd);
+}
+
+// ---- wc ----
+
+typedef struct {
+    unsigned long long lines;
+    unsigned long long words;
+    unsigned long long bytes;
+} Counts;
+
+// What a byte is to wc in the C locale: whitespace ends a word, a printable
+// character is part of one, anything else (controls, bytes past ASCII)
+// leaves the word as it was
+enum { BYTE_OTHER, BYTE_SPACE, BYTE_PRINT };
+
+static unsigned char byte_class(unsigned char c) {
+    if (c == ' ' || (c >= '\t' && c <= '\r')) return BYTE_SPACE;
+    if (c > ' ' && c < 0x7f) return BYTE_PRINT;
+    return BYTE_OTHER;
+}
+
+static int count_input(int fd, bool need_words, bool bytes_only, Counts *counts) {
+    // the size of a regular file is the byte count, from where fd stands
+    struct stat st;
+    if (bytes_only && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        off_t offset = lseek(fd, 0, SEEK_CUR);
+        if (offset >= 0) {
+            counts->bytes = offset < st.st_size ? (unsigned long long)(st.st_size - offset) : 0;
+            lseek(fd, 0, SEEK_END);
+            return 0;
+        }
+    }
+
+    Reader reader;
+    if (!reader_init(&reader, fd)) return -1;
+    unsigned char classes[256];
+    for (int c = 0; c < 256; c++) classes[c] = byte_class(c);
+
+    bool in_word = false;
+    ssize_t n;
+    while ((n = reader_fill(&reader, 0)) > 0) {
+        counts->bytes += n;
+        counts->lines += textscan_count(reader.buffer, n, '\n');
+        if (need_words) {
+            const unsigned char *data = (const unsigned char *)reader.buffer;
+            for (ssize_t i = 0; i < n; i++) {
+                unsigned char class = classes[data[i]];
+                if (class == BYTE_SPACE) {
+                    counts->words += in_word;
+                    in_word = false;
+                } else if (class == BYTE_PRINT) {
+                    in_word = true;
+                }
+            }
+        }
+    }
+    counts->words += in_word;
+    int saved_errno = errno;
+    reader_free(&reader);
+    errno = saved_errno;
+    return n < 0 ? -1 : 0;
+}
+
+// Column width the way coreutils picks it: wide enough for the total size
+// of the regular files, at least 7 when any input is not one, and no
+// padding at all for a single count of a single input
+static int count_width(char **files, int file_count, int column_count, const BuiltinIO *io) {
+    if (file_count == 1 && column_count == 1) return 1;
+
+    int min_width = 1;
+    unsigned long long regular_total = 0;
+    for (int i = 0; i < file_count; i++) {
+        struct stat st;
+        int result = strcmp(files[i], "-") == 0 ? fstat(io->in, &st) : stat(files[i], &st);
+        if (result != 0) {
+            // an input that cannot be looked at first leaves the width at 1
+            if (i == 0) return 1;
+            continue;
+        }
+        if (S_ISREG(st.st_mode)) {
+            regular_total += st.st_size;
+        } else {
+            min_width = 7;
+        }
+    }
+    int width = 1;
+    for (; regular_total >= 10; regular_total /= 10) width++;
+    return width > min_width ? width : min_width;
+}
+
+static void print_counts(Output *out, const Counts *counts, const bool *columns, int width, const char *name) {
+    const unsigned long long values[] = {counts->lines, counts->words, counts->bytes, counts->bytes};
+    char field[32];
+    bool first = true;
+    for (int i = 0; i < 4; i++) {
+        if (!columns[i]) continue;
+        int len = snprintf(field, sizeof(field), "%s%*llu", first ? "" : " ", width, values[i]);
+        output_add(out, field, len);
+        first = false;
+    }
+    if (name != NULL) {
+        output_str(out, " ");
+        output_str(out, name);
+    }
+    output_str(out, "\n");
+}
+
+int handle_wc(char **argv, const BuiltinIO *io) {
+    // lines, words, characters, bytes: the order coreutils prints them in
+    bool columns[4] = {false, false, false, false};
+    bool any_column = false;
+    int arg = 1;
+    for (; argv[arg] != NULL && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+        if (strcmp(argv[arg], "--") == 0) {
+            arg++;
+            break;
+        }
+        for (const char *p = argv[arg] + 1; *p != '\0'; p++) {
+            const char *letters = "lwmc";
+            const char *found = strchr(letters, *p);
+            if (found == NULL) return run_external_fallback(argv, io);
+            columns[found - letters] = true;
+            any_column = true;
+        }
+    }
+    if (!any_column) {
+        columns[0] = columns[1] = columns[3] = true;
+    }
+    // words and characters depend on the locale's character set
+    if ((columns[1] || columns[2]) && multibyte_locale()) {
+        return run_external_fallback(argv, io);
+    }
+
+    char *stdin_only[] = {"-", NULL};
+    bool named = argv[arg] != NULL;
+    char **files = named ? argv + arg : stdin_only;
+    int file_count = 0;
+    while (files[file_count] != NULL) file_count++;
+    int column_count = columns[0] + columns[1] + columns[2] + columns[3];
+    bool bytes_only = column_count == 1 && columns[3];
+
+    Output out;
+    output_init(&out, io->out);
+    int width = count_width(files, file_count, column_count, io);
+    Counts total = {0, 0, 0};
+    int status = 0;
+
+    for (int i = 0; i < file_count && out.error == 0; i++) {
+        Counts counts = {0, 0, 0};
+        int fd = open_input(files[i], io);
+        if (fd < 0) {
+            outbuf_printf(io->err, "wc: %s: %s\n", files[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        if (count_input(fd, columns[1], bytes_only, &counts) != 0) {
+            // counted as far as it went, like coreutils
+            outbuf_printf(io->err, "wc: %s: %s\n", files[i], strerror(errno));
+            status = 1;
+        }
+        close_input(fd, io);
+        print_counts(&out, &counts, columns, width, named ? files[i] : NULL);
+        total.lines += counts.lines;
+        total.words += counts.words;
+        total.bytes += counts.bytes;
+    }
+    if (file_count > 1) {
+        print_counts(&out, &total, columns, width, "total");
+    }
+    return output_finish(&out, "wc", status, io);
+}
+
+// ---- head and tail ----
+
+typedef struct {
+    unsigned long long count;
+    bool bytes;         // -c: count bytes, not lines
+    bool from_start;    // tail +N: from the N-th on
+    int headers;        // -1 never (-q), 1 always (-v), 0 with several files
+    char **files;
+} HeadTailOptions;
+
+// Options both take: -n N, -c N, -N, -q, -v. Returns false for anything
+// else, left to the real command; tail also takes +N counts.
+static bool parse_head_tail(char **argv, bool tail, HeadTailOptions *options) {
+    options->count = 10;
+    options->bytes = false;
+    options->from_start = false;
+    options->headers = 0;
+
+    bool obsolete = false;
+    int arg = 1;
+    for (; argv[arg] != NULL && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+        const char *option = argv[arg];
+        if (strcmp(option, "--") == 0) {
+            arg++;
+            break;
+        }
+        if (isdigit((unsigned char)option[1])) {
+            // "head -5", the obsolete form of -n 5
+            if (!parse_count(option + 1, &options->count)) return false;
+            options->bytes = false;
+            obsolete = true;
+            continue;
+        }
+        for (const char *p = option + 1; *p != '\0'; p++) {
+            if (*p == 'q' || *p == 'v') {
+                options->headers = *p == 'q' ? -1 : 1;
+                continue;
+            }
+            if (*p != 'n' && *p != 'c') return false;
+
+            options->bytes = *p == 'c';
+            const char *value = p[1] != '\0' ? p + 1 : argv[++arg];
+            if (value == NULL) return false;
+            options->from_start = tail && value[0] == '+';
+            if (!parse_count(options->from_start ? value + 1 : value, &options->count)) return false;
+            break;
+        }
+    }
+    options->files = argv + arg;
+    // which tail refuses with more than one file
+    if (tail && obsolete && options->files[0] != NULL && options->files[1] != NULL) return false;
+    return true;
+}
+
+static const char *display_name(const char *name) {
+    return strcmp(name, "-") == 0 ? "standard input" : name;
+}
+
+// Write the first count lines or bytes of fd. What was read past them is
+// given back to a seekable input, so the next reader starts right after.
+static int head_input(int fd, const HeadTailOptions *options, Output *out) {
+    char *buffer = malloc(READ_BLOCK_SIZE);
+    if (buffer == NULL) return -1;
+
+    bool blocking = may_block(fd);
+    size_t remaining = options->count;
+    int result = 0;
+    while (remaining > 0 && out->error == 0) {
+        if (blocking) output_flush(out);
+        ssize_t n = read(fd, buffer, READ_BLOCK_SIZE);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            result = -1;
+            break;
+        }
+        if (n == 0) break;
+
+        size_t used = n;
+        if (options->bytes) {
+            if (remaining < used) used = remaining;
+            remaining -= used;
+        } else {
+            const char *newline = textscan_nth(buffer, n, '\n', &remaining, false);
+            if (newline != NULL) used = newline + 1 - buffer;
+        }
+        output_add(out, buffer, used);
+        if ((size_t)n > used) {
+            lseek(fd, -(off_t)(n - used), SEEK_CUR);
+        }
+    }
+    int saved_errno = errno;
+    free(buffer);
+    errno = saved_errno;
+    return result;
+}
+
+int handle_head(char **argv, const BuiltinIO *io) {
+    HeadTailOptions options;
+    if (!parse_head_tail(argv, false, &options)) {
+        return run_external_fallback(argv, io);
+    }
+
+    char *stdin_only[] = {"-", NULL};
+    char **files = options.files[0] != NULL ? options.files : stdin_only;
+    bool headers = options.headers > 0 || (options.headers == 0 && files[1] != NULL);
+
+    Output out;
+    output_init(&out, io->out);
+    int status = 0;
+    for (int i = 0; files[i] != NULL && out.error == 0; i++) {
+        int fd = open_input(files[i], io);
+        if (fd < 0) {
+            outbuf_printf(io->err, "head: cannot open '%s' for reading: %s\n", files[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        if (headers) {
+            output_str(&out, i > 0 ? "\n==> " : "==> ");
+            output_str(&out, display_name(files[i]));
+            output_str(&out, " <==\n");
+        }
+        if (head_input(fd, &options, &out) != 0) {
+            outbuf_printf(io->err, "head: error reading '%s': %s\n", files[i], strerror(errno));
+            status = 1;
+        }
+        close_input(fd, io);
+    }
+    return output_finish(&out, "head", status, io);
+}
+
+// Offset in data where its last count lines start. A newline ending the
+// data closes the last line rather than starting an empty one.
+static size_t last_lines_start(const char *data, size_t len, unsigned long long count) {
+    if (count == 0) return len;
+    size_t wanted = count + (len > 0 && data[len - 1] == '\n');
+    const char *newline = textscan_nth(data, len, '\n', &wanted, true);
+    return newline != NULL ? (size_t)(newline + 1 - data) : 0;
+}
+
+// Copy the rest of fd to the output, inside the kernel where it can
+static int copy_rest(int fd, Output *out) {
+    output_flush(out);
+    if (out->error != 0) return 0;
+    bool write_failed = false;
+    if (copy_fd(fd, out->fd, &write_failed) != 0) {
+        if (write_failed) {
+            out->error = errno;
+            return 0;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// tail of a regular file: read backwards from its end only as far as the
+// lines asked for go, then copy from there
+static int tail_seekable(int fd, off_t base, off_t end, const HeadTailOptions *options, Output *out) {
+    off_t start;
+    if (options->bytes) {
+        start = end - base > (off_t)options->count ? end - (off_t)options->count : base;
+    } else {
+        char *buffer = malloc(READ_BLOCK_SIZE);
+        if (buffer == NULL) return -1;
+
+        char last = '\0';
+        if (end > base && pread(fd, &last, 1, end - 1) != 1) {
+            free(buffer);
+            return -1;
+        }
+        size_t wanted = options->count + (last == '\n');
+        start = options->count == 0 ? end : base;
+        for (off_t pos = end; pos > base && wanted > 0; ) {
+            size_t block = pos - base < READ_BLOCK_SIZE ? (size_t)(pos - base) : READ_BLOCK_SIZE;
+            ssize_t n = pread(fd, buffer, block, pos - block);
+            if (n != (ssize_t)block) {
+                free(buffer);
+                if (n >= 0) errno = EIO;
+                return -1;
+            }
+            const char *newline = textscan_nth(buffer, block, '\n', &wanted, true);
+            pos -= block;
+            if (newline != NULL) {
+                start = pos + (newline + 1 - buffer);
+                break;
+            }
+        }
+        free(buffer);
+    }
+    if (lseek(fd, start, SEEK_SET) < 0) return -1;
+    return copy_rest(fd, out);
+}
+
+// tail of a pipe: everything passes through, only what may still be
+// printed is kept
+static int tail_stream(int fd, const HeadTailOptions *options, Output *out) {
+    Reader reader;
+    if (!reader_init(&reader, fd)) return -1;
+
+    size_t keep = 0;
+    ssize_t n;
+    while ((n = reader_fill(&reader, keep)) > 0) {
+        keep = reader.len;
+        if (reader.len < TAIL_TRIM_SIZE) continue;
+        if (options->bytes) {
+            if (keep > options->count) keep = options->count;
+        } else {
+            keep = reader.len - last_lines_start(reader.buffer, reader.len, options->count);
+        }
+    }
+    if (n == 0) {
+        size_t start;
+        if (options->bytes) {
+            start = reader.len > options->count ? reader.len - options->count : 0;
+        } else {
+            start = last_lines_start(reader.buffer, reader.len, options->count);
+        }
+        output_add(out, reader.buffer + start, reader.len - start);
+    }
+    int saved_errno = errno;
+    reader_free(&reader);
+    errno = saved_errno;
+    return n < 0 ? -1 : 0;
+}
+
+// tail +N: skip the first N - 1 lines or bytes, copy the rest
+static int tail_from_start(int fd, const HeadTailOptions *options, Output *out) {
+    size_t skip = options->count > 1 ? options->count - 1 : 0;
+    if (skip > 0 && options->bytes && lseek(fd, skip, SEEK_CUR) >= 0) {
+        skip = 0;
+    }
+
+    char *buffer = malloc(READ_BLOCK_SIZE);
+    if (buffer == NULL) return -1;
+    while (skip > 0) {
+        ssize_t n = read(fd, buffer, READ_BLOCK_SIZE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            free(buffer);
+            return n < 0 ? -1 : 0;
+        }
+        size_t from = n;
+        if (options->bytes) {
+            from = skip < (size_t)n ? skip : (size_t)n;
+            skip -= from;
+        } else {
+            const char *newline = textscan_nth(buffer, n, '\n', &skip, false);
+            if (newline != NULL) from = newline + 1 - buffer;
+        }
+        output_add(out, buffer + from, n - from);
+    }
+    free(buffer);
+    return copy_rest(fd, out);
+}
+
+int handle_tail(char **argv, const BuiltinIO *io) {
+    HeadTailOptions options;
+    if (!parse_head_tail(argv, true, &options)) {
+        return run_external_fallback(argv, io);
+    }
+
+    char *stdin_only[] = {"-", NULL};
+    char **files = options.files[0] != NULL ? options.files : stdin_only;
+    bool headers = options.headers > 0 || (options.headers == 0 && files[1] != NULL);
+
+    Output out;
+    output_init(&out, io->out);
+    int status = 0;
+    bool first = true;
+    for (int i = 0; files[i] != NULL && out.error == 0; i++) {
+        int fd = open_input(files[i], io);
+        if (fd < 0) {
+            outbuf_printf(io->err, "tail: cannot open '%s' for reading: %s\n", files[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        if (headers) {
+            output_str(&out, first ? "==> " : "\n==> ");
+            output_str(&out, display_name(files[i]));
+            output_str(&out, " <==\n");
+        }
+        first = false;
+
+        struct stat st;
+        off_t base;
+        int result;
+        if (options.from_start) {
+            result = tail_from_start(fd, &options, &out);
+        } else if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (base = lseek(fd, 0, SEEK_CUR)) >= 0) {
+            result = tail_seekable(fd, base, st.st_size, &options, &out);
+        } else {
+            result = tail_stream(fd, &options, &out);
+        }
+        if (result != 0) {
+            outbuf_printf(io->err, "tail: error reading '%s': %s\n", files[i], strerror(errno));
+            status = 1;
+        }
+        close_input(fd, io);
+    }
+    return output_finish(&out, "tail", status, io);
+}
+
+// ---- grep -F ----
+
+typedef struct {
+    const char *pattern;
+    size_t pattern_len;
+    bool invert;            // -v
+    bool count_only;        // -c
+    bool quiet;             // -q
+    bool line_numbers;      // -n
+    bool no_messages;       // -s
+    int with_filename;      // -1 -h, 1 -H, 0 by file count
+    bool multibyte;         // invalid UTF-8 makes a file binary
+} GrepOptions;
+
+// One input being searched
+typedef struct {
+    const GrepOptions *options;
+    const char *name;       // as printed before lines, or NULL
+    Output *out;
+    unsigned long long line;    // number of the first line not yet passed
+    unsigned long long selected;
+    bool binary;            // a NUL or an encoding error was seen
+    bool stop;              // nothing more to do with this input
+} GrepInput;
+
+// Whether data is valid UTF-8
+static bool valid_utf8(const unsigned char *data, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        unsigned char c = data[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+        size_t extra;
+        unsigned int min;
+        unsigned int code;
+        if ((c & 0xe0) == 0xc0) {
+            extra = 1, min = 0x80, code = c & 0x1f;
+        } else if ((c & 0xf0) == 0xe0) {
+            extra = 2, min = 0x800, code = c & 0x0f;
+        } else if ((c & 0xf8) == 0xf0) {
+            extra = 3, min = 0x10000, code = c & 0x07;
+        } else {
+            return false;
+        }
+        if (len - i <= extra) return false;
+        for (size_t k = 1; k <= extra; k++) {
+            if ((data[i + k] & 0xc0) != 0x80) return false;
+            code = (code << 6) | (data[i + k] & 0x3f);
+        }
+        if (code < min || code > 0x10ffff || (code >= 0xd800 && code <= 0xdfff)) return false;
+        i += extra + 1;
+    }
+    return true;
+}
+
+// Handle lines that were selected: print, count, or stop at the first
+static void grep_select(GrepInput *input, const char *start, const char *end, unsigned long long lines) {
+    const GrepOptions *options = input->options;
+    input->selected += lines;
+    if (options->quiet) {
+        input->stop = true;
+        return;
+    }
+    if (options->count_only) return;
+    if (input->binary) {
+        input->stop = true;
+        return;
+    }
+
+    Output *out = input->out;
+    // without prefixes a run of lines goes out as one piece
+    if (input->name == NULL && !options->line_numbers) {
+        output_add(out, start, end - start);
+        if (end[-1] != '\n') output_str(out, "\n");
+        return;
+    }
+    unsigned long long number = input->line;
+    while (start < end) {
+        const char *newline = memchr(start, '\n', end - start);
+        const char *line_end = newline != NULL ? newline : end;
+        if (input->name != NULL) {
+            output_str(out, input->name);
+            output_str(out, ":");
+        }
+        if (options->line_numbers) {
+            char prefix[32];
+            output_add(out, prefix, snprintf(prefix, sizeof(prefix), "%llu:", number));
+        }
+        output_add(out, start, line_end - start);
+        output_str(out, "\n");
+        number++;
+        start = line_end + 1;
+    }
+}
+
+// Search complete lines [start, end): a newline ends each one but maybe
+// the last, at end of input. Matches are found in the whole block at
+// once; the lines around them are taken as runs.
+static void grep_lines(GrepInput *input, const char *start, const char *end) {
+    const GrepOptions *options = input->options;
+    const char *cursor = start;
+    while (cursor < end && !input->stop) {
+        const char *match = textscan_find(cursor, end - cursor, options->pattern, options->pattern_len);
+        const char *line_start = end;
+        const char *line_end = end;
+        if (match != NULL) {
+            const char *newline = memrchr(cursor, '\n', match - cursor);
+            line_start = newline != NULL ? newline + 1 : cursor;
+            newline = memchr(match, '\n', end - match);
+            line_end = newline != NULL ? newline + 1 : end;
+        }
+
+        // the lines before the match do not contain the pattern
+        if (line_start > cursor) {
+            unsigned long long lines = textscan_count(cursor, line_start - cursor, '\n');
+            if (line_start == end && end[-1] != '\n') lines++;
+            if (options->invert) grep_select(input, cursor, line_start, lines);
+            input->line += lines;
+        }
+        if (match == NULL || input->stop) break;
+
+        if (!options->invert) grep_select(input, line_start, line_end, 1);
+        input->line++;
+        cursor = line_end;
+    }
+}
+
+// Search one input; returns -1 with errno set on a read error
+static int grep_input(GrepInput *input, int fd) {
+    Reader reader;
+    if (!reader_init(&reader, fd)) return -1;
+
+    size_t partial = 0;     // bytes of a line cut by the block end
+    ssize_t n;
+    while (!input->stop && (n = reader_fill(&reader, partial)) >= 0) {
+        const char *data = reader.buffer;
+        const char *new_data = data + partial;
+        const char *end = data + reader.len;
+        if (n > 0) {
+            // hand over only complete lines; the cut one waits for more
+            const char *newline = memrchr(new_data, '\n', end - new_data);
+            if (newline == NULL) {
+                partial = reader.len;
+                continue;
+            }
+            end = newline + 1;
+        }
+        if (!input->binary) {
+            input->binary = memchr(data, '\0', end - data) != NULL ||
+                            (input->options->multibyte && textscan_has_high_bit(data, end - data) &&
+                             !valid_utf8((const unsigned char *)data, end - data));
+        }
+        if (end > data) grep_lines(input, data, end);
+        if (n == 0) break;
+        partial = data + reader.len - end;
+    }
+    int saved_errno = errno;
+    reader_free(&reader);
+    errno = saved_errno;
+    return !input->stop && n < 0 ? -1 : 0;
+}
+
+// Options grep -F is run with here: -F itself, -c -v -n -q -s -h -H and a
+// single pattern, given as the first operand or with -e
+static bool parse_grep(char **argv, GrepOptions *options, char ***files) {
+    memset(options, 0, sizeof(*options));
+    bool fixed = false;
+    bool options_done = false;
+
+    // GNU grep takes options after operands too: collect operands in place
+    int out = 1;
+    for (int arg = 1; argv[arg] != NULL; arg++) {
+        const char *word = argv[arg];
+        if (options_done || word[0] != '-' || word[1] == '\0') {
+            argv[out++] = argv[arg];
+            continue;
+        }
+        if (strcmp(word, "--") == 0) {
+            options_done = true;
+            continue;
+        }
+        for (const char *p = word + 1; *p != '\0'; p++) {
+            switch (*p) {
+            case 'F': fixed = true; break;
+            case 'c': options->count_only = true; break;
+            case 'v': options->invert = true; break;
+            case 'n': options->line_numbers = true; break;
+            case 'q': options->quiet = true; break;
+            case 's': options->no_messages = true; break;
+            case 'h': options->with_filename = -1; break;
+            case 'H': options->with_filename = 1; break;
+            case 'e':
+                if (options->pattern != NULL) return false;
+                options->pattern = p[1] != '\0' ? p + 1 : argv[++arg];
+                if (options->pattern == NULL) return false;
+                p += strlen(p) - 1;
+                break;
+            default:
+                return false;
+            }
+        }
+    }
+    argv[out] = NULL;
+
+    char **rest = argv + 1;
+    if (options->pattern == NULL) {
+        if (rest[0] == NULL) return false;
+        options->pattern = *rest++;
+    }
+    // several patterns, one per line, are left to grep
+    if (!fixed || strchr(options->pattern, '\n') != NULL) return false;
+    options->pattern_len = strlen(options->pattern);
+    options->multibyte = multibyte_locale();
+    *files = rest;
+    return true;
+}
+
+int handle_grep(char **argv, const BuiltinIO *io) {
+    // the options are parsed from a copy: operands are moved to the front
+    int argc = 0;
+    while (argv[argc] != NULL) argc++;
+    char **args = malloc((argc + 1) * sizeof(char *));
+    if (args == NULL) return 2;
+    memcpy(args, argv, (argc + 1) * sizeof(char *));
+
+    GrepOptions options;
+    char **files;
+    if (!parse_grep(args, &options, &files)) {
+        free(args);
+        return run_external_fallback(argv, io);
+    }
+
+    char *stdin_only[] = {"-", NULL};
+    if (files[0] == NULL) files = stdin_only;
+    bool with_filename = options.with_filename > 0 || (options.with_filename == 0 && files[1] != NULL);
+
+    Output out;
+    output_init(&out, io->out);
+    bool selected = false;
+    bool error = false;
+    for (int i = 0; files[i] != NULL && out.error == 0; i++) {
+        const char *name = strcmp(files[i], "-") == 0 ? "(standard input)" : files[i];
+        int fd = open_input(files[i], io);
+        if (fd < 0) {
+            if (!options.no_messages) {
+                outbuf_printf(io->err, "grep: %s: %s\n", files[i], strerror(errno));
+            }
+            error = true;
+            continue;
+        }
+
+        GrepInput input = {&options, with_filename ? name : NULL, &out, 1, 0, false, false};
+        if (grep_input(&input, fd) != 0) {
+            if (!options.no_messages) {
+                outbuf_printf(io->err, "grep: %s: %s\n", files[i], strerror(errno));
+            }
+            error = true;
+        }
+        close_input(fd, io);
+
+        if (options.count_only && !options.quiet) {
+            char line[32];
+            if (input.name != NULL) {
+                output_str(&out, input.name);
+                output_str(&out, ":");
+            }
+            output_add(&out, line, snprintf(line, sizeof(line), "%llu\n", input.selected));
+        } else if (input.binary && input.selected > 0 && !options.quiet) {
+            outbuf_printf(io->err, "grep: %s: binary file matches\n", name);
+        }
+        if (input.selected > 0) {
+            selected = true;
+            if (options.quiet) break;
+        }
+    }
+    free(args);
+
+    int status = output_finish(&out, "grep", 0, io);
+    if (status != 0) return 2;
+    // -q with a match succeeds whatever went wrong elsewhere
+    if (options.quiet && selected) return 0;
+    return error ? 2 : selected ? 0 : 1;
+}
@@ -0,0 +1,14 @@
+#ifndef TEXTUTILS_H
+#define TEXTUTILS_H
+
+#include "common.h"
+
+// wc, head, tail and grep -F as builtins, so the usual "... | wc -l" does
+// not start a process. Output matches coreutils and GNU grep; options they
+// do not handle are left to the real command.
+int handle_wc(char **argv, const BuiltinIO *io);
+int handle_head(char **argv, const BuiltinIO *io);
+int handle_tail(char **argv, const BuiltinIO *io);
+int handle_grep(char **argv, const BuiltinIO *io);
+
+#endif
@@ -0,0 +1,157 @@
+#include "timing.h"
+#include "vars.h"
+#include <sys/time.h>
+
+// bash's default, plus the peak resident set size
+#define DEFAULT_TIMEFORMAT "\nreal\t%3lR\nuser\t%3lU\nsys\t%3lS\nmaxrss\t%MK"
+
+#define POSIX_TIMEFORMAT "real %2R\nuser %2U\nsys %2S"
+
+static double timespec_seconds(const struct timespec *ts) {
+    return ts->tv_sec + ts->tv_nsec / 1e9;
+}
+
+static double timeval_seconds(const struct timeval *tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+void timing_start(TimingStart *start) {
+    clock_gettime(CLOCK_MONOTONIC, &start->start);
+    getrusage(RUSAGE_SELF, &start->self);
+    getrusage(RUSAGE_CHILDREN, &start->children);
+}
+
+void timing_thread_begin(StageTimes *times) {
+    getrusage(RUSAGE_THREAD, &times->usage);
+}
+
+void timing_thread_end(StageTimes *times) {
+    struct rusage now;
+    getrusage(RUSAGE_THREAD, &now);
+    clock_gettime(CLOCK_MONOTONIC, &times->end);
+
+    timersub(&now.ru_utime, &times->usage.ru_utime, &now.ru_utime);
+    timersub(&now.ru_stime, &times->usage.ru_stime, &now.ru_stime);
+    times->usage = now;
+    times->measured = true;
+}
+
+// Print seconds the way bash does: "1.500" or, in long form, "0m1.500s"
+static void print_seconds(FILE *out, double seconds, int precision, bool long_form) {
+    if (long_form) {
+        long minutes = (long)(seconds / 60);
+        fprintf(out, "%ldm%.*fs", minutes, precision, seconds - minutes * 60.0);
+    } else {
+        fprintf(out, "%.*f", precision, seconds);
+    }
+}
+
+// Expand a TIMEFORMAT string: %[p][l]R, %[p][l]U, %[p][l]S, %P, %M and %%
+static void print_format(FILE *out, const char *format, double real, double user, double sys, long maxrss) {
+    for (const char *p = format; *p != '\0'; p++) {
+        if (*p != '%') {
+            fputc(*p, out);
+            continue;
+        }
+
+        const char *spec = p++;
+        int precision = 3;
+        bool long_form = false;
+        if (*p >= '0' && *p <= '9') {
+            precision = *p - '0' > 3 ? 3 : *p - '0';
+            p++;
+        }
+        if (*p == 'l') {
+            long_form = true;
+            p++;
+        }
+
+        switch (*p) {
+            case 'R':
+                print_seconds(out, real, precision, long_form);
+                break;
+            case 'U':
+                print_seconds(out, user, precision, long_form);
+                break;
+            case 'S':
+                print_seconds(out, sys, precision, long_form);
+                break;
+            case 'P':
+                fprintf(out, "%.2f", real > 0 ? (user + sys) * 100 / real : 0.0);
+                break;
+            case 'M':
+                fprintf(out, "%ld", maxrss);
+                break;
+            case '%':
+                fputc('%', out);
+                break;
+            default:
+                // not a conversion: print it as written
+                fwrite(spec, 1, p - spec + (*p != '\0'), out);
+                if (*p == '\0') p--;
+                break;
+        }
+    }
+    fputc('\n', out);
+}
+
+static void print_stage(FILE *out, int index, const Args *command, const StageTimes *times, double real) {
+    fprintf(out, "[%d] real %.3fs  user %.3fs  sys %.3fs  maxrss %ldK  ", index + 1, real,
+            timeval_seconds(&times->usage.ru_utime), timeval_seconds(&times->usage.ru_stime),
+            times->usage.ru_maxrss);
+    for (int i = 0; i < command->count; i++) {
+        fprintf(out, i > 0 ? " %s" : "%s", command->args[i]);
+    }
+    fputc('\n', out);
+}
+
+void timing_report(const TimingStart *start, const StageTimes *stages, const Pipeline *pipeline) {
+    struct timespec now;
+    struct rusage self;
+    struct rusage children;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+
+    const char *format = pipeline->time_posix ? POSIX_TIMEFORMAT : var_get("TIMEFORMAT");
+    if (format == NULL) {
+        format = DEFAULT_TIMEFORMAT;
+    }
+    // an empty TIMEFORMAT turns the report off
+    if (format[0] == '\0') return;
+
+    double real = timespec_seconds(&now) - timespec_seconds(&start->start);
+    // the shell's own time covers builtins, the children's the processes
+    double user = timeval_seconds(&self.ru_utime) - timeval_seconds(&start->self.ru_utime) +
+                  timeval_seconds(&children.ru_utime) - timeval_seconds(&start->children.ru_utime);
+    double sys = timeval_seconds(&self.ru_stime) - timeval_seconds(&start->self.ru_stime) +
+                 timeval_seconds(&children.ru_stime) - timeval_seconds(&start->children.ru_stime);
+    long maxrss = 0;
+    for (int i = 0; i < pipeline->count; i++) {
+        if (stages[i].measured && stages[i].usage.ru_maxrss > maxrss) {
+            maxrss = stages[i].usage.ru_maxrss;
+        }
+    }
+
+    // build the report in memory so it reaches the unbuffered stderr in one write
+    char *report = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&report, &length);
+    if (out == NULL) {
+        perror("open_memstream");
+        return;
+    }
+
+    print_format(out, format, real, user, sys, maxrss);
+    if (pipeline->count > 1 && !pipeline->time_posix) {
+        for (int i = 0; i < pipeline->count; i++) {
+            if (!stages[i].measured) continue;
+            double stage_real = timespec_seconds(&stages[i].end) - timespec_seconds(&start->start);
+            print_stage(out, i, &pipeline->commands[i], &stages[i], stage_real);
+        }
+    }
+
+    fclose(out);
+    fwrite(report, 1, length, stderr);
+    free(report);
+}
@@ -0,0 +1,35 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "common.h"
+#include "parser.h"
+#include <sys/resource.h>
+#include <time.h>
+
+// What one stage of a timed pipeline cost
+typedef struct {
+    bool measured;          // false for stages that never started
+    struct rusage usage;    // from wait4 for processes, RUSAGE_THREAD otherwise
+    struct timespec end;    // CLOCK_MONOTONIC time the stage was seen to finish
+} StageTimes;
+
+// Counters taken when a timed pipeline starts
+typedef struct {
+    struct timespec start;
+    struct rusage self;
+    struct rusage children;
+} TimingStart;
+
+void timing_start(TimingStart *start);
+
+// Measure a builtin running on the calling thread: begin keeps the thread's
+// counters in times, end turns them into what the builtin used
+void timing_thread_begin(StageTimes *times);
+void timing_thread_end(StageTimes *times);
+
+// Print the report for a timed pipeline on stderr: the totals in the
+// TIMEFORMAT format (POSIX format for "time -p"), then one line per stage
+// when there is more than one
+void timing_report(const TimingStart *start, const StageTimes *stages, const Pipeline *pipeline);
+
+#endif
@@ -0,0 +1,222 @@
+#include "trace.h"
+#include "outbuf.h"
+#include <stdatomic.h>
+#include <time.h>
+
+// events kept for percentiles and the Chrome trace; a power of two
+#define TRACE_RING_SIZE 16384
+
+static const char *const phase_names[TRACE_PHASE_COUNT] = {
+    "line", "parse", "lookup", "spawn", "redirect", "wait", "builtin", "history"
+};
+
+// One slot of the ring. seq is the event's index + 1 once the slot is
+// complete and 0 while a writer is filling it, so a reader can tell a
+// finished event from one being overwritten (a seqlock without the lock).
+typedef struct {
+    _Atomic uint64_t seq;
+    _Atomic uint64_t start;
+    _Atomic uint64_t duration;
+    _Atomic uint32_t tid;
+    _Atomic uint8_t phase;
+} TraceEvent;
+
+bool trace_enabled = false;
+
+static TraceEvent *ring = NULL;
+static _Atomic uint64_t ring_head = 0;      // index of the next event
+static _Atomic uint64_t ring_floor = 0;     // events before this were cleared
+
+// running totals, kept across ring wrap-around
+static _Atomic uint64_t phase_count[TRACE_PHASE_COUNT];
+static _Atomic uint64_t phase_total[TRACE_PHASE_COUNT];
+
+void trace_init(void) {
+    const char *value = getenv("SHELL_TRACE");
+    if (value == NULL || value[0] == '\0' || strcmp(value, "0") == 0) return;
+
+    ring = calloc(TRACE_RING_SIZE, sizeof(TraceEvent));
+    trace_enabled = ring != NULL;
+}
+
+uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+void trace_record(TracePhase phase, uint64_t start) {
+    uint64_t duration = trace_now() - start;
+    uint64_t index = atomic_fetch_add_explicit(&ring_head, 1, memory_order_relaxed);
+    TraceEvent *event = &ring[index & (TRACE_RING_SIZE - 1)];
+
+    atomic_store_explicit(&event->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&event->start, start, memory_order_relaxed);
+    atomic_store_explicit(&event->duration, duration, memory_order_relaxed);
+    atomic_store_explicit(&event->tid, (uint32_t)gettid(), memory_order_relaxed);
+    atomic_store_explicit(&event->phase, (uint8_t)phase, memory_order_relaxed);
+    atomic_store_explicit(&event->seq, index + 1, memory_order_release);
+
+    atomic_fetch_add_explicit(&phase_count[phase], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&phase_total[phase], duration, memory_order_relaxed);
+}
+
+typedef struct {
+    uint64_t start;
+    uint64_t duration;
+    uint32_t tid;
+    uint8_t phase;
+} TraceSnapshot;
+
+// Copy the events still in the ring, oldest first. Slots being rewritten
+// while we read are skipped. Returns the number copied into events.
+static size_t snapshot_ring(TraceSnapshot *events) {
+    uint64_t head = atomic_load_explicit(&ring_head, memory_order_acquire);
+    uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    uint64_t floor = atomic_load_explicit(&ring_floor, memory_order_relaxed);
+    if (first < floor) first = floor;
+
+    size_t count = 0;
+    for (uint64_t index = first; index < head; index++) {
+        TraceEvent *event = &ring[index & (TRACE_RING_SIZE - 1)];
+        if (atomic_load_explicit(&event->seq, memory_order_acquire) != index + 1) continue;
+
+        TraceSnapshot copy;
+        copy.start = atomic_load_explicit(&event->start, memory_order_relaxed);
+        copy.duration = atomic_load_explicit(&event->duration, memory_order_relaxed);
+        copy.tid = atomic_load_explicit(&event->tid, memory_order_relaxed);
+        copy.phase = atomic_load_explicit(&event->phase, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&event->seq, memory_order_relaxed) != index + 1) continue;
+
+        events[count++] = copy;
+    }
+    return count;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nanoseconds in the largest unit that keeps them readable
+static void format_duration(char *buf, size_t size, uint64_t ns) {
+    if (ns < 1000) {
+        snprintf(buf, size, "%luns", (unsigned long)ns);
+    } else if (ns < 1000000) {
+        snprintf(buf, size, "%.1fus", ns / 1e3);
+    } else if (ns < 1000000000) {
+        snprintf(buf, size, "%.2fms", ns / 1e6);
+    } else {
+        snprintf(buf, size, "%.2fs", ns / 1e9);
+    }
+}
+
+static void print_stats(const BuiltinIO *io, const TraceSnapshot *events, size_t count) {
+    uint64_t *durations = malloc((count ? count : 1) * sizeof(uint64_t));
+    if (durations == NULL) {
+        perror("malloc");
+        return;
+    }
+
+    outbuf_printf(io->out, "%-10s %8s %10s %10s %10s %10s\n", "phase", "count", "p50", "p99", "max", "total");
+    for (int phase = 0; phase < TRACE_PHASE_COUNT; phase++) {
+        uint64_t total_count = atomic_load_explicit(&phase_count[phase], memory_order_relaxed);
+        if (total_count == 0) continue;
+
+        // percentiles over the events still in the ring
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (events[i].phase == phase) durations[n++] = events[i].duration;
+        }
+        char p50[16] = "-", p99[16] = "-", max[16] = "-", total[16];
+        if (n > 0) {
+            qsort(durations, n, sizeof(uint64_t), compare_u64);
+            format_duration(p50, sizeof(p50), durations[(n - 1) / 2]);
+            format_duration(p99, sizeof(p99), durations[(n - 1) * 99 / 100]);
+            format_duration(max, sizeof(max), durations[n - 1]);
+        }
+        format_duration(total, sizeof(total), atomic_load_explicit(&phase_total[phase], memory_order_relaxed));
+
+        outbuf_printf(io->out, "%-10s %8lu %10s %10s %10s %10s\n", phase_names[phase],
+                      (unsigned long)total_count, p50, p99, max, total);
+    }
+    free(durations);
+}
+
+// Write the ring as Chrome trace event JSON (chrome://tracing, Perfetto)
+static int write_chrome_trace(const char *path, const TraceSnapshot *events, size_t count) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    int pid = (int)getpid();
+    fprintf(out, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < count; i++) {
+        fprintf(out, "{\"name\":\"%s\",\"cat\":\"shell\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}%s\n",
+                phase_names[events[i].phase], events[i].start / 1e3, events[i].duration / 1e3,
+                pid, events[i].tid, i + 1 < count ? "," : "");
+    }
+    fprintf(out, "],\"displayTimeUnit\":\"ns\"}\n");
+
+    if (fclose(out) != 0) {
+        perror(path);
+        return 1;
+    }
+    return 0;
+}
+
+// Forget everything recorded so far
+static void clear_stats(void) {
+    atomic_store_explicit(&ring_floor, atomic_load(&ring_head), memory_order_relaxed);
+    for (int phase = 0; phase < TRACE_PHASE_COUNT; phase++) {
+        atomic_store_explicit(&phase_count[phase], 0, memory_order_relaxed);
+        atomic_store_explicit(&phase_total[phase], 0, memory_order_relaxed);
+    }
+}
+
+// shellstats [-c] [-t file]: per-phase latency of the shell itself
+int handle_shellstats(char **argv, const BuiltinIO *io) {
+    bool clear = false;
+    const char *trace_path = NULL;
+
+    for (int i = 1; argv[i] != NULL; i++) {
+        if (strcmp(argv[i], "-c") == 0) {
+            clear = true;
+        } else if (strcmp(argv[i], "-t") == 0 && argv[i + 1] != NULL) {
+            trace_path = argv[++i];
+        } else {
+            outbuf_printf(io->err, "shellstats: usage: shellstats [-c] [-t file]\n");
+            return 2;
+        }
+    }
+
+    if (!trace_enabled) {
+        outbuf_printf(io->err, "shellstats: tracing is off, start the shell with SHELL_TRACE=1\n");
+        return 1;
+    }
+
+    TraceSnapshot *events = malloc(TRACE_RING_SIZE * sizeof(TraceSnapshot));
+    if (events == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    size_t count = snapshot_ring(events);
+
+    int status = 0;
+    if (trace_path != NULL) {
+        status = write_chrome_trace(trace_path, events, count);
+    } else if (!clear) {
+        print_stats(io, events, count);
+    }
+    free(events);
+
+    if (clear) {
+        clear_stats();
+    }
+    return status;
+}
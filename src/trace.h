@@ -0,0 +1,46 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "common.h"
+#include <stdint.h>
+
+// Phases of running a command that the shell times itself
+typedef enum {
+    TRACE_LINE,         // a whole command line, parse to last wait
+    TRACE_PARSE,        // tokenizing and parsing
+    TRACE_LOOKUP,       // finding a command in the hash table or PATH
+    TRACE_SPAWN,        // posix_spawn or fork
+    TRACE_REDIRECT,     // opening and wiring redirection targets
+    TRACE_WAIT,         // waiting for foreground processes
+    TRACE_BUILTIN,      // running a builtin's handler
+    TRACE_HISTORY,      // recording a line in the history list and file
+    TRACE_PHASE_COUNT
+} TracePhase;
+
+// Set once at startup; every probe tests it before doing anything else
+extern bool trace_enabled;
+
+// Turn tracing on when SHELL_TRACE is set to something other than "0".
+// The event ring is only allocated then.
+void trace_init(void);
+
+// CLOCK_MONOTONIC in nanoseconds
+uint64_t trace_now(void);
+
+// Record a phase that started at start (from trace_now) and ends now.
+// Safe to call from any thread.
+void trace_record(TracePhase phase, uint64_t start);
+
+// Probes: TRACE_BEGIN(t); ...; TRACE_END(TRACE_SPAWN, t);
+// When tracing is off each costs one predictable branch.
+#define TRACE_BEGIN(var) uint64_t var = trace_enabled ? trace_now() : 0
+#define TRACE_END(phase, var)               \
+    do {                                    \
+        if (trace_enabled) {                \
+            trace_record((phase), (var));   \
+        }                                   \
+    } while (0)
+
+int handle_shellstats(char **argv, const BuiltinIO *io);
+
+#endif
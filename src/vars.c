@@ -0,0 +1,498 @@
+#include "vars.h"
+#include "outbuf.h"
+#include <errno.h>
+#include <sys/stat.h>
+
+#define VAR_BUCKETS 256
+
+typedef struct Var {
+    char *name;
+    char *env;      // "NAME=value", NULL while declared without a value
+    int flags;
+    bool in_envp;   // env is referenced by the cached envp array
+    struct Var *next;
+} Var;
+
+static Var *buckets[VAR_BUCKETS];
+
+extern char **environ;
+
+// environment handed to new commands, rebuilt only when it is out of date
+static char **envp = NULL;
+static bool envp_dirty = true;
+
+// replaced "NAME=value" strings the cached envp may still point to; they
+// are freed once the array has been rebuilt without them
+static char **retired = NULL;
+static int retired_count = 0;
+static int retired_capacity = 0;
+
+static Var *find_var(const char *name) {
+    Var *var = buckets[hash_string(name) % VAR_BUCKETS];
+    while (var != NULL) {
+        if (strcmp(var->name, name) == 0) {
+            return var;
+        }
+        var = var->next;
+    }
+    return NULL;
+}
+
+static Var *new_var(const char *name) {
+    Var *var = calloc(1, sizeof(Var));
+    if (var == NULL) return NULL;
+    var->name = strdup(name);
+    if (var->name == NULL) {
+        free(var);
+        return NULL;
+    }
+
+    unsigned int bucket = hash_string(name) % VAR_BUCKETS;
+    var->next = buckets[bucket];
+    buckets[bucket] = var;
+    return var;
+}
+
+static void retire_env(char *env) {
+    if (retired_count == retired_capacity) {
+        int capacity = retired_capacity ? retired_capacity * 2 : 16;
+        char **grown = realloc(retired, capacity * sizeof(char *));
+        // if even that fails the string is leaked rather than left dangling
+        if (grown == NULL) return;
+        retired = grown;
+        retired_capacity = capacity;
+    }
+    retired[retired_count++] = env;
+}
+
+// let go of a variable's "NAME=value" string
+static void release_env(Var *var) {
+    if (var->env == NULL) return;
+
+    if (var->in_envp) {
+        retire_env(var->env);
+    } else {
+        free(var->env);
+    }
+    var->env = NULL;
+    var->in_envp = false;
+}
+
+bool var_valid_name(const char *name, size_t len) {
+    if (len == 0 || isdigit((unsigned char)name[0])) return false;
+    for (size_t i = 0; i < len; i++) {
+        if (!isalnum((unsigned char)name[i]) && name[i] != '_') return false;
+    }
+    return true;
+}
+
+void vars_init(void) {
+    for (char **entry = environ; *entry != NULL; entry++) {
+        const char *eq = strchr(*entry, '=');
+        if (eq == NULL || !var_valid_name(*entry, eq - *entry)) continue;
+
+        var_assign(*entry, VAR_EXPORT);
+    }
+}
+
+const char *var_get(const char *name) {
+    Var *var = find_var(name);
+    if (var == NULL || var->env == NULL) return NULL;
+    return var->env + strlen(var->name) + 1;
+}
+
+bool var_set(const char *name, const char *value, int flags) {
+    size_t name_len = strlen(name);
+    if (!var_valid_name(name, name_len)) return false;
+
+    Var *var = find_var(name);
+    if (var == NULL) {
+        var = new_var(name);
+        if (var == NULL) return false;
+    }
+
+    size_t value_len = strlen(value);
+    char *env = malloc(name_len + value_len + 2);
+    if (env == NULL) return false;
+    memcpy(env, name, name_len);
+    env[name_len] = '=';
+    memcpy(env + name_len + 1, value, value_len + 1);
+
+    release_env(var);
+    var->env = env;
+    var->flags |= flags;
+    if (var->flags & VAR_EXPORT) {
+        envp_dirty = true;
+    }
+    return true;
+}
+
+bool var_assign(const char *assignment, int flags) {
+    const char *eq = strchr(assignment, '=');
+    if (eq == NULL) return false;
+
+    char *name = strndup(assignment, eq - assignment);
+    if (name == NULL) return false;
+    bool ok = var_set(name, eq + 1, flags);
+    free(name);
+    return ok;
+}
+
+void var_export(const char *name, bool exported) {
+    Var *var = find_var(name);
+    if (var == NULL) {
+        if (!exported) return;
+        var = new_var(name);
+        if (var == NULL) return;
+    }
+
+    bool was_exported = (var->flags & VAR_EXPORT) != 0;
+    if (exported) {
+        var->flags |= VAR_EXPORT;
+    } else {
+        var->flags &= ~VAR_EXPORT;
+    }
+    if (was_exported != exported) {
+        envp_dirty = true;
+    }
+}
+
+void var_unset(const char *name) {
+    unsigned int bucket = hash_string(name) % VAR_BUCKETS;
+    for (Var **link = &buckets[bucket]; *link != NULL; link = &(*link)->next) {
+        Var *var = *link;
+        if (strcmp(var->name, name) != 0) continue;
+
+        if (var->flags & VAR_EXPORT) {
+            envp_dirty = true;
+        }
+        *link = var->next;
+        release_env(var);
+        free(var->name);
+        free(var);
+        return;
+    }
+}
+
+char **vars_environ(void) {
+    if (!envp_dirty && envp != NULL) {
+        return envp;
+    }
+
+    int count = 0;
+    for (int i = 0; i < VAR_BUCKETS; i++) {
+        for (Var *var = buckets[i]; var != NULL; var = var->next) {
+            if ((var->flags & VAR_EXPORT) && var->env != NULL) count++;
+        }
+    }
+
+    char **fresh = malloc((count + 1) * sizeof(char *));
+    if (fresh == NULL) {
+        // keep handing out the stale array rather than none
+        return envp != NULL ? envp : environ;
+    }
+
+    count = 0;
+    for (int i = 0; i < VAR_BUCKETS; i++) {
+        for (Var *var = buckets[i]; var != NULL; var = var->next) {
+            var->in_envp = (var->flags & VAR_EXPORT) && var->env != NULL;
+            if (var->in_envp) {
+                fresh[count++] = var->env;
+            }
+        }
+    }
+    fresh[count] = NULL;
+
+    // getenv() in libraries (readline, the locale code) sees the same values
+    environ = fresh;
+    free(envp);
+    envp = fresh;
+    envp_dirty = false;
+
+    for (int i = 0; i < retired_count; i++) {
+        free(retired[i]);
+    }
+    retired_count = 0;
+    return envp;
+}
+
+char **vars_environ_with(Arena *arena, char **assigns, int count) {
+    char **base = vars_environ();
+    if (count == 0) return base;
+
+    int base_count = 0;
+    while (base[base_count] != NULL) base_count++;
+
+    char **merged = arena_alloc(arena, (base_count + count + 1) * sizeof(char *));
+    if (merged == NULL) return base;
+
+    int n = 0;
+    for (int i = 0; i < base_count; i++) {
+        size_t name_len = strchr(base[i], '=') - base[i];
+        bool overridden = false;
+        for (int j = 0; j < count && !overridden; j++) {
+            overridden = strncmp(assigns[j], base[i], name_len + 1) == 0;
+        }
+        if (!overridden) {
+            merged[n++] = base[i];
+        }
+    }
+    for (int j = 0; j < count; j++) {
+        merged[n++] = assigns[j];
+    }
+    merged[n] = NULL;
+    return merged;
+}
+
+static int compare_vars(const void *a, const void *b) {
+    return strcmp((*(Var *const *)a)->name, (*(Var *const *)b)->name);
+}
+
+// export with no names lists the exported variables the way bash does
+static int list_exported(const BuiltinIO *io) {
+    int count = 0;
+    for (int i = 0; i < VAR_BUCKETS; i++) {
+        for (Var *var = buckets[i]; var != NULL; var = var->next) {
+            if (var->flags & VAR_EXPORT) count++;
+        }
+    }
+
+    Var **sorted = malloc((count > 0 ? count : 1) * sizeof(Var *));
+    if (sorted == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    count = 0;
+    for (int i = 0; i < VAR_BUCKETS; i++) {
+        for (Var *var = buckets[i]; var != NULL; var = var->next) {
+            if (var->flags & VAR_EXPORT) sorted[count++] = var;
+        }
+    }
+    qsort(sorted, count, sizeof(Var *), compare_vars);
+
+    for (int i = 0; i < count; i++) {
+        if (sorted[i]->env == NULL) {
+            outbuf_printf(io->out, "declare -x %s\n", sorted[i]->name);
+            continue;
+        }
+
+        // double quoted, with the characters special there escaped
+        outbuf_printf(io->out, "declare -x %s=\"", sorted[i]->name);
+        for (const char *p = var_get(sorted[i]->name); *p != '\0'; p++) {
+            if (*p == '"' || *p == '\\' || *p == '$' || *p == '`') {
+                outbuf_printf(io->out, "\\");
+            }
+            outbuf_printf(io->out, "%c", *p);
+        }
+        outbuf_printf(io->out, "\"\n");
+    }
+
+    free(sorted);
+    return 0;
+}
+
+// export [-n] [-p] [name[=value] ...]
+int handle_export(char **argv, const BuiltinIO *io) {
+    bool unexport = false;
+    int i = 1;
+    for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        } else if (strcmp(argv[i], "-n") == 0) {
+            unexport = true;
+        } else if (strcmp(argv[i], "-p") != 0) {
+            outbuf_printf(io->err, "export: %s: invalid option\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if (argv[i] == NULL) {
+        return list_exported(io);
+    }
+
+    int status = 0;
+    for (; argv[i] != NULL; i++) {
+        const char *eq = strchr(argv[i], '=');
+        size_t len = eq != NULL ? (size_t)(eq - argv[i]) : strlen(argv[i]);
+        if (!var_valid_name(argv[i], len)) {
+            outbuf_printf(io->err, "export: `%s': not a valid identifier\n", argv[i]);
+            status = 1;
+            continue;
+        }
+
+        char *name = strndup(argv[i], len);
+        if (name == NULL) {
+            perror("malloc");
+            return 1;
+        }
+        if (eq != NULL) {
+            var_set(name, eq + 1, 0);
+        }
+        var_export(name, !unexport);
+        free(name);
+    }
+    return status;
+}
+
+// unset [-v] name ...
+int handle_unset(char **argv, const BuiltinIO *io) {
+    int i = 1;
+    for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        // there are no shell functions, so -f has nothing to remove
+        if (strcmp(argv[i], "-v") != 0 && strcmp(argv[i], "-f") != 0) {
+            outbuf_printf(io->err, "unset: %s: invalid option\n", argv[i]);
+            return 2;
+        }
+    }
+
+    int status = 0;
+    for (; argv[i] != NULL; i++) {
+        if (!var_valid_name(argv[i], strlen(argv[i]))) {
+            outbuf_printf(io->err, "unset: `%s': not a valid identifier\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        var_unset(argv[i]);
+    }
+    return status;
+}
+
+#define READ_BLOCK_SIZE 4096
+
+static bool is_ifs_space(const char *ifs, char c) {
+    return (c == ' ' || c == '\t' || c == '\n') && strchr(ifs, c) != NULL;
+}
+
+// Read one line from fd and leave the rest of the input to whoever reads
+// next: a regular file is read in blocks and its offset put back after the
+// newline, anything else one byte at a time. Unless raw, a backslash
+// quotes the next character and joins a line to the one after. Returns 0
+// when a whole line was read, 1 at the end of the input, -1 on error.
+static int read_input_line(int fd, bool raw, char **line) {
+    struct stat st;
+    bool seekable = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    size_t block = seekable ? READ_BLOCK_SIZE : 1;
+    char buffer[READ_BLOCK_SIZE];
+
+    char *text = NULL;
+    size_t length = 0, capacity = 0;
+    bool escaped = false;
+    int result = 1;
+
+    while (result == 1) {
+        ssize_t n = read(fd, buffer, block);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) result = -1;
+        if (n <= 0) break;
+
+        ssize_t i = 0;
+        for (; i < n; i++) {
+            char c = buffer[i];
+            if (!escaped && c == '\n') {
+                result = 0;
+                i++;
+                break;
+            }
+            if (!escaped && c == '\\' && !raw) {
+                escaped = true;
+                continue;
+            }
+            bool continuation = escaped && c == '\n';
+            escaped = false;
+            if (continuation) continue;
+
+            if (length + 1 >= capacity) {
+                capacity = capacity ? capacity * 2 : 128;
+                char *grown = realloc(text, capacity);
+                if (grown == NULL) {
+                    free(text);
+                    return -1;
+                }
+                text = grown;
+            }
+            text[length++] = c;
+        }
+        if (seekable && i < n) {
+            lseek(fd, i - n, SEEK_CUR);
+        }
+    }
+
+    if (text == NULL) {
+        text = malloc(1);
+        if (text == NULL) return -1;
+    }
+    text[length] = '\0';
+    *line = text;
+    return result;
+}
+
+// read [-r] [name ...]: split a line of input on IFS into variables, the
+// last one taking the rest of the line; REPLY gets the whole line
+int handle_read(char **argv, const BuiltinIO *io) {
+    bool raw = false;
+    int i = 1;
+    for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        } else if (strcmp(argv[i], "-r") == 0) {
+            raw = true;
+        } else {
+            outbuf_printf(io->err, "read: %s: invalid option\n", argv[i]);
+            return 2;
+        }
+    }
+    for (int j = i; argv[j] != NULL; j++) {
+        if (!var_valid_name(argv[j], strlen(argv[j]))) {
+            outbuf_printf(io->err, "read: `%s': not a valid identifier\n", argv[j]);
+            return 1;
+        }
+    }
+
+    char *line;
+    int status = read_input_line(io->in, raw, &line);
+    if (status < 0) {
+        outbuf_printf(io->err, "read: read error: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if (argv[i] == NULL) {
+        var_set("REPLY", line, 0);
+        free(line);
+        return status;
+    }
+
+    const char *ifs = var_get("IFS");
+    if (ifs == NULL) ifs = " \t\n";
+    char *p = line;
+    for (; argv[i] != NULL; i++) {
+        while (*p != '\0' && is_ifs_space(ifs, *p)) p++;
+
+        if (argv[i + 1] == NULL) {
+            // the last name takes the rest, less trailing IFS whitespace
+            char *end = p + strlen(p);
+            while (end > p && is_ifs_space(ifs, end[-1])) end--;
+            *end = '\0';
+            var_set(argv[i], p, 0);
+            break;
+        }
+
+        char *end = p + strcspn(p, ifs);
+        char saved = *end;
+        *end = '\0';
+        var_set(argv[i], p, 0);
+        *end = saved;
+        p = end;
+        // one delimiter ends the field: a run of IFS whitespace, with at
+        // most one other IFS character in it
+        while (*p != '\0' && is_ifs_space(ifs, *p)) p++;
+        if (*p != '\0' && strchr(ifs, *p) != NULL && !is_ifs_space(ifs, *p)) p++;
+    }
+    free(line);
+    return status;
+}
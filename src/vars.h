@@ -0,0 +1,44 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include "common.h"
+#include "arena.h"
+
+// the variable is passed to commands in their environment
+#define VAR_EXPORT 0x1
+
+// Load the process environment into the variable store, all exported
+void vars_init(void);
+
+// Value of a shell variable, or NULL if it is unset
+const char *var_get(const char *name);
+
+// Set a variable and add flags to it. An exported variable stays exported.
+// Returns false if the name is not a valid identifier or memory ran out.
+bool var_set(const char *name, const char *value, int flags);
+
+// Mark a variable exported or not, declaring it without a value if needed
+void var_export(const char *name, bool exported);
+
+void var_unset(const char *name);
+
+// Set a variable from a "NAME=value" assignment word
+bool var_assign(const char *assignment, int flags);
+
+// Whether the first len characters of name form a valid variable name
+bool var_valid_name(const char *name, size_t len);
+
+// The environment for new commands: "NAME=value" for every exported
+// variable. The array is cached and rebuilt only after an exported
+// variable changed; environ is pointed at it so getenv() agrees.
+char **vars_environ(void);
+
+// vars_environ() with "NAME=value" assignments from before a command
+// name added or overriding; the array comes from the arena
+char **vars_environ_with(Arena *arena, char **assigns, int count);
+
+int handle_export(char **argv, const BuiltinIO *io);
+int handle_unset(char **argv, const BuiltinIO *io);
+int handle_read(char **argv, const BuiltinIO *io);
+
+#endif
@@ -0,0 +1,414 @@
+#include "wildcard.h"
+#include "dircache.h"
+#include <fnmatch.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+// threads walking the subtree under a "**", the caller included
+#define WALK_MAX_THREADS 8
+
+typedef struct {
+    char **paths;       // malloc'd, in the order found
+    int count;
+    int capacity;
+    bool failed;        // memory ran out, the list is incomplete
+} MatchList;
+
+typedef struct {
+    char **parts;       // the components between slashes, still escaped
+    int count;
+    bool dirs_only;     // the pattern ended in '/'
+} Pattern;
+
+// Directories still to visit under one "**", shared by its walkers
+typedef struct {
+    const Pattern *pattern;
+    int index;          // the "**" component
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    char **pending;
+    int pending_count;
+    int pending_capacity;
+    int busy;           // walkers visiting a directory, which may push more
+    bool failed;
+} Walk;
+
+typedef struct {
+    Walk *walk;
+    MatchList found;
+} Walker;
+
+// set on walker threads: a second "**" below the first is walked serially
+static _Thread_local bool in_walk = false;
+
+static void match_at(const Pattern *pattern, int index, const char *path, MatchList *out);
+
+static bool component_has_magic(const char *p, const char *end) {
+    for (; p < end; p++) {
+        if (*p == '\\' && p + 1 < end) {
+            p++;
+        } else if (*p == '*' || *p == '?') {
+            return true;
+        } else if (*p == '[') {
+            // "[" alone, as in the test command, is not a bracket expression;
+            // in "[]...]" the first ']' is a member
+            for (const char *q = p + 2; q < end; q++) {
+                if (*q == ']') return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool wildcard_has_magic(const char *pattern) {
+    while (*pattern != '\0') {
+        const char *slash = strchr(pattern, '/');
+        const char *end = slash != NULL ? slash : pattern + strlen(pattern);
+        if (component_has_magic(pattern, end)) return true;
+        if (slash == NULL) break;
+        pattern = slash + 1;
+    }
+    return false;
+}
+
+// path followed by name and, if slash, a '/'. path is empty or ends in '/'.
+static char *join(const char *path, const char *name, bool slash) {
+    size_t path_len = strlen(path), name_len = strlen(name);
+    char *joined = malloc(path_len + name_len + 2);
+    if (joined == NULL) return NULL;
+    memcpy(joined, path, path_len);
+    memcpy(joined + path_len, name, name_len);
+    if (slash) joined[path_len + name_len++] = '/';
+    joined[path_len + name_len] = '\0';
+    return joined;
+}
+
+// Take ownership of a malloc'd path, or of NULL when memory ran out
+static void add_match(MatchList *list, char *path) {
+    if (path == NULL) {
+        list->failed = true;
+        return;
+    }
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 64;
+        char **grown = realloc(list->paths, capacity * sizeof(char *));
+        if (grown == NULL) {
+            free(path);
+            list->failed = true;
+            return;
+        }
+        list->paths = grown;
+        list->capacity = capacity;
+    }
+    list->paths[list->count++] = path;
+}
+
+static void merge_matches(MatchList *into, MatchList *from) {
+    for (int i = 0; i < from->count; i++) {
+        add_match(into, from->paths[i]);
+    }
+    into->failed |= from->failed;
+    free(from->paths);
+}
+
+// Whether a directory entry is a directory. d_type answers without a
+// system call on most filesystems; a symlink is only followed if asked.
+static bool entry_is_dir(const char *path, const DirEntry *entry, bool follow) {
+    if (entry->type == DT_DIR) return true;
+    if (entry->type != DT_UNKNOWN && !(follow && entry->type == DT_LNK)) return false;
+
+    char *full = join(path, entry->name, false);
+    if (full == NULL) return false;
+    struct stat st;
+    bool dir = (follow ? stat(full, &st) : lstat(full, &st)) == 0 && S_ISDIR(st.st_mode);
+    free(full);
+    return dir;
+}
+
+// The entries of path matching the last component: every one for a
+// trailing "**", otherwise those fnmatch accepts
+static void match_last(const Pattern *pattern, const char *part, const char *path,
+                       const DirListing *listing, MatchList *out) {
+    bool any = part == NULL;
+    for (int i = 0; i < listing->count; i++) {
+        const DirEntry *entry = &listing->entries[i];
+        if (any ? entry->name[0] == '.' : fnmatch(part, entry->name, FNM_PERIOD) != 0) continue;
+
+        if (!pattern->dirs_only) {
+            add_match(out, join(path, entry->name, false));
+        } else if (entry_is_dir(path, entry, !any)) {
+            add_match(out, join(path, entry->name, true));
+        }
+    }
+}
+
+// Visit one directory under a "**": match the rest of the pattern there
+// and queue its subdirectories
+static void visit_dir(Walk *walk, const char *dir, MatchList *out) {
+    const Pattern *pattern = walk->pattern;
+    const DirListing *listing = dircache_get(*dir != '\0' ? dir : ".");
+    if (listing == NULL) return;
+
+    if (walk->index == pattern->count - 1) {
+        match_last(pattern, NULL, dir, listing, out);
+    } else {
+        match_at(pattern, walk->index + 1, dir, out);
+    }
+
+    // hidden directories are skipped and symlinks not followed, so a walk
+    // cannot loop
+    char **subdirs = NULL;
+    int count = 0;
+    for (int i = 0; i < listing->count; i++) {
+        const DirEntry *entry = &listing->entries[i];
+        if (entry->name[0] == '.' || !entry_is_dir(dir, entry, false)) continue;
+
+        if (subdirs == NULL) {
+            subdirs = malloc((listing->count - i) * sizeof(char *));
+            if (subdirs == NULL) {
+                out->failed = true;
+                break;
+            }
+        }
+        subdirs[count] = join(dir, entry->name, true);
+        if (subdirs[count] == NULL) {
+            out->failed = true;
+            break;
+        }
+        count++;
+    }
+    dircache_release(listing);
+    if (count == 0) {
+        free(subdirs);
+        return;
+    }
+
+    pthread_mutex_lock(&walk->lock);
+    if (walk->pending_count + count > walk->pending_capacity) {
+        int capacity = walk->pending_capacity ? walk->pending_capacity : 64;
+        while (walk->pending_count + count > capacity) capacity *= 2;
+        char **grown = realloc(walk->pending, capacity * sizeof(char *));
+        if (grown == NULL) {
+            walk->failed = true;
+            pthread_mutex_unlock(&walk->lock);
+            for (int i = 0; i < count; i++) free(subdirs[i]);
+            free(subdirs);
+            return;
+        }
+        walk->pending = grown;
+        walk->pending_capacity = capacity;
+    }
+    memcpy(walk->pending + walk->pending_count, subdirs, count * sizeof(char *));
+    walk->pending_count += count;
+    pthread_cond_broadcast(&walk->ready);
+    pthread_mutex_unlock(&walk->lock);
+    free(subdirs);
+}
+
+// Take directories off the queue until it is empty and no walker is
+// still visiting one that could add more
+static void *walk_worker(void *arg) {
+    Walker *walker = arg;
+    Walk *walk = walker->walk;
+    bool was_in_walk = in_walk;
+    in_walk = true;
+
+    pthread_mutex_lock(&walk->lock);
+    for (;;) {
+        while (walk->pending_count == 0 && walk->busy > 0) {
+            pthread_cond_wait(&walk->ready, &walk->lock);
+        }
+        if (walk->pending_count == 0) break;
+
+        char *dir = walk->pending[--walk->pending_count];
+        walk->busy++;
+        pthread_mutex_unlock(&walk->lock);
+
+        visit_dir(walk, dir, &walker->found);
+        free(dir);
+
+        pthread_mutex_lock(&walk->lock);
+        walk->busy--;
+        if (walk->busy == 0 && walk->pending_count == 0) {
+            pthread_cond_broadcast(&walk->ready);
+        }
+    }
+    pthread_mutex_unlock(&walk->lock);
+
+    in_walk = was_in_walk;
+    return NULL;
+}
+
+static int walk_threads(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) return 1;
+    return cpus < WALK_MAX_THREADS ? (int)cpus : WALK_MAX_THREADS;
+}
+
+// "**" at index: every directory from path down, path itself included
+static void walk_tree(const Pattern *pattern, int index, const char *path, MatchList *out) {
+    Walk walk = {0};
+    walk.pattern = pattern;
+    walk.index = index;
+    pthread_mutex_init(&walk.lock, NULL);
+    pthread_cond_init(&walk.ready, NULL);
+
+    walk.pending = malloc(64 * sizeof(char *));
+    char *root = strdup(path);
+    if (walk.pending == NULL || root == NULL) {
+        free(walk.pending);
+        free(root);
+        out->failed = true;
+        return;
+    }
+    walk.pending[0] = root;
+    walk.pending_count = 1;
+    walk.pending_capacity = 64;
+
+    int threads = in_walk ? 1 : walk_threads();
+    Walker walkers[WALK_MAX_THREADS];
+    pthread_t ids[WALK_MAX_THREADS];
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+        walkers[i] = (Walker){&walk, {NULL, 0, 0, false}};
+    }
+    // the caller is the first walker; a thread that fails to start is
+    // simply one walker fewer
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&ids[started], NULL, walk_worker, &walkers[started + 1]) != 0) break;
+        started++;
+    }
+    walk_worker(&walkers[0]);
+    for (int i = 0; i < started; i++) {
+        pthread_join(ids[i], NULL);
+    }
+
+    for (int i = 0; i <= started; i++) {
+        merge_matches(out, &walkers[i].found);
+    }
+    out->failed |= walk.failed;
+    free(walk.pending);
+    pthread_cond_destroy(&walk.ready);
+    pthread_mutex_destroy(&walk.lock);
+}
+
+// Remove the backslashes from a component without magic
+static char *unescape(const char *part) {
+    char *text = malloc(strlen(part) + 1);
+    if (text == NULL) return NULL;
+    size_t length = 0;
+    for (const char *p = part; *p != '\0'; p++) {
+        if (*p == '\\' && p[1] != '\0') p++;
+        text[length++] = *p;
+    }
+    text[length] = '\0';
+    return text;
+}
+
+// Match the components from index on inside path, which is empty for
+// the current directory or ends in '/'
+static void match_at(const Pattern *pattern, int index, const char *path, MatchList *out) {
+    const char *part = pattern->parts[index];
+    bool last = index == pattern->count - 1;
+
+    if (strcmp(part, "**") == 0) {
+        walk_tree(pattern, index, path, out);
+        return;
+    }
+
+    if (!component_has_magic(part, part + strlen(part))) {
+        // a literal name needs no listing; only the full path is checked
+        char *name = unescape(part);
+        char *next = name != NULL ? join(path, name, !last || pattern->dirs_only) : NULL;
+        free(name);
+        if (next == NULL) {
+            out->failed = true;
+            return;
+        }
+        if (!last) {
+            match_at(pattern, index + 1, next, out);
+            free(next);
+            return;
+        }
+        struct stat st;
+        if (pattern->dirs_only ? stat(next, &st) == 0 && S_ISDIR(st.st_mode) : lstat(next, &st) == 0) {
+            add_match(out, next);
+        } else {
+            free(next);
+        }
+        return;
+    }
+
+    const DirListing *listing = dircache_get(*path != '\0' ? path : ".");
+    if (listing == NULL) return;
+
+    if (last) {
+        match_last(pattern, part, path, listing, out);
+    } else {
+        for (int i = 0; i < listing->count; i++) {
+            const DirEntry *entry = &listing->entries[i];
+            if (fnmatch(part, entry->name, FNM_PERIOD) != 0) continue;
+            if (!entry_is_dir(path, entry, true)) continue;
+
+            char *dir = join(path, entry->name, true);
+            if (dir == NULL) {
+                out->failed = true;
+                break;
+            }
+            match_at(pattern, index + 1, dir, out);
+            free(dir);
+        }
+    }
+    dircache_release(listing);
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int wildcard_expand(Arena *arena, const char *text, char ***matches) {
+    *matches = NULL;
+
+    // split into components, dropping the empty ones between repeated slashes
+    char *copy = strdup(text);
+    char **parts = malloc((strlen(text) / 2 + 2) * sizeof(char *));
+    if (copy == NULL || parts == NULL) {
+        free(copy);
+        free(parts);
+        return -1;
+    }
+    Pattern pattern = {parts, 0, false};
+    size_t len = strlen(copy);
+    pattern.dirs_only = len > 0 && copy[len - 1] == '/';
+    char *saved;
+    for (char *part = strtok_r(copy, "/", &saved); part != NULL; part = strtok_r(NULL, "/", &saved)) {
+        parts[pattern.count++] = part;
+    }
+
+    MatchList found = {NULL, 0, 0, false};
+    if (pattern.count > 0) {
+        match_at(&pattern, 0, text[0] == '/' ? "/" : "", &found);
+    }
+    free(parts);
+    free(copy);
+
+    int count = found.failed ? -1 : found.count;
+    if (count > 0) {
+        qsort(found.paths, count, sizeof(char *), compare_paths);
+        *matches = arena_alloc(arena, (count + 1) * sizeof(char *));
+        for (int i = 0; i < count && *matches != NULL; i++) {
+            (*matches)[i] = arena_strdup(arena, found.paths[i]);
+            if ((*matches)[i] == NULL) *matches = NULL;
+        }
+        if (*matches == NULL) {
+            count = -1;
+        } else {
+            (*matches)[count] = NULL;
+        }
+    }
+    for (int i = 0; i < found.count; i++) {
+        free(found.paths[i]);
+    }
+    free(found.paths);
+    return count;
+}
@@ -0,0 +1,20 @@
+#ifndef WILDCARD_H
+#define WILDCARD_H
+
+#include "common.h"
+#include "arena.h"
+
+// Whether a pattern has an unescaped *, ? or a [...] bracket expression.
+// Patterns use fnmatch syntax: a backslash makes the next character literal.
+bool wildcard_has_magic(const char *pattern);
+
+// Expand a pathname pattern. Each '/'-separated component is matched
+// against the cached directory listings; a component of just "**" matches
+// any number of directories, walked on several threads. A trailing '/'
+// matches directories only. Names starting with '.' are only matched by a
+// literal '.'. The matches, sorted bytewise and allocated from the arena,
+// are stored in *matches. Returns how many there are, 0 when none, or -1
+// if memory ran out.
+int wildcard_expand(Arena *arena, const char *pattern, char ***matches);
+
+#endif
@@ -0,0 +1,120 @@
+#include "workdir.h"
+#include "vars.h"
+#include <errno.h>
+#include <sys/stat.h>
+
+static char *current = NULL;
+static unsigned long generation = 0;
+
+// Whether two paths name the same directory
+static bool same_dir(const char *a, const char *b) {
+    struct stat sa, sb;
+    return stat(a, &sa) == 0 && stat(b, &sb) == 0 && S_ISDIR(sa.st_mode) &&
+           sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+// An absolute path with no ".", ".." or repeated slashes in it; ".."
+// takes off the name before it, whatever that name links to
+static char *canonical_path(const char *path) {
+    size_t len = strlen(path);
+    char *result = malloc(len + 2);
+    if (result == NULL) return NULL;
+
+    size_t used = 0;
+    const char *p = path;
+    while (*p != '\0') {
+        while (*p == '/') p++;
+        const char *start = p;
+        while (*p != '\0' && *p != '/') p++;
+        size_t part = p - start;
+
+        if (part == 0 || (part == 1 && start[0] == '.')) continue;
+        if (part == 2 && start[0] == '.' && start[1] == '.') {
+            while (used > 0 && result[used - 1] != '/') used--;
+            if (used > 0) used--;
+            continue;
+        }
+        result[used++] = '/';
+        memcpy(result + used, start, part);
+        used += part;
+    }
+    if (used == 0) result[used++] = '/';
+    result[used] = '\0';
+    return result;
+}
+
+static void set_current(char *path) {
+    if (current != NULL) {
+        var_set("OLDPWD", current, VAR_EXPORT);
+    }
+    free(current);
+    current = path;
+    generation++;
+    if (current != NULL) {
+        var_set("PWD", current, VAR_EXPORT);
+    }
+}
+
+void workdir_init(void) {
+    const char *pwd = var_get("PWD");
+    if (pwd != NULL && pwd[0] == '/' && same_dir(pwd, ".")) {
+        char *path = canonical_path(pwd);
+        // PWD may spell the directory with "..": only a plain one is kept
+        if (path != NULL && strcmp(path, pwd) == 0) {
+            current = path;
+        } else {
+            free(path);
+        }
+    }
+    if (current == NULL) {
+        current = getcwd(NULL, 0);
+    }
+    generation++;
+    if (current != NULL) {
+        var_set("PWD", current, VAR_EXPORT);
+    }
+}
+
+const char *workdir_get(void) {
+    return current;
+}
+
+unsigned long workdir_generation(void) {
+    return generation;
+}
+
+int workdir_change(const char *path, bool physical) {
+    char *logical = NULL;
+    if (!physical) {
+        if (path[0] == '/' || current == NULL) {
+            logical = canonical_path(path);
+        } else {
+            size_t base = strlen(current);
+            char *joined = malloc(base + strlen(path) + 2);
+            if (joined == NULL) return ENOMEM;
+            sprintf(joined, "%s/%s", current, path);
+            logical = canonical_path(joined);
+            free(joined);
+        }
+        if (logical == NULL) return ENOMEM;
+    }
+
+    if (logical != NULL && chdir(logical) == 0) {
+        set_current(logical);
+        return 0;
+    }
+    free(logical);
+
+    // "cd -P", or a logical path that does not work because ".." of a
+    // link is not the link's parent: follow the kernel
+    if (chdir(path) != 0) {
+        return errno;
+    }
+    char *resolved = getcwd(NULL, 0);
+    if (resolved == NULL) {
+        // the directory has no name we can give; keep what we had
+        resolved = current != NULL ? strdup(current) : NULL;
+    }
+    set_current(resolved);
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef WORKDIR_H
+#define WORKDIR_H
+
+#include "common.h"
+
+// Take the logical working directory from PWD when it names the directory
+// the shell is in, from getcwd otherwise, and export PWD
+void workdir_init(void);
+
+// The logical working directory: the path cd took to get here, symlinks
+// as typed. Kept by cd, so reading it costs no getcwd. NULL only when the
+// directory could not be named at startup.
+const char *workdir_get(void);
+
+// Changes with every change of directory
+unsigned long workdir_generation(void);
+
+// Change to path, resolved against the logical directory with "." and
+// ".." removed by name, or as the kernel sees it when physical is true.
+// PWD and OLDPWD follow. Returns 0, or an errno value with nothing changed.
+int workdir_change(const char *path, bool physical);
+
+#endif